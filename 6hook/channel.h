@@ -0,0 +1,504 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <utility>
+#include "fiberSync.h"
+
+// Go风格的协程通道
+// 缓冲区是无锁环形队列：没有等待者时send/recv只是一次CAS加一次原子读，不碰互斥锁；
+// 只有缓冲区满/空需要挂起，或者需要唤醒对端时才进入互斥锁保护的慢路径
+
+namespace nsCoroutine
+{
+    // 有界无锁多生产者多消费者环形队列（Vyukov算法），每个槽位用序号区分"可写"和"可读"
+    // 容量至少为2：容量为1时"位置p可读"和"位置p+1可写"的序号相同，无法区分
+    template <typename T>
+    class ChannelRing
+    {
+    public:
+        explicit ChannelRing(size_t capacity)
+            : _m_capacity(capacity), _m_cells(new Cell[capacity])
+        {
+            for (size_t i = 0; i < capacity; ++i)
+            {
+                _m_cells[i].seq.store(i, std::memory_order_relaxed);
+            }
+        }
+
+        ~ChannelRing()
+        {
+            // 析构时已经没有并发访问，直接析构剩余元素
+            size_t tail = _m_tail.load(std::memory_order_relaxed);
+            for (size_t pos = _m_head.load(std::memory_order_relaxed); pos != tail; ++pos)
+            {
+                _m_cells[pos % _m_capacity].ptr()->~T();
+            }
+        }
+
+        ChannelRing(const ChannelRing &) = delete;
+        ChannelRing &operator=(const ChannelRing &) = delete;
+
+        // 队列满返回false，此时v不会被移动
+        template <typename U>
+        bool push(U &&v)
+        {
+            size_t pos = _m_tail.load(std::memory_order_relaxed);
+            while (true)
+            {
+                Cell &cell = _m_cells[pos % _m_capacity];
+                size_t seq = cell.seq.load(std::memory_order_acquire);
+                intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+                if (diff == 0)
+                {
+                    if (_m_tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    {
+                        new (cell.storage) T(std::forward<U>(v));
+                        cell.seq.store(pos + 1, std::memory_order_release);
+                        return true;
+                    }
+                }
+                else if (diff < 0)
+                {
+                    return false;
+                }
+                else
+                {
+                    pos = _m_tail.load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+        // 队列空返回false
+        bool pop(T &out)
+        {
+            size_t pos = _m_head.load(std::memory_order_relaxed);
+            while (true)
+            {
+                Cell &cell = _m_cells[pos % _m_capacity];
+                size_t seq = cell.seq.load(std::memory_order_acquire);
+                intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+                if (diff == 0)
+                {
+                    if (_m_head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    {
+                        T *p = cell.ptr();
+                        out = std::move(*p);
+                        p->~T();
+                        cell.seq.store(pos + _m_capacity, std::memory_order_release);
+                        return true;
+                    }
+                }
+                else if (diff < 0)
+                {
+                    return false;
+                }
+                else
+                {
+                    pos = _m_head.load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+        // 近似的元素个数，包括正在写入、还没发布的槽位
+        size_t size() const
+        {
+            size_t head = _m_head.load(std::memory_order_acquire);
+            size_t tail = _m_tail.load(std::memory_order_acquire);
+            return tail > head ? tail - head : 0;
+        }
+        size_t capacity() const { return _m_capacity; }
+
+    private:
+        struct Cell
+        {
+            std::atomic<size_t> seq;
+            alignas(T) unsigned char storage[sizeof(T)];
+            T *ptr() { return reinterpret_cast<T *>(storage); }
+        };
+
+        const size_t _m_capacity;
+        std::unique_ptr<Cell[]> _m_cells;
+        alignas(64) std::atomic<size_t> _m_head{0}; // 消费者位置
+        alignas(64) std::atomic<size_t> _m_tail{0}; // 生产者位置
+    };
+
+    // 通道一端的等待队列，只在通道的互斥锁内访问
+    // 节点里记录唤醒时用的结果值：普通send/recv用NOTIFIED，select用各自分支的编号
+    class ChannelWaitQueue
+    {
+    public:
+        void push(const std::shared_ptr<FiberWaiter> &waiter, int result)
+        {
+            _m_nodes.push_back(Node{waiter, result});
+        }
+
+        // 取出第一个还能被唤醒的等待者并claim，跳过已经超时或已被别的分支唤醒的节点
+        // 返回的等待者需要在解锁后调用resume()
+        std::shared_ptr<FiberWaiter> claimOne(size_t &removed)
+        {
+            while (!_m_nodes.empty())
+            {
+                Node node = std::move(_m_nodes.front());
+                _m_nodes.pop_front();
+                ++removed;
+                if (node.waiter->claim(node.result))
+                {
+                    return std::move(node.waiter);
+                }
+            }
+            return nullptr;
+        }
+
+        // 移出指定等待者的节点，返回是否找到
+        bool remove(const FiberWaiter *waiter)
+        {
+            for (auto it = _m_nodes.begin(); it != _m_nodes.end(); ++it)
+            {
+                if (it->waiter.get() == waiter)
+                {
+                    _m_nodes.erase(it);
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        // 取走全部节点
+        size_t takeAll(std::deque<std::shared_ptr<FiberWaiter>> &out, std::deque<int> &results)
+        {
+            size_t n = _m_nodes.size();
+            for (auto &node : _m_nodes)
+            {
+                out.push_back(std::move(node.waiter));
+                results.push_back(node.result);
+            }
+            _m_nodes.clear();
+            return n;
+        }
+
+    private:
+        struct Node
+        {
+            std::shared_ptr<FiberWaiter> waiter;
+            int result;
+        };
+        std::deque<Node> _m_nodes;
+    };
+
+    // 协程通道
+    // capacity为缓冲区大小，受环形队列限制最小为2（没有Go那样的无缓冲通道）；UNBOUNDED表示无界：缓冲区满时多出的消息放进锁保护的溢出队列，send永远不会挂起
+    // send/recv在缓冲区满/空时挂起当前协程，由对端通过FiberWaiter唤醒；不在任务协程里调用时阻塞线程
+    // 出错时返回false并设置errno：EPIPE通道已关闭（recv要等缓冲区取空后才返回EPIPE），ETIMEDOUT超时，EAGAIN（try版本）暂时无法完成
+    template <typename T>
+    class Channel
+    {
+    public:
+        static const size_t UNBOUNDED = (size_t)-1;
+        // 无界通道中无锁环形队列的大小
+        static const size_t UNBOUNDED_RING_SIZE = 1024;
+
+        explicit Channel(size_t capacity)
+            : _m_unbounded(capacity == UNBOUNDED),
+              _m_ring(capacity == UNBOUNDED ? UNBOUNDED_RING_SIZE : std::max<size_t>(capacity, 2))
+        {
+        }
+
+        Channel(const Channel &) = delete;
+        Channel &operator=(const Channel &) = delete;
+
+        bool send(const T &v) { return sendImpl(v, 0, false); }
+        bool send(T &&v) { return sendImpl(v, 0, false); }
+        // 最多等待ms毫秒
+        bool sendFor(const T &v, uint64_t ms) { return sendImpl(v, ms, true); }
+        bool sendFor(T &&v, uint64_t ms) { return sendImpl(v, ms, true); }
+        // 不挂起，失败时v保持不变
+        bool trySend(T &v)
+        {
+            if (trySendImpl(v))
+            {
+                return true;
+            }
+            errno = _m_closed.load(std::memory_order_acquire) ? EPIPE : EAGAIN;
+            return false;
+        }
+
+        bool recv(T &out) { return recvImpl(out, 0, false); }
+        // 最多等待ms毫秒
+        bool recvFor(T &out, uint64_t ms) { return recvImpl(out, ms, true); }
+        // 不挂起
+        bool tryRecv(T &out)
+        {
+            if (tryRecvImpl(out))
+            {
+                return true;
+            }
+            errno = isDrained() ? EPIPE : EAGAIN;
+            return false;
+        }
+
+        // 关闭通道：之后的send都失败，recv取空剩余消息后失败，所有挂起的协程被唤醒
+        void close()
+        {
+            std::deque<std::shared_ptr<FiberWaiter>> waiters;
+            std::deque<int> results;
+            {
+                std::lock_guard<std::mutex> lock(_m_mutex);
+                if (_m_closed.exchange(true, std::memory_order_acq_rel))
+                {
+                    return;
+                }
+                _m_recvWaiting.fetch_sub(_m_recvq.takeAll(waiters, results), std::memory_order_relaxed);
+                _m_sendWaiting.fetch_sub(_m_sendq.takeAll(waiters, results), std::memory_order_relaxed);
+            }
+            for (size_t i = 0; i < waiters.size(); ++i)
+            {
+                waiters[i]->wake(results[i]);
+            }
+        }
+
+        bool isClosed() const { return _m_closed.load(std::memory_order_acquire); }
+        // 近似的缓冲消息数
+        size_t size() const { return _m_ring.size() + _m_overflowSize.load(std::memory_order_acquire); }
+        size_t capacity() const { return _m_unbounded ? UNBOUNDED : _m_ring.capacity(); }
+
+        // 以下供Select使用：在等待队列里登记一个等待者，被唤醒时claim(result)
+        // 登记前在锁内再检查一次，已经可以完成（或通道已关闭）时不登记，返回false
+        bool watchRecv(const std::shared_ptr<FiberWaiter> &waiter, int result)
+        {
+            std::lock_guard<std::mutex> lock(_m_mutex);
+            _m_recvWaiting.fetch_add(1, std::memory_order_seq_cst);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (_m_ring.size() > 0 || _m_overflowSize.load(std::memory_order_relaxed) > 0 || _m_closed.load(std::memory_order_relaxed))
+            {
+                _m_recvWaiting.fetch_sub(1, std::memory_order_relaxed);
+                return false;
+            }
+            _m_recvq.push(waiter, result);
+            return true;
+        }
+
+        bool watchSend(const std::shared_ptr<FiberWaiter> &waiter, int result)
+        {
+            std::lock_guard<std::mutex> lock(_m_mutex);
+            _m_sendWaiting.fetch_add(1, std::memory_order_seq_cst);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (_m_unbounded || _m_ring.size() < _m_ring.capacity() || _m_closed.load(std::memory_order_relaxed))
+            {
+                _m_sendWaiting.fetch_sub(1, std::memory_order_relaxed);
+                return false;
+            }
+            _m_sendq.push(waiter, result);
+            return true;
+        }
+
+        void unwatchRecv(const FiberWaiter *waiter)
+        {
+            std::lock_guard<std::mutex> lock(_m_mutex);
+            if (_m_recvq.remove(waiter))
+            {
+                _m_recvWaiting.fetch_sub(1, std::memory_order_relaxed);
+            }
+        }
+
+        void unwatchSend(const FiberWaiter *waiter)
+        {
+            std::lock_guard<std::mutex> lock(_m_mutex);
+            if (_m_sendq.remove(waiter))
+            {
+                _m_sendWaiting.fetch_sub(1, std::memory_order_relaxed);
+            }
+        }
+
+        // 关闭且缓冲区已取空，recv不可能再成功
+        bool isDrained() const
+        {
+            return _m_closed.load(std::memory_order_acquire) && _m_ring.size() == 0 && _m_overflowSize.load(std::memory_order_acquire) == 0;
+        }
+
+        // 不挂起地发送/接收，不设置errno
+        template <typename U>
+        bool trySendImpl(U &v)
+        {
+            if (_m_closed.load(std::memory_order_acquire))
+            {
+                return false;
+            }
+            // 溢出队列非空时新消息必须排在它后面，否则同一个发送者的消息会乱序
+            if (_m_overflowSize.load(std::memory_order_acquire) == 0 && _m_ring.push(std::move(v)))
+            {
+                // 发布之后再看有没有接收方在等；与watchRecv里的先登记再检查配对，二者至少有一方能看到对方
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                if (_m_recvWaiting.load(std::memory_order_relaxed) > 0)
+                {
+                    notify(_m_recvq, _m_recvWaiting);
+                }
+                return true;
+            }
+            if (!_m_unbounded)
+            {
+                return false;
+            }
+            std::shared_ptr<FiberWaiter> waiter;
+            {
+                std::lock_guard<std::mutex> lock(_m_mutex);
+                if (_m_closed.load(std::memory_order_relaxed))
+                {
+                    return false;
+                }
+                _m_overflow.push_back(std::move(v));
+                _m_overflowSize.fetch_add(1, std::memory_order_release);
+                size_t removed = 0;
+                waiter = _m_recvq.claimOne(removed);
+                _m_recvWaiting.fetch_sub(removed, std::memory_order_relaxed);
+            }
+            if (waiter)
+            {
+                waiter->resume();
+            }
+            return true;
+        }
+
+        bool tryRecvImpl(T &out)
+        {
+            if (!_m_ring.pop(out))
+            {
+                if (_m_overflowSize.load(std::memory_order_acquire) == 0 || !popOverflow(out))
+                {
+                    return false;
+                }
+                return true;
+            }
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (_m_sendWaiting.load(std::memory_order_relaxed) > 0)
+            {
+                notify(_m_sendq, _m_sendWaiting);
+            }
+            return true;
+        }
+
+    private:
+        template <typename U>
+        bool sendImpl(U &v, uint64_t ms, bool timed)
+        {
+            auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(ms);
+            while (true)
+            {
+                if (trySendImpl(v))
+                {
+                    return true;
+                }
+                if (_m_closed.load(std::memory_order_acquire))
+                {
+                    errno = EPIPE;
+                    return false;
+                }
+                std::shared_ptr<FiberWaiter> waiter = std::make_shared<FiberWaiter>(timed);
+                if (!watchSend(waiter, FiberWaiter::NOTIFIED))
+                {
+                    continue;
+                }
+                if (!park(waiter, deadline, timed))
+                {
+                    unwatchSend(waiter.get());
+                    errno = waiter->result() == FiberWaiter::CANCELED ? ECANCELED : ETIMEDOUT;
+                    return false;
+                }
+            }
+        }
+
+        bool recvImpl(T &out, uint64_t ms, bool timed)
+        {
+            auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(ms);
+            while (true)
+            {
+                if (tryRecvImpl(out))
+                {
+                    return true;
+                }
+                if (isDrained())
+                {
+                    errno = EPIPE;
+                    return false;
+                }
+                std::shared_ptr<FiberWaiter> waiter = std::make_shared<FiberWaiter>(timed);
+                if (!watchRecv(waiter, FiberWaiter::NOTIFIED))
+                {
+                    continue;
+                }
+                if (!park(waiter, deadline, timed))
+                {
+                    unwatchRecv(waiter.get());
+                    errno = waiter->result() == FiberWaiter::CANCELED ? ECANCELED : ETIMEDOUT;
+                    return false;
+                }
+            }
+        }
+
+        // 挂起直到被唤醒，超时或被取消返回false。被唤醒只表示"可能可以继续了"，调用方要重试
+        static bool park(const std::shared_ptr<FiberWaiter> &waiter, std::chrono::steady_clock::time_point deadline, bool timed)
+        {
+            if (!timed)
+            {
+                return waiter->wait() != FiberWaiter::CANCELED;
+            }
+            auto now = std::chrono::steady_clock::now();
+            uint64_t left = now < deadline ? std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now).count() : 0;
+            return waiter->waitFor(left);
+        }
+
+        // 唤醒一端的一个等待者
+        void notify(ChannelWaitQueue &queue, std::atomic<size_t> &waiting)
+        {
+            std::shared_ptr<FiberWaiter> waiter;
+            {
+                std::lock_guard<std::mutex> lock(_m_mutex);
+                size_t removed = 0;
+                waiter = queue.claimOne(removed);
+                waiting.fetch_sub(removed, std::memory_order_relaxed);
+            }
+            if (waiter)
+            {
+                waiter->resume();
+            }
+        }
+
+        // 从溢出队列取一条消息，顺便把后面的消息搬进环形队列，让后续接收重新走无锁路径
+        bool popOverflow(T &out)
+        {
+            std::lock_guard<std::mutex> lock(_m_mutex);
+            if (_m_overflow.empty())
+            {
+                return false;
+            }
+            out = std::move(_m_overflow.front());
+            _m_overflow.pop_front();
+            while (!_m_overflow.empty() && _m_ring.push(std::move(_m_overflow.front())))
+            {
+                _m_overflow.pop_front();
+            }
+            _m_overflowSize.store(_m_overflow.size(), std::memory_order_release);
+            return true;
+        }
+
+    private:
+        const bool _m_unbounded;
+        ChannelRing<T> _m_ring;
+        std::atomic<bool> _m_closed{false};
+        // 登记在等待队列里的协程数，快路径只在它们非零时才加锁去唤醒
+        alignas(64) std::atomic<size_t> _m_recvWaiting{0};
+        alignas(64) std::atomic<size_t> _m_sendWaiting{0};
+        std::atomic<size_t> _m_overflowSize{0};
+        std::mutex _m_mutex; // 保护等待队列和溢出队列
+        ChannelWaitQueue _m_recvq;
+        ChannelWaitQueue _m_sendq;
+        std::deque<T> _m_overflow;
+    };
+}
@@ -0,0 +1,42 @@
+#include "deadline.h"
+
+#include <chrono>
+
+namespace nsCoroutine
+{
+    uint64_t NowMonoMs()
+    {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    uint64_t deadline_left_ms()
+    {
+        uint64_t deadline = Fiber::GetThisRaw()->getDeadline();
+        if (deadline == 0)
+        {
+            return (uint64_t)-1;
+        }
+        uint64_t now = NowMonoMs();
+        return deadline > now ? deadline - now : 0;
+    }
+
+    DeadlineScope::DeadlineScope(uint64_t timeout_ms)
+        : _m_fiber(Fiber::GetThisRaw()), _m_saved(_m_fiber->getDeadline())
+    {
+        // 0表示没有截止时间，算出来的截止时间至少为1
+        uint64_t deadline = NowMonoMs() + timeout_ms;
+        if (deadline == 0)
+        {
+            deadline = 1;
+        }
+        if (_m_saved == 0 || deadline < _m_saved)
+        {
+            _m_fiber->setDeadline(deadline);
+        }
+    }
+
+    DeadlineScope::~DeadlineScope()
+    {
+        _m_fiber->setDeadline(_m_saved);
+    }
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdint>
+#include "fiber.h"
+
+// 协程的截止时间（端到端预算）
+// 套接字的SO_RCVTIMEO/SO_SNDTIMEO只管单次调用，一个请求可能经过很多次I/O；截止时间属于整个请求：
+// 设置之后，当前协程里hook的I/O、connect、sleep都不会等过截止时间，到期返回-1且errno = ETIMEDOUT
+// 用spawn()/TaskGroup::spawn()启动的协程继承父协程的截止时间
+//
+//  DeadlineScope budget(200);   // 本请求最多再用200ms
+//  recv(fd, ...);              // 超过预算返回ETIMEDOUT
+
+namespace nsCoroutine
+{
+    // 单调时钟的当前时间(ms)，截止时间都以它为基准
+    uint64_t NowMonoMs();
+
+    // 当前协程剩余的预算(ms)：没有截止时间返回(uint64_t)-1，已经用完返回0
+    uint64_t deadline_left_ms();
+
+    // 在作用域内给当前协程设置timeout_ms之后的截止时间，析构时恢复原来的截止时间
+    // 嵌套时只能收紧：外层的截止时间更早的话保持外层的
+    class DeadlineScope
+    {
+    public:
+        explicit DeadlineScope(uint64_t timeout_ms);
+        ~DeadlineScope();
+        DeadlineScope(const DeadlineScope &) = delete;
+        DeadlineScope &operator=(const DeadlineScope &) = delete;
+
+    private:
+        Fiber *_m_fiber;
+        uint64_t _m_saved;
+    };
+}
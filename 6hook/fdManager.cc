@@ -1,5 +1,6 @@
 #include "fdManager.h"
 #include "hook.h"
+#include "log.h"
 
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -45,10 +46,13 @@ namespace nsCoroutine
             m_isInit = true;
             // S_ISSOCK(statbuf.st_mode) SISSOCK是一个宏，用于检查'st_mode'中的位，以确定文件是否是一个套接字(socket)。该宏定义在<sys/stat.h>头文件中。
             m_isSocket = S_ISSOCK(statbuf.st_mode);
+            // 管道/FIFO，以及eventfd、timerfd这类匿名inode（文件类型位为0）也能用epoll等待
+            m_isPollable = m_isSocket || S_ISFIFO(statbuf.st_mode) || (statbuf.st_mode & S_IFMT) == 0;
         }
 
-        // 如果是套接字就设置为非阻塞
-        if (m_isSocket)
+        // 能用epoll等待的fd设置为非阻塞，I/O返回EAGAIN时挂起协程
+        // 注意O_NONBLOCK属于打开的文件描述（file description），和fork出去的子进程共享的管道在子进程里同样是非阻塞的
+        if (m_isPollable)
         {
             // 获取文件描述符的状态
             int flags = fcntl_f(m_fd, F_GETFL, 0);
@@ -62,7 +66,7 @@ namespace nsCoroutine
         }
         else
         {
-            // 如果不是套接字就没必要设置非阻塞
+            // 普通文件设置非阻塞也没有用，它们的读写交给卸载池
             m_sysNonblock = false;
         }
 
@@ -85,7 +89,7 @@ namespace nsCoroutine
         {
             m_recvTimeout = -1;
             m_sendTimeout = -1;
-            std::cout << "type error" << std::endl;
+            LOG_ERROR("FdCtx::setTimeout type error: {}", type);
         }
     }
 
@@ -102,8 +106,8 @@ namespace nsCoroutine
         //type无效
         else
         {
+            LOG_ERROR("FdCtx::getTimeout type error: {}", type);
             return -1;
-            std::cout << "type error" << std::endl;
         }
     }
 
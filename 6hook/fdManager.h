@@ -13,6 +13,7 @@ namespace nsCoroutine
     private:
         bool m_isInit = false; //标记文件描述符是否已初始化
         bool m_isSocket = false; //标记文件描述符是否是一个套接字
+        bool m_isPollable = false; //标记文件描述符能否用epoll等待（套接字、管道、eventfd等），这类fd走异步路径
         bool m_sysNonblock = false; //标记文件描述符是否设置为系统非阻塞模式
         bool m_userNonblock = false; //标记文件描述符是否设置为用户非阻塞模式 
         bool m_isClosed = false; //标记文件描述符是否已关闭
@@ -31,6 +32,7 @@ namespace nsCoroutine
         bool init();
         bool isInit() const { return m_isInit; }
         bool isSocket() const { return m_isSocket; }
+        bool isPollable() const { return m_isPollable; }
         bool isClosed() const { return m_isClosed; }
 
         // 设置和获取用户层面的非阻塞状态
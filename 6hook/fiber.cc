@@ -1,6 +1,10 @@
 #include "fiber.h"
+#include "log.h"
 
-static bool debug = false;
+#include <cstring>
+#include <csignal>
+#include <execinfo.h>
+#include <sys/mman.h>
 
 namespace nsCoroutine
 {
@@ -16,8 +20,234 @@ namespace nsCoroutine
     static std::atomic<uint64_t> s_fiber_id{0};
     //s_fiber_count: 活跃协程数量计数器
     static std::atomic<uint64_t> s_fiber_count{0};
-    //子协程栈默认大小
-    const size_t DEFAULT_STACK_SIZE = 128 * 1024;
+    //子协程栈默认大小，可以用SetDefaultStackSize按栈用量统计调整
+    static std::atomic<size_t> s_default_stack_size{128 * 1024};
+    //是否统计栈用量
+    static std::atomic<bool> s_stack_profiling{false};
+    //栈用量统计
+    static std::atomic<uint64_t> s_stack_fibers{0};
+    static std::atomic<uint64_t> s_stack_total{0};
+    static std::atomic<uint64_t> s_stack_max{0};
+    static std::atomic<uint64_t> s_stack_histogram[Fiber::STACK_HISTOGRAM_BUCKETS];
+
+    static size_t PageSize()
+    {
+        static const size_t s_page = sysconf(_SC_PAGESIZE);
+        return s_page;
+    }
+
+    //是否在栈底放保护页
+    static std::atomic<bool> s_stack_guard{true};
+
+    //当前带保护页的栈数量
+    static std::atomic<size_t> s_guarded_stacks{0};
+
+    //带保护页的栈最多占用vm.max_map_count的3/4：每个占两个VMA（保护页和栈），
+    //超出后的栈不带保护页，相邻的无保护栈会合并成一个VMA，最坏情况下夹在两个带保护页的栈之间再多占一个
+    //映射数一旦超过上限，连能合并的mmap也会失败，所以要在用完之前就停止加保护页
+    static size_t GuardedStackLimit()
+    {
+        static const size_t s_limit = []()
+        {
+            size_t max_map_count = 65530;
+            FILE *fp = fopen("/proc/sys/vm/max_map_count", "r");
+            if(fp)
+            {
+                unsigned long n = 0;
+                if(fscanf(fp, "%lu", &n) == 1 && n > 0)
+                {
+                    max_map_count = n;
+                }
+                fclose(fp);
+            }
+            return max_map_count / 4;
+        }();
+        return s_limit;
+    }
+
+    //用mmap分配协程栈：MAP_NORESERVE不预留交换空间，页面第一次被访问时才真正分配，
+    //没用到的部分既不算RSS也不会被malloc的元数据写入。大小向上取整到页
+    //guard不为0时在栈底（低地址）多映射guard字节并设为不可访问，栈溢出时立即触发SIGSEGV而不是悄悄写坏相邻内存
+    //带保护页的栈达到GuardedStackLimit()或者mprotect失败时退回没有保护页的栈：整段映射都当作栈，size加上guard、guard置0，
+    //第一次退回时打印一条警告
+    //返回可用部分的起始地址
+    static void *StackAlloc(size_t &size, size_t &guard)
+    {
+        static std::atomic<bool> s_warned{false};
+        const char *reason = nullptr;
+        if(guard && s_guarded_stacks.fetch_add(1) >= GuardedStackLimit())
+        {
+            s_guarded_stacks.fetch_sub(1);
+            reason = "guarded stack limit reached";
+        }
+        char *p = (char *)mmap(nullptr, size + guard, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_STACK, -1, 0);
+        if(p == MAP_FAILED)
+        {
+            std::cerr << "StackAlloc: mmap " << size << " bytes failed\n";
+            abort();
+        }
+        if(guard && !reason && mprotect(p, guard, PROT_NONE) != 0)
+        {
+            s_guarded_stacks.fetch_sub(1);
+            reason = strerror(errno);
+        }
+        if(!reason)
+        {
+            return p + guard;
+        }
+        size += guard;
+        guard = 0;
+        //日志可能还要分配内存，放在栈分配完之后
+        if(!s_warned.exchange(true))
+        {
+            LOG_WARN("StackAlloc: no guard page ({}), {} guarded stacks, later fiber stacks may be unguarded; raise vm.max_map_count or call Fiber::SetStackGuard(false)",
+                     reason, s_guarded_stacks.load());
+        }
+        return p;
+    }
+
+    static void StackFree(void *stack, size_t size, size_t guard)
+    {
+        if(guard)
+        {
+            s_guarded_stacks.fetch_sub(1);
+        }
+        munmap((char *)stack - guard, size + guard);
+    }
+
+    static size_t StackRoundUp(size_t size)
+    {
+        size_t page = PageSize();
+        return (size + page - 1) / page * page;
+    }
+
+    //SIGSEGV原来的处理方式，不是协程栈溢出时交还给它
+    static struct sigaction s_old_segv;
+
+    //信号处理函数里只能用异步信号安全的函数，这里手写整数格式化
+    static void WriteStr(const char *str)
+    {
+        ssize_t rt = write(STDERR_FILENO, str, strlen(str));
+        (void)rt;
+    }
+
+    static void WriteNum(uint64_t value, int base)
+    {
+        char buf[32];
+        char *p = buf + sizeof(buf);
+        *--p = '\0';
+        do
+        {
+            *--p = "0123456789abcdef"[value % base];
+            value /= base;
+        } while(value);
+        if(base == 16)
+        {
+            *--p = 'x';
+            *--p = '0';
+        }
+        WriteStr(p);
+    }
+
+    //每个运行协程的线程都需要自己的信号栈：栈溢出时当前栈已经不能用了，信号处理函数只能在备用栈上执行
+    struct AltStack
+    {
+        AltStack()
+        {
+            stack_t ss;
+            ss.ss_size = 64 * 1024;
+            ss.ss_sp = mmap(nullptr, ss.ss_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            ss.ss_flags = 0;
+            if(ss.ss_sp != MAP_FAILED && sigaltstack(&ss, nullptr) == 0)
+            {
+                mem = ss.ss_sp;
+                size = ss.ss_size;
+            }
+        }
+        ~AltStack()
+        {
+            if(mem)
+            {
+                stack_t ss;
+                ss.ss_sp = nullptr;
+                ss.ss_size = 0;
+                ss.ss_flags = SS_DISABLE;
+                sigaltstack(&ss, nullptr);
+                munmap(mem, size);
+            }
+        }
+        void *mem = nullptr;
+        size_t size = 0;
+    };
+
+    //安装SIGSEGV处理函数（进程内一次）和当前线程的信号栈（每个线程一次）
+    static void InstallStackGuard(void (*handler)(int, siginfo_t *, void *))
+    {
+        static std::once_flag s_once;
+        std::call_once(s_once, [handler]()
+        {
+            //backtrace第一次调用时会加载libgcc，提前调用一次，信号处理函数里就不会再分配内存
+            void *frames[1];
+            backtrace(frames, 1);
+            struct sigaction sa;
+            memset(&sa, 0, sizeof(sa));
+            sa.sa_sigaction = handler;
+            sa.sa_flags = SA_SIGINFO | SA_ONSTACK;
+            sigemptyset(&sa.sa_mask);
+            sigaction(SIGSEGV, &sa, &s_old_segv);
+        });
+        static thread_local AltStack t_alt_stack;
+        (void)t_alt_stack;
+    }
+
+    //记录一个协程的栈用量
+    static void RecordStackUsage(size_t bytes)
+    {
+        s_stack_fibers++;
+        s_stack_total += bytes;
+        uint64_t max = s_stack_max.load(std::memory_order_relaxed);
+        while(bytes > max && !s_stack_max.compare_exchange_weak(max, bytes, std::memory_order_relaxed))
+        {
+        }
+        //第i个桶统计用量不超过4KB<<i的协程，最后一个桶兜底
+        size_t bucket = 0;
+        while(bucket + 1 < Fiber::STACK_HISTOGRAM_BUCKETS && bytes > ((size_t)4096 << bucket))
+        {
+            ++bucket;
+        }
+        s_stack_histogram[bucket]++;
+    }
+    //共享栈的大小和数量：块数多于工作线程数时，新协程总能找到空闲的栈
+    const size_t SHARED_STACK_SIZE = 256 * 1024;
+    const size_t SHARED_STACK_COUNT = 64;
+
+    //共享栈
+    struct SharedStack
+    {
+        std::mutex runMutex;      //持有期间有协程正在这块栈上运行
+        std::mutex occupantMutex; //保护occupant，协程析构时也要访问
+        Fiber *occupant = nullptr; //栈上的内容属于哪个协程
+        char *mem = nullptr;       //第一次使用时分配
+        size_t guard = 0;          //mem下方保护页的大小，分配保护页失败时为0
+    };
+
+    static SharedStack *GetSharedStacks()
+    {
+        static SharedStack *s_stacks = new SharedStack[SHARED_STACK_COUNT]; //进程内共用，不释放
+        return s_stacks;
+    }
+
+    //从上下文里取出挂起时的栈顶，之后恢复时用到的栈就是[sp, 栈底)
+    static char *ContextSp(const ucontext_t &ctx)
+    {
+#if defined(__x86_64__)
+        return (char *)ctx.uc_mcontext.gregs[REG_RSP];
+#elif defined(__aarch64__)
+        return (char *)ctx.uc_mcontext.sp;
+#else
+#error "shared stack: unsupported architecture"
+#endif
+    }
 
     //设置当前运行的协程
     void Fiber::SetThis(Fiber* f) 
@@ -42,7 +272,19 @@ namespace nsCoroutine
         //判断t_fiber是否等于main_fiber，是就继续执行，否则程序终止
         assert(t_fiber == main_fiber.get());
 
-        return t_fiber->shared_from_this();
+        return main_fiber;
+    }
+
+    //返回裸指针，不经过shared_from_this()，避免引用计数的原子加减
+    Fiber* Fiber::GetThisRaw()
+    {
+        if(t_fiber)
+        {
+            return t_fiber;
+        }
+        //首次调用，创建主协程
+        GetThis();
+        return t_fiber;
     }
 
     //设置当前的调度协程
@@ -74,65 +316,84 @@ namespace nsCoroutine
             std::cerr << "Fiber() failed\n";
             pthread_exit(nullptr);
         }
+        //每个线程创建主协程时安装栈溢出检测
+        InstallStackGuard(&Fiber::OnSegv);
         _m_id = s_fiber_id++;
         s_fiber_count++;
-        if(debug)
-        {
-            std::cout << "Fiber(): main id = " << _m_id << std::endl;
-        }
+        LOG_DEBUG("Fiber(): main id = {}", _m_id);
     }
 
     //作用：创建子协程，初始化回调函数，栈的大小和状态。分配栈空间，并通过make修改上下文。
     //当set或者swap激活ucontext_t _m_ctx上下文时候会执行make第二个参数的函数
-    Fiber::Fiber(std::function<void()> cb, size_t stacksize, bool run_in_scheduler)
-        :_m_cb(cb), _m_runInScheduler(run_in_scheduler)
+    Fiber::Fiber(std::function<void()> cb, size_t stacksize, bool run_in_scheduler, bool shared_stack)
+        :_m_cb(std::move(cb)), _m_runInScheduler(run_in_scheduler), _m_useSharedStack(shared_stack)
     {
         _m_state = READY;
 
-        //分配协程栈空间
-        _m_stacksize = stacksize ? stacksize : DEFAULT_STACK_SIZE;
-        _m_stack= malloc(_m_stacksize);
-
         if(getcontext(&_m_ctx))
         {
             std::cerr << "Fiber(std::function<void()> cb, size_t stacksize, bool run_in_scheduler) failed\n";
             pthread_exit(nullptr);
         }
 
-        //这里没有设置后继，是因为在运行完mainfunc后协程退出，会调用一次yield返回主协程
-        _m_ctx.uc_link = nullptr;
-        _m_ctx.uc_stack.ss_sp = _m_stack;
-        _m_ctx.uc_stack.ss_size = _m_stacksize;
-        makecontext(&_m_ctx, &Fiber::MainFunc, 0);
+        //分配协程栈空间，共享栈协程在第一次运行绑定栈时再设置上下文
+        if(!_m_useSharedStack)
+        {
+            _m_stacksize = StackRoundUp(stacksize ? stacksize : s_default_stack_size.load(std::memory_order_relaxed));
+            size_t size = _m_stacksize;
+            size_t guard = s_stack_guard.load(std::memory_order_relaxed) ? PageSize() : 0;
+            _m_stack = StackAlloc(size, guard);
+            _m_stacksize = size;
+            _m_guardSize = guard;
+            makeContext();
+        }
+        else
+        {
+            _m_needContext = true;
+        }
 
         _m_id = s_fiber_id++;
         s_fiber_count++;
-        if(debug)
-        {
-            std::cout << "Fiber(): child id = " << _m_id << std::endl;
-        }
+        LOG_DEBUG("Fiber(): child id = {}", _m_id);
     }
 
     Fiber::~Fiber()
     {
+        clearLocals();
         s_fiber_count--;
         if(_m_stack)
         {
-            free(_m_stack);
+            StackFree(_m_stack, _m_stacksize, _m_guardSize);
         }
-        if(debug)
+        //栈上还留着自己的内容，解除占用，别的协程不必再拷贝
+        if(_m_sharedStack)
         {
-            std::cout << "~Fiber(): id = " << _m_id << std::endl;
+            std::lock_guard<std::mutex> lock(_m_sharedStack->occupantMutex);
+            if(_m_sharedStack->occupant == this)
+            {
+                _m_sharedStack->occupant = nullptr;
+            }
         }
+        free(_m_saveBuf);
+        LOG_DEBUG("~Fiber(): id = {}", _m_id);
+    }
+
+    void Fiber::makeContext()
+    {
+        //这里没有设置后继，是因为在运行完mainfunc后协程退出，会调用一次yield返回主协程
+        _m_ctx.uc_link = nullptr;
+        _m_ctx.uc_stack.ss_sp = _m_stack ? _m_stack : _m_sharedStack->mem;
+        _m_ctx.uc_stack.ss_size = _m_stack ? _m_stacksize : SHARED_STACK_SIZE;
+        makecontext(&_m_ctx, &Fiber::MainFunc, 0);
     }
 
     //作用：重置协程的回调函数，并重新设置上下文，使用与将协程从TERM状态重置READY
     void Fiber::reset(std::function<void()> cb)
     {
-        assert(_m_stack != nullptr && _m_state == TERM);
+        assert((_m_stack != nullptr || _m_useSharedStack) && _m_state == TERM);
 
         _m_state = READY;
-        _m_cb = cb;
+        _m_cb = std::move(cb);
 
         if(getcontext(&_m_ctx))
         {
@@ -140,15 +401,141 @@ namespace nsCoroutine
             pthread_exit(nullptr);
         }
 
-        _m_ctx.uc_link = nullptr;
-        _m_ctx.uc_stack.ss_sp = _m_stack;
-        _m_ctx.uc_stack.ss_size = _m_stacksize;
-        makecontext(&_m_ctx, &Fiber::MainFunc, 0);
+        //共享栈协程等下次运行拿到栈之后再设置
+        if(_m_stack)
+        {
+            makeContext();
+        }
+        else
+        {
+            _m_needContext = true;
+        }
+    }
+
+    bool Fiber::tryLockStack()
+    {
+        return lockStack(false);
+    }
+
+    void Fiber::unlockStack()
+    {
+        if(_m_stackLocked.load(std::memory_order_acquire))
+        {
+            _m_stackLocked.store(false, std::memory_order_release);
+            _m_sharedStack->runMutex.unlock();
+        }
+    }
+
+    bool Fiber::lockStack(bool block)
+    {
+        if(!_m_useSharedStack || _m_stackLocked.load(std::memory_order_acquire))
+        {
+            return true;
+        }
+        //这里只拿锁和绑定栈，调度器持有任务队列锁时调用；分配栈、拷贝栈内容都放到loadStack()
+        if(!_m_sharedStack)
+        {
+            //第一次运行：从轮转位置开始找一块空闲的栈，都被占用时才等待
+            static std::atomic<size_t> s_next{0};
+            SharedStack *stacks = GetSharedStacks();
+            size_t start = s_next.fetch_add(1, std::memory_order_relaxed);
+            SharedStack *chosen = nullptr;
+            for(size_t i = 0; i < SHARED_STACK_COUNT; ++i)
+            {
+                SharedStack *stack = &stacks[(start + i) % SHARED_STACK_COUNT];
+                if(stack->runMutex.try_lock())
+                {
+                    chosen = stack;
+                    break;
+                }
+            }
+            if(!chosen)
+            {
+                if(!block)
+                {
+                    return false;
+                }
+                chosen = &stacks[start % SHARED_STACK_COUNT];
+                chosen->runMutex.lock();
+            }
+            _m_sharedStack = chosen;
+        }
+        else if(block)
+        {
+            _m_sharedStack->runMutex.lock();
+        }
+        else if(!_m_sharedStack->runMutex.try_lock())
+        {
+            return false;
+        }
+        _m_stackLocked.store(true, std::memory_order_release);
+        return true;
+    }
+
+    void Fiber::loadStack()
+    {
+        if(!_m_sharedStack->mem)
+        {
+            //共享栈只用前SHARED_STACK_SIZE字节，没有保护页时多出来的一页不用
+            size_t size = SHARED_STACK_SIZE;
+            _m_sharedStack->guard = PageSize();
+            _m_sharedStack->mem = (char *)StackAlloc(size, _m_sharedStack->guard);
+        }
+        {
+            std::lock_guard<std::mutex> lock(_m_sharedStack->occupantMutex);
+            Fiber *occupant = _m_sharedStack->occupant;
+            if(occupant != this)
+            {
+                //上一个使用者挂起时把内容留在了栈上，先替它拷走
+                if(occupant)
+                {
+                    occupant->saveStack();
+                }
+                _m_sharedStack->occupant = this;
+                if(_m_saveSize)
+                {
+                    memcpy(_m_sharedStack->mem + SHARED_STACK_SIZE - _m_saveSize, _m_saveBuf, _m_saveSize);
+                }
+            }
+        }
+        //makecontext会往栈顶写入口帧，必须在上一个使用者的内容拷走之后
+        if(_m_needContext)
+        {
+            makeContext();
+            _m_needContext = false;
+        }
+    }
+
+    void Fiber::saveStack()
+    {
+        char *top = _m_sharedStack->mem + SHARED_STACK_SIZE;
+        char *sp = ContextSp(_m_ctx);
+        assert(sp >= _m_sharedStack->mem && sp <= top);
+        size_t size = top - sp;
+        //按实际大小分配，用量明显变小时缩小，空闲协程只占它真正用到的那部分栈
+        if(size > _m_saveCap || size < _m_saveCap / 4)
+        {
+            free(_m_saveBuf);
+            _m_saveBuf = (char *)malloc(size);
+            _m_saveCap = size;
+        }
+        memcpy(_m_saveBuf, sp, size);
+        _m_saveSize = size;
+        if(size > _m_stackHighWater)
+        {
+            _m_stackHighWater = size;
+        }
     }
 
     void Fiber::resume()
     {
         assert(_m_state == READY);
+        //调度器取任务时可能已经占用了栈（tryLockStack），这里已经释放了任务队列的锁
+        if(_m_useSharedStack)
+        {
+            lockStack(true);
+            loadStack();
+        }
         _m_state = RUNNING;
         //这里的切换就相当于非对称协程函数那个当a执行完后会将执行权交给b
         if(_m_runInScheduler)
@@ -170,6 +557,25 @@ namespace nsCoroutine
                 pthread_exit(nullptr);
             }   
         }
+
+        if(_m_state == TERM && s_stack_profiling.load(std::memory_order_relaxed))
+        {
+            RecordStackUsage(stackHighWater());
+        }
+
+        if(_m_useSharedStack)
+        {
+            //执行完的协程不再需要栈上的内容
+            if(_m_state == TERM)
+            {
+                std::lock_guard<std::mutex> lock(_m_sharedStack->occupantMutex);
+                _m_sharedStack->occupant = nullptr;
+                free(_m_saveBuf);
+                _m_saveBuf = nullptr;
+                _m_saveSize = _m_saveCap = 0;
+            }
+            unlockStack();
+        }
     }
 
     void Fiber::yield()
@@ -203,18 +609,156 @@ namespace nsCoroutine
 
     void Fiber::MainFunc()
     {
-        //GetThis()的shared_from_this()方法让引用计数加1
-        std::shared_ptr<Fiber> curr = GetThis();
+        //协程运行期间由resume()的调用方（调度器的任务或用户）持有shared_ptr，这里直接使用裸指针，
+        //不再通过shared_from_this()加1再减1
+        Fiber* curr = t_fiber;
         assert(curr != nullptr);
 
         curr->_m_cb();
         //这里的一个细节就是，重置的cb回调函数就希望它指向nullptr，因为方便其他线程再次调用这个协程对象。
         curr->_m_cb = nullptr;
+        //协程局部变量属于这次执行，在协程里销毁，reset()复用协程时不会带到下一个任务
+        curr->clearLocals();
         curr->_m_state = TERM;
 
         //运行完毕 -> 让出执行权
-        auto raw_ptr = curr.get();
-        curr.reset(); //计数-1
-        raw_ptr->yield();
+        curr->yield();
+    }
+
+    size_t Fiber::AllocLocalIndex()
+    {
+        static std::atomic<size_t> s_next{0};
+        return s_next.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void Fiber::setLocal(size_t index, void *value, void (*destroy)(void *))
+    {
+        if(!_m_locals)
+        {
+            _m_locals.reset(new std::vector<LocalSlot>());
+        }
+        if(index >= _m_locals->size())
+        {
+            _m_locals->resize(index + 1);
+        }
+        LocalSlot &slot = (*_m_locals)[index];
+        //先换上新值再销毁旧值，旧值的析构函数里再访问这个槽时看到的是新值
+        LocalSlot old = slot;
+        slot.value = value;
+        slot.destroy = destroy;
+        if(old.value)
+        {
+            old.destroy(old.value);
+        }
+    }
+
+    void Fiber::clearLocals()
+    {
+        if(!_m_locals)
+        {
+            return;
+        }
+        //析构函数可能再访问别的FiberLocal，先把槽数组摘下来
+        std::unique_ptr<std::vector<LocalSlot>> locals = std::move(_m_locals);
+        for(LocalSlot &slot : *locals)
+        {
+            if(slot.value)
+            {
+                slot.destroy(slot.value);
+            }
+        }
+    }
+
+    size_t Fiber::stackHighWater()
+    {
+        if(!_m_stack)
+        {
+            return _m_stackHighWater;
+        }
+        //栈从高地址向低地址增长，最低的一个已驻留页就是用到过的最深处
+        size_t page = PageSize();
+        size_t pages = _m_stacksize / page;
+        std::vector<unsigned char> resident(pages);
+        if(mincore(_m_stack, _m_stacksize, resident.data()) != 0)
+        {
+            return 0;
+        }
+        for(size_t i = 0; i < pages; ++i)
+        {
+            if(resident[i] & 1)
+            {
+                return _m_stacksize - i * page;
+            }
+        }
+        return 0;
+    }
+
+    void Fiber::SetDefaultStackSize(size_t size)
+    {
+        s_default_stack_size = size;
+    }
+
+    void Fiber::SetStackGuard(bool on)
+    {
+        s_stack_guard = on;
+    }
+
+    void Fiber::OnSegv(int, siginfo_t *info, void *)
+    {
+        //判断出错地址是否落在当前协程栈底的保护页里
+        Fiber *fiber = t_fiber;
+        char *addr = (char *)info->si_addr;
+        char *base = nullptr;
+        size_t guard = 0;
+        size_t size = 0;
+        if(fiber && fiber->_m_useSharedStack && fiber->_m_sharedStack)
+        {
+            base = fiber->_m_sharedStack->mem;
+            guard = fiber->_m_sharedStack->guard;
+            size = SHARED_STACK_SIZE;
+        }
+        else if(fiber && fiber->_m_stack)
+        {
+            base = (char *)fiber->_m_stack;
+            guard = fiber->_m_guardSize;
+            size = fiber->_m_stacksize;
+        }
+        if(guard == 0 || addr < base - guard || addr >= base)
+        {
+            //不是协程栈溢出：恢复原来的处理方式后返回，出错的指令重新执行时由它处理（默认是产生core）
+            sigaction(SIGSEGV, &s_old_segv, nullptr);
+            return;
+        }
+
+        WriteStr("Fiber stack overflow: fiber id = ");
+        WriteNum(fiber->_m_id, 10);
+        WriteStr(", stack size = ");
+        WriteNum(size, 10);
+        WriteStr(fiber->_m_useSharedStack ? " (shared)" : "");
+        WriteStr(", fault address = ");
+        WriteNum((uintptr_t)addr, 16);
+        WriteStr("\nbacktrace:\n");
+        void *frames[64];
+        int n = backtrace(frames, 64);
+        backtrace_symbols_fd(frames, n, STDERR_FILENO);
+        abort();
+    }
+
+    void Fiber::SetStackProfiling(bool on)
+    {
+        s_stack_profiling = on;
+    }
+
+    Fiber::StackStats Fiber::GetStackStats()
+    {
+        StackStats stats;
+        stats.fibers = s_stack_fibers.load();
+        stats.totalBytes = s_stack_total.load();
+        stats.maxBytes = s_stack_max.load();
+        for(size_t i = 0; i < STACK_HISTOGRAM_BUCKETS; ++i)
+        {
+            stats.histogram[i] = s_stack_histogram[i].load();
+        }
+        return stats;
     }
-}
\ No newline at end of file
+}
@@ -5,14 +5,19 @@
 #include <functional>
 #include <cassert>
 #include <ucontext.h>
+#include <signal.h>
 #include <unistd.h>
 #include <mutex>
+#include <vector>
 
 //Fiber类提供协程的基本功能，包括创建、管理、切换、销毁协程\
 它使用ucontext结果（主要是使用非对称协程）保存和恢复协程的上下文，并通过std::function来存储协程的执行逻辑
 
 namespace nsCoroutine
 {
+    class CancelState;
+    struct SharedStack;
+
     // 非对称有独立栈协程
     // 这里的继承使用enable_shared_from_this，是为了在Fiber内部可以通过shared_from-this() 获取到自身的shared_ptr实例，
     // 从而在需要时可以将自身的shared_ptr实例传递给其他地方，而不是裸指针（一个shared_ptr控制块管理，如果直接使用裸指针创建shared_ptr实例会导致多个控制块管理，导致计数混乱，多次释放资源的问题）。
@@ -28,6 +33,15 @@ namespace nsCoroutine
             TERM     // 协程处于结束状态
         };
 
+        // 调度优先级，数值越小越优先，调度器每级一个任务队列（见Scheduler::run）
+        enum Priority
+        {
+            PRIORITY_HIGH,   // 健康检查、控制面等对延迟敏感的任务
+            PRIORITY_NORMAL, // 默认
+            PRIORITY_LOW,    // 批量传输等后台任务
+            PRIORITY_LEVELS
+        };
+
     private:
         // 私有Riber()，只能被GetThis调用，用于创建主协程
         //当第一次调用GetThis时，会创建主协程
@@ -36,7 +50,8 @@ namespace nsCoroutine
     public:
         //用于创建子协程
         // 用于创建指定回调函数、栈大小和run_in_scheduler本协程是否参与调度器调度，默认为true
-        Fiber(std::function<void()> cb, size_t stacksize = 0, bool run_in_scheduler = true);
+        // shared_stack为true时不分配独立栈（忽略stacksize），运行在进程共用的几块共享栈上，见resume()
+        Fiber(std::function<void()> cb, size_t stacksize = 0, bool run_in_scheduler = true, bool shared_stack = false);
         ~Fiber();
 
     public:
@@ -44,6 +59,10 @@ namespace nsCoroutine
         // 减少反复申请空间的开销
         void reset(std::function<void()> cb);
         // 恢复协程执行
+        // 共享栈协程：第一次运行时绑定一块空闲的共享栈（栈上保存的是绝对地址，之后只能在这块栈上运行），
+        // 栈上的内容属于另一个协程时，先把它用到的部分拷贝到它自己的保存区，再把本协程保存的内容拷回来；
+        // 挂起时内容留在栈上，下一个要用这块栈的协程才负责拷走，同一个协程连续运行时没有拷贝
+        // 注意：共享栈协程挂起期间，它栈上变量的地址不能被其他协程访问（内容可能已经被拷走、栈已经被别人占用）
         void resume();
         // 将执行权还给调度协程
         void yield();
@@ -57,12 +76,99 @@ namespace nsCoroutine
         {
             return _m_state;
         }
+        // 是否把执行权交还给调度协程（false表示交还给线程主协程）
+        bool isRunInScheduler() const
+        {
+            return _m_runInScheduler;
+        }
+        // 是否是共享栈协程
+        bool isSharedStack() const
+        {
+            return _m_useSharedStack;
+        }
+        // 占用共享栈（独立栈协程总是返回true）：栈正被别的线程上的协程使用时返回false
+        // 调度器取任务时调用，拿不到就先执行别的任务，不阻塞工作线程；成功后必须resume()或unlockStack()
+        // 只拿锁不拷贝栈内容，保存上一个使用者、恢复自己的栈都在resume()里做
+        bool tryLockStack();
+        void unlockStack();
+        // 栈的高水位（字节）：独立栈用mincore扫描已驻留的页，精确到页，reset()复用的栈会累计之前的用量；
+        // 共享栈协程没有独占的栈，返回挂起时保存过的最大栈大小（下限）
+        size_t stackHighWater();
+        // 挂起时保存下来的栈内容大小（共享栈协程的实际内存开销）
+        size_t savedStackSize() const
+        {
+            return _m_saveSize;
+        }
+        // 调度优先级，协程每次被放回任务队列时都按它排队
+        int getPriority() const
+        {
+            return _m_priority;
+        }
+        void setPriority(int priority)
+        {
+            assert(priority >= PRIORITY_HIGH && priority < PRIORITY_LEVELS);
+            _m_priority = priority;
+        }
+        // 取消状态，只有TaskGroup的子任务才有，其余协程为nullptr
+        CancelState *cancelState() const
+        {
+            return _m_cancel.get();
+        }
+        void setCancelState(std::shared_ptr<CancelState> state)
+        {
+            _m_cancel = std::move(state);
+        }
+
+        // 截止时间（单调时钟ms，0表示没有），由DeadlineScope设置，hook的阻塞调用据此限制等待时间
+        uint64_t getDeadline() const
+        {
+            return _m_deadline;
+        }
+        void setDeadline(uint64_t deadline)
+        {
+            _m_deadline = deadline;
+        }
+        // 协程局部存储（FiberLocal<T>使用），index是FiberLocal分配的全局槽号
+        // 槽数组在协程第一次写入时才分配，从不使用的协程只多一个空指针
+        void *getLocal(size_t index) const
+        {
+            return _m_locals && index < _m_locals->size() ? (*_m_locals)[index].value : nullptr;
+        }
+        // 设置槽的值，destroy用来销毁值；原来有值的话先销毁
+        void setLocal(size_t index, void *value, void (*destroy)(void *));
+        // 分配一个协程局部存储的槽号，所有类型的FiberLocal共用一个编号空间
+        static size_t AllocLocalIndex();
+
+        // 栈用量的汇总统计
+        static const size_t STACK_HISTOGRAM_BUCKETS = 8;
+        struct StackStats
+        {
+            uint64_t fibers = 0;     // 统计过的协程数
+            uint64_t totalBytes = 0; // 高水位之和，除以fibers得到平均值
+            uint64_t maxBytes = 0;   // 最大的高水位
+            uint64_t histogram[STACK_HISTOGRAM_BUCKETS] = {}; // 第i个桶：高水位不超过4KB<<i（最后一个桶包括更大的）
+        };
+
+    public:
+        // 设置之后创建的协程的默认栈大小
+        static void SetDefaultStackSize(size_t size);
+        // 是否在之后创建的独立栈下方放一页不可访问的保护页（默认开启，共享栈总是有保护页）
+        // 栈溢出时触发SIGSEGV，信号处理函数在线程的备用信号栈上运行，打印协程id、栈大小和调用栈后abort()
+        // 每个保护页会把一段映射拆成两个VMA：带保护页的栈最多vm.max_map_count/4个，超出的栈不带保护页并打印一次警告，
+        // 协程很多又需要保护时调大该参数
+        static void SetStackGuard(bool on);
+        // 开启后每个协程执行结束时把它的栈高水位计入统计（一次mincore系统调用），默认关闭
+        static void SetStackProfiling(bool on);
+        static StackStats GetStackStats();
 
     public:
         // 设置当前运行的协程
         static void SetThis(Fiber *f);
         // 获取当前运行的协程的shared_ptr实例，兼具第一次调用时创建主协程的功能
         static std::shared_ptr<Fiber> GetThis();
+        // 获取当前运行的协程的裸指针，供库内部热路径使用（yield等），不会产生引用计数的原子操作
+        // 只有需要延长协程生命周期（放入定时器、事件上下文、任务队列）时才使用GetThis()
+        static Fiber* GetThisRaw();
         // 设置调度协程，默认是主协程，即主协程也可以是调度协程
         static void SetSchedulerFiber(Fiber *f);
         // 获取当前运行的协程的ID
@@ -76,8 +182,10 @@ namespace nsCoroutine
     private:
         // 协程唯一标识符 -- 使用自己的定义的全局ID生成器
         uint64_t _m_id = 0;
-        // 栈大小--主协程不需要
+        // 栈大小--主协程不需要，按页取整
         uint32_t _m_stacksize = 0;
+        // 栈下方保护页的大小，0表示没有
+        uint32_t _m_guardSize = 0;
         // 协程状态--初始化为READY
         State _m_state = READY;
         // 协程上下文
@@ -87,6 +195,48 @@ namespace nsCoroutine
         // 协程的回调函数--主协程不需要
         std::function<void()> _m_cb;
         // 标志是否将执行器交给调度协程--主协程不需要
-        bool _m_runInScheduler;
+        bool _m_runInScheduler = false;
+        // 调度优先级
+        int _m_priority = PRIORITY_NORMAL;
+        // 取消状态，按需设置
+        std::shared_ptr<CancelState> _m_cancel;
+        // 截止时间
+        uint64_t _m_deadline = 0;
+        // 共享栈模式
+        bool _m_useSharedStack = false;
+        // 绑定的共享栈，第一次运行时分配
+        SharedStack *_m_sharedStack = nullptr;
+        // 是否已经占用了共享栈：唤醒方在别的线程上把协程放回任务队列时，
+        // 那个线程的调度器可能在协程还没让出完的时候就通过tryLockStack()读它
+        std::atomic<bool> _m_stackLocked{false};
+        // 入口上下文还没设置：共享栈协程创建或reset()之后，下次拿到栈时设置
+        bool _m_needContext = false;
+        // 栈内容的保存区，大小按实际用到的栈分配
+        char *_m_saveBuf = nullptr;
+        size_t _m_saveSize = 0;
+        size_t _m_saveCap = 0;
+        // 共享栈协程挂起时保存过的最大栈大小
+        size_t _m_stackHighWater = 0;
+        // 协程局部存储的槽
+        struct LocalSlot
+        {
+            void *value = nullptr;
+            void (*destroy)(void *) = nullptr;
+        };
+        // 协程局部存储，按需分配；协程结束时销毁
+        std::unique_ptr<std::vector<LocalSlot>> _m_locals;
+
+        // 销毁所有协程局部变量
+        void clearLocals();
+        // 占用共享栈，block为false时拿不到返回false
+        bool lockStack(bool block);
+        // 占用共享栈之后、切换之前调用：第一次使用时分配栈，保存上一个使用者的栈内容，恢复自己的
+        void loadStack();
+        // 把挂起的协程用到的栈拷贝到保存区，调用方持有共享栈
+        void saveStack();
+        // 初始化入口上下文
+        void makeContext();
+        // SIGSEGV处理函数，识别当前协程的栈溢出
+        static void OnSegv(int sig, siginfo_t *info, void *ucontext);
     };
 }
\ No newline at end of file
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <utility>
+#include "fiber.h"
+
+// 协程局部存储
+// thread_local的值属于线程：协程yield后可能在另一个工作线程上恢复，读到的是别人的值；同一线程上的协程之间也会互相串改
+// FiberLocal<T>的值保存在当前协程里，随协程迁移，协程结束时销毁。不在任务协程里时（主线程）使用线程主协程的存储，
+// 效果等同于thread_local
+//
+//  static FiberLocal<std::string> t_traceId;
+//  *t_traceId = "abc";        // 第一次访问时默认构造
+//  if (t_traceId.get()) ...   // 不构造，没有值返回nullptr
+
+namespace nsCoroutine
+{
+    template <typename T>
+    class FiberLocal
+    {
+    public:
+        // 每个FiberLocal对象占用一个全局槽号，槽号不回收
+        FiberLocal() : _m_index(Fiber::AllocLocalIndex()) {}
+        FiberLocal(const FiberLocal &) = delete;
+        FiberLocal &operator=(const FiberLocal &) = delete;
+
+        // 当前协程的值，没有设置过返回nullptr
+        T *get() const
+        {
+            return static_cast<T *>(Fiber::GetThisRaw()->getLocal(_m_index));
+        }
+
+        // 设置当前协程的值
+        template <typename... Args>
+        T &emplace(Args &&...args)
+        {
+            T *value = new T(std::forward<Args>(args)...);
+            Fiber::GetThisRaw()->setLocal(_m_index, value, &Destroy);
+            return *value;
+        }
+
+        // 销毁当前协程的值
+        void reset()
+        {
+            Fiber::GetThisRaw()->setLocal(_m_index, nullptr, nullptr);
+        }
+
+        // 当前协程的值，没有的话默认构造一个
+        T &operator*() const
+        {
+            T *value = get();
+            return value ? *value : const_cast<FiberLocal *>(this)->emplace();
+        }
+        T *operator->() const { return &**this; }
+
+    private:
+        static void Destroy(void *value) { delete static_cast<T *>(value); }
+
+    private:
+        const size_t _m_index;
+    };
+}
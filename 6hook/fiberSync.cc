@@ -0,0 +1,617 @@
+#include "fiberSync.h"
+#include "ioManager.h"
+#include "taskGroup.h"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+namespace nsCoroutine
+{
+    FiberWaiter::FiberWaiter(bool timed, bool cancelable) : _m_cancelable(cancelable)
+    {
+        if (Scheduler::InTaskFiber() && (!timed || IOManager::GetThis() != nullptr))
+        {
+            //只有这里会增加一次引用计数：协程挂起期间，等待队列是它唯一的持有者
+            _m_fiber = Fiber::GetThis();
+            _m_scheduler = Scheduler::GetThis();
+        }
+        else
+        {
+            _m_sem.reset(new Semaphore());
+        }
+    }
+
+    // 挂起前向所在任务组登记取消回调；已经被取消并且抢到了唤醒权时不需要挂起，返回false
+    // 抢不到说明唤醒方已经claim并且会resume，照常挂起把这次resume消化掉
+    static bool ArmCancel(FiberWaiter *waiter, bool cancelable, CancelState *&state)
+    {
+        state = cancelable ? Fiber::GetThisRaw()->cancelState() : nullptr;
+        if (state == nullptr)
+        {
+            return true;
+        }
+        std::shared_ptr<FiberWaiter> self = waiter->shared_from_this();
+        if (state->arm([self]()
+                       { self->wake(FiberWaiter::CANCELED); }))
+        {
+            return true;
+        }
+        state = nullptr;
+        return !waiter->claim(FiberWaiter::CANCELED);
+    }
+
+    int FiberWaiter::wait()
+    {
+        if (_m_sem)
+        {
+            _m_sem->wait();
+            return result();
+        }
+        CancelState *cancel;
+        if (!ArmCancel(this, _m_cancelable, cancel))
+        {
+            return CANCELED;
+        }
+        // 唤醒方可能在yield之前就已经把协程放进了任务队列，
+        // 这是安全的：Scheduler::run在resume前要拿到协程的_m_mutex，会一直等到这里yield返回调度协程
+        _m_scheduler->addParkedFiber(1);
+        Fiber::GetThisRaw()->yield();
+        if (cancel)
+        {
+            cancel->disarm();
+        }
+        return result();
+    }
+
+    bool FiberWaiter::waitFor(uint64_t ms)
+    {
+        if (_m_sem)
+        {
+            // 超时后如果claim失败，说明唤醒方已经抢到了唤醒权，按被唤醒处理（信号量属于这个等待者，不必再消费）
+            if (!_m_sem->waitFor(ms) && claim(TIMEOUT))
+            {
+                return false;
+            }
+            return true;
+        }
+        CancelState *cancel;
+        if (!ArmCancel(this, _m_cancelable, cancel))
+        {
+            return false;
+        }
+        // 定时器持有等待者的shared_ptr，超时回调在IOManager的线程上执行
+        std::shared_ptr<FiberWaiter> self = shared_from_this();
+        std::shared_ptr<Timer> timer = IOManager::GetThis()->addTimer(ms, [self]()
+                                                                      { self->wake(TIMEOUT); });
+        _m_scheduler->addParkedFiber(1);
+        Fiber::GetThisRaw()->yield();
+        if (cancel)
+        {
+            cancel->disarm();
+        }
+        if (result() == TIMEOUT)
+        {
+            return false;
+        }
+        // 被唤醒或取消，取消定时器，释放它持有的引用
+        timer->cancel();
+        return result() != CANCELED;
+    }
+
+    void FiberWaiter::resume()
+    {
+        if (_m_sem)
+        {
+            _m_sem->signal();
+            return;
+        }
+        // 先放回任务队列再减计数，调度器不会在两者之间误判为可以停止
+        Scheduler *scheduler = _m_scheduler;
+        scheduler->scheduleLock(std::move(_m_fiber));
+        scheduler->addParkedFiber(-1);
+    }
+
+    void FiberWaiter::WakeAll(std::vector<std::shared_ptr<FiberWaiter>> &waiters, int result)
+    {
+        Scheduler *scheduler = nullptr;
+        std::vector<std::shared_ptr<Fiber>> fibers;
+        fibers.reserve(waiters.size());
+        // 分组时保持原有顺序：通常所有协程来自同一个调度器，遇到不同的调度器就先把已收集的一批提交
+        auto flush = [&]()
+        {
+            if (!fibers.empty())
+            {
+                int n = fibers.size();
+                scheduler->scheduleBatch(fibers);
+                scheduler->addParkedFiber(-n);
+                fibers.clear();
+            }
+        };
+        for (auto &w : waiters)
+        {
+            if (!w->claim(result))
+            {
+                continue;
+            }
+            if (w->_m_sem)
+            {
+                w->_m_sem->signal();
+                continue;
+            }
+            if (w->_m_scheduler != scheduler)
+            {
+                flush();
+                scheduler = w->_m_scheduler;
+            }
+            fibers.push_back(std::move(w->_m_fiber));
+        }
+        flush();
+    }
+
+    static uint64_t NowNs()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    bool FiberMutex::try_lock()
+    {
+        uint32_t expected = 0;
+        return _m_state.compare_exchange_strong(expected, LOCKED, std::memory_order_acquire, std::memory_order_relaxed);
+    }
+
+    bool FiberMutex::spinLock()
+    {
+        for (int i = 0; i < SPIN_COUNT; ++i)
+        {
+            uint32_t s = _m_state.load(std::memory_order_relaxed);
+            // 饥饿模式下锁只能移交，不能抢
+            if (s & STARVING)
+            {
+                return false;
+            }
+            if (!(s & LOCKED) && _m_state.compare_exchange_weak(s, s | LOCKED, std::memory_order_acquire, std::memory_order_relaxed))
+            {
+                return true;
+            }
+            CpuRelax();
+        }
+        return false;
+    }
+
+    void FiberMutex::lock()
+    {
+        // 快路径：无竞争时一次CAS
+        if (try_lock())
+        {
+            return;
+        }
+
+        uint64_t wait_start = 0;
+        while (true)
+        {
+            // 持有者很可能正在别的线程上执行很短的临界区，先自旋一小会儿
+            if (spinLock())
+            {
+                return;
+            }
+
+            std::unique_lock<std::mutex> lock(_m_mutex);
+            // 在队列锁内再检查一次：锁已经空闲就直接拿走，否则标记有等待者（解锁方看到后会来队列里唤醒）
+            uint32_t s = _m_state.load(std::memory_order_relaxed);
+            bool acquired = false;
+            while (true)
+            {
+                if (!(s & (LOCKED | STARVING)))
+                {
+                    if (_m_state.compare_exchange_weak(s, s | LOCKED, std::memory_order_acquire, std::memory_order_relaxed))
+                    {
+                        acquired = true;
+                        break;
+                    }
+                    continue;
+                }
+                if (_m_state.compare_exchange_weak(s, s | WAITERS, std::memory_order_relaxed, std::memory_order_relaxed))
+                {
+                    break;
+                }
+            }
+            if (acquired)
+            {
+                return;
+            }
+
+            // unlock()移交锁时不检查claim结果，等待锁不能被取消打断
+            std::shared_ptr<FiberWaiter> waiter = std::make_shared<FiberWaiter>(false, false);
+            if (wait_start == 0)
+            {
+                wait_start = NowNs();
+                _m_waiters.push_back(waiter);
+            }
+            else
+            {
+                // 被唤醒后又没抢到锁的，排回队首，保持它原来的位置
+                if (NowNs() - wait_start > STARVE_NS)
+                {
+                    _m_state.fetch_or(STARVING, std::memory_order_relaxed);
+                }
+                _m_waiters.push_front(waiter);
+            }
+            lock.unlock();
+
+            waiter->wait();
+            if (waiter->result() == HANDOFF)
+            {
+                // 饥饿模式，锁已经直接移交给当前协程
+                return;
+            }
+        }
+    }
+
+    void FiberMutex::unlock()
+    {
+        // 快路径：没有等待者
+        uint32_t expected = LOCKED;
+        if (_m_state.compare_exchange_strong(expected, 0, std::memory_order_release, std::memory_order_relaxed))
+        {
+            return;
+        }
+
+        std::shared_ptr<FiberWaiter> waiter;
+        int reason;
+        {
+            std::lock_guard<std::mutex> lock(_m_mutex);
+            if (_m_waiters.empty())
+            {
+                _m_state.fetch_and(~(LOCKED | WAITERS | STARVING), std::memory_order_release);
+                return;
+            }
+            waiter = std::move(_m_waiters.front());
+            _m_waiters.pop_front();
+            if (_m_state.load(std::memory_order_relaxed) & STARVING)
+            {
+                // 饥饿模式：保持加锁状态直接移交，队列空了就退出饥饿模式
+                reason = HANDOFF;
+                if (_m_waiters.empty())
+                {
+                    _m_state.fetch_and(~(WAITERS | STARVING), std::memory_order_release);
+                }
+            }
+            else
+            {
+                // 正常模式：释放锁，唤醒队首重新去抢
+                reason = RETRY;
+                _m_state.fetch_and(_m_waiters.empty() ? ~(LOCKED | WAITERS) : ~LOCKED, std::memory_order_release);
+            }
+        }
+        waiter->wake(reason);
+    }
+
+    std::shared_ptr<FiberWaiter> FiberCondVar::enqueue(bool timed)
+    {
+        std::shared_ptr<FiberWaiter> waiter = std::make_shared<FiberWaiter>(timed);
+        std::lock_guard<std::mutex> lock(_m_mutex);
+        _m_waiters.push_back(waiter);
+        return waiter;
+    }
+
+    void FiberCondVar::remove(const std::shared_ptr<FiberWaiter> &waiter)
+    {
+        std::lock_guard<std::mutex> lock(_m_mutex);
+        auto it = std::find(_m_waiters.begin(), _m_waiters.end(), waiter);
+        if (it != _m_waiters.end())
+        {
+            _m_waiters.erase(it);
+        }
+    }
+
+    void FiberCondVar::notify_one()
+    {
+        std::shared_ptr<FiberWaiter> waiter;
+        {
+            std::lock_guard<std::mutex> lock(_m_mutex);
+            // 跳过已经超时、还没来得及把自己移出队列的等待者
+            while (!_m_waiters.empty())
+            {
+                std::shared_ptr<FiberWaiter> w = std::move(_m_waiters.front());
+                _m_waiters.pop_front();
+                if (w->claim())
+                {
+                    waiter = std::move(w);
+                    break;
+                }
+            }
+        }
+        if (waiter)
+        {
+            waiter->resume();
+        }
+    }
+
+    void FiberCondVar::notify_all()
+    {
+        std::vector<std::shared_ptr<FiberWaiter>> waiters;
+        {
+            std::lock_guard<std::mutex> lock(_m_mutex);
+            waiters.assign(std::make_move_iterator(_m_waiters.begin()), std::make_move_iterator(_m_waiters.end()));
+            _m_waiters.clear();
+        }
+        FiberWaiter::WakeAll(waiters);
+    }
+
+    bool FiberSemaphore::wait()
+    {
+        std::shared_ptr<FiberWaiter> waiter;
+        {
+            std::lock_guard<std::mutex> lock(_m_mutex);
+            if (_m_count > 0)
+            {
+                --_m_count;
+                return true;
+            }
+            waiter = std::make_shared<FiberWaiter>();
+            _m_waiters.push_back(waiter);
+        }
+        if (waiter->wait() != FiberWaiter::CANCELED)
+        {
+            return true;
+        }
+        remove(waiter);
+        errno = ECANCELED;
+        return false;
+    }
+
+    bool FiberSemaphore::tryWait()
+    {
+        std::lock_guard<std::mutex> lock(_m_mutex);
+        if (_m_count > 0)
+        {
+            --_m_count;
+            return true;
+        }
+        return false;
+    }
+
+    bool FiberSemaphore::waitFor(uint64_t ms)
+    {
+        std::shared_ptr<FiberWaiter> waiter;
+        {
+            std::lock_guard<std::mutex> lock(_m_mutex);
+            if (_m_count > 0)
+            {
+                --_m_count;
+                return true;
+            }
+            waiter = std::make_shared<FiberWaiter>(true);
+            _m_waiters.push_back(waiter);
+        }
+        if (waiter->waitFor(ms))
+        {
+            return true;
+        }
+        remove(waiter);
+        errno = waiter->result() == FiberWaiter::CANCELED ? ECANCELED : ETIMEDOUT;
+        return false;
+    }
+
+    void FiberSemaphore::remove(const std::shared_ptr<FiberWaiter> &waiter)
+    {
+        // signal()不会把许可交给已超时/被取消的等待者，这里只需要把自己移出队列
+        std::lock_guard<std::mutex> lock(_m_mutex);
+        auto it = std::find(_m_waiters.begin(), _m_waiters.end(), waiter);
+        if (it != _m_waiters.end())
+        {
+            _m_waiters.erase(it);
+        }
+    }
+
+    void FiberSemaphore::signal(size_t n)
+    {
+        std::vector<std::shared_ptr<FiberWaiter>> woken;
+        {
+            std::lock_guard<std::mutex> lock(_m_mutex);
+            while (n > 0 && !_m_waiters.empty())
+            {
+                std::shared_ptr<FiberWaiter> w = std::move(_m_waiters.front());
+                _m_waiters.pop_front();
+                // claim成功才算把许可交了出去，超时的等待者直接丢弃
+                if (w->claim())
+                {
+                    woken.push_back(std::move(w));
+                    --n;
+                }
+            }
+            _m_count += n;
+        }
+        for (auto &w : woken)
+        {
+            w->resume();
+        }
+    }
+
+    void FiberWaitGroup::add(long delta)
+    {
+        long count = _m_count.fetch_add(delta, std::memory_order_acq_rel) + delta;
+        assert(count >= 0);
+        if (count != 0 || delta == 0)
+        {
+            return;
+        }
+        // 等待者在锁内检查计数后才入队，这里在锁内取走的一定是计数归零前入队的全部等待者
+        std::vector<std::shared_ptr<FiberWaiter>> waiters;
+        {
+            std::lock_guard<std::mutex> lock(_m_mutex);
+            waiters.swap(_m_waiters);
+        }
+        FiberWaiter::WakeAll(waiters);
+    }
+
+    bool FiberWaitGroup::wait()
+    {
+        std::shared_ptr<FiberWaiter> waiter;
+        {
+            std::lock_guard<std::mutex> lock(_m_mutex);
+            if (_m_count.load(std::memory_order_acquire) == 0)
+            {
+                return true;
+            }
+            waiter = std::make_shared<FiberWaiter>();
+            _m_waiters.push_back(waiter);
+        }
+        if (waiter->wait() != FiberWaiter::CANCELED)
+        {
+            return true;
+        }
+        std::lock_guard<std::mutex> lock(_m_mutex);
+        auto it = std::find(_m_waiters.begin(), _m_waiters.end(), waiter);
+        if (it != _m_waiters.end())
+        {
+            _m_waiters.erase(it);
+        }
+        errno = ECANCELED;
+        return false;
+    }
+
+    FiberBarrier::FiberBarrier(size_t count) : _m_count(count)
+    {
+        assert(count > 0);
+    }
+
+    bool FiberBarrier::wait()
+    {
+        std::shared_ptr<FiberWaiter> waiter;
+        std::vector<std::shared_ptr<FiberWaiter>> waiters;
+        {
+            std::lock_guard<std::mutex> lock(_m_mutex);
+            if (++_m_arrived < _m_count)
+            {
+                waiter = std::make_shared<FiberWaiter>(false, false);
+                _m_waiters.push_back(waiter);
+            }
+            else
+            {
+                // 最后一个到达：开始新的一轮，本轮的等待者在锁外一次唤醒
+                _m_arrived = 0;
+                waiters.swap(_m_waiters);
+            }
+        }
+        if (waiter)
+        {
+            waiter->wait();
+            return false;
+        }
+        FiberWaiter::WakeAll(waiters);
+        return true;
+    }
+
+    FiberRWMutex::FiberRWMutex()
+    {
+        // 槽按线程分配，工作线程数可能多于核数，至少留MIN_SLOTS个；超出时多个线程共用一个槽，只影响性能不影响正确性
+        _m_slotCount = std::max(MIN_SLOTS, (size_t)std::thread::hardware_concurrency());
+        _m_slots.reset(new Slot[_m_slotCount]);
+    }
+
+    FiberRWMutex::Slot &FiberRWMutex::mySlot()
+    {
+        static std::atomic<size_t> s_nextThread{0};
+        static thread_local size_t t_thread = s_nextThread.fetch_add(1, std::memory_order_relaxed);
+        return _m_slots[t_thread % _m_slotCount];
+    }
+
+    long FiberRWMutex::readerCount()
+    {
+        long sum = 0;
+        for (size_t i = 0; i < _m_slotCount; ++i)
+        {
+            sum += _m_slots[i].readers.load(std::memory_order_seq_cst);
+        }
+        return sum;
+    }
+
+    bool FiberRWMutex::try_lock_shared()
+    {
+        // 和lock()里的"置写者标志、再统计读者"构成Dekker式的同步，seq_cst保证双方至少有一方看到对方
+        Slot &slot = mySlot();
+        slot.readers.fetch_add(1, std::memory_order_seq_cst);
+        if (!_m_writer.load(std::memory_order_seq_cst))
+        {
+            return true;
+        }
+        readerExit(slot);
+        return false;
+    }
+
+    void FiberRWMutex::lock_shared()
+    {
+        while (!try_lock_shared())
+        {
+            std::shared_ptr<FiberWaiter> waiter;
+            {
+                std::lock_guard<std::mutex> lock(_m_mutex);
+                // 写者在锁内清除标志并取走等待队列，检查和入队都在锁内，不会丢失唤醒
+                if (!_m_writer.load(std::memory_order_seq_cst))
+                {
+                    continue;
+                }
+                waiter = std::make_shared<FiberWaiter>(false, false);
+                _m_readerWaiters.push_back(waiter);
+            }
+            waiter->wait();
+        }
+    }
+
+    void FiberRWMutex::unlock_shared()
+    {
+        readerExit(mySlot());
+    }
+
+    void FiberRWMutex::readerExit(Slot &slot)
+    {
+        slot.readers.fetch_sub(1, std::memory_order_seq_cst);
+        if (!_m_writer.load(std::memory_order_seq_cst))
+        {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(_m_mutex);
+        if (_m_writerWaiter && readerCount() == 0)
+        {
+            _m_writerWaiter->wake();
+            _m_writerWaiter.reset();
+        }
+    }
+
+    void FiberRWMutex::lock()
+    {
+        _m_writerLock.lock();
+        _m_writer.store(true, std::memory_order_seq_cst);
+        while (true)
+        {
+            std::shared_ptr<FiberWaiter> waiter;
+            {
+                std::lock_guard<std::mutex> lock(_m_mutex);
+                // 读者退出时在锁内检查计数，这里入队后最后一个读者一定能看到等待者
+                if (readerCount() == 0)
+                {
+                    return;
+                }
+                waiter = std::make_shared<FiberWaiter>(false, false);
+                _m_writerWaiter = waiter;
+            }
+            waiter->wait();
+        }
+    }
+
+    void FiberRWMutex::unlock()
+    {
+        std::vector<std::shared_ptr<FiberWaiter>> waiters;
+        {
+            std::lock_guard<std::mutex> lock(_m_mutex);
+            _m_writer.store(false, std::memory_order_seq_cst);
+            waiters.swap(_m_readerWaiters);
+        }
+        FiberWaiter::WakeAll(waiters);
+        _m_writerLock.unlock();
+    }
+}
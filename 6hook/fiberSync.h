@@ -0,0 +1,330 @@
+#pragma once
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "fiber.h"
+#include "scheduler.h"
+#include "thread.h"
+
+// 协程同步原语：等待方挂起的是协程而不是工作线程，唤醒时通过Scheduler::scheduleLock把协程放回任务队列
+// 不在任务协程里调用时（例如主线程），退化为用Semaphore阻塞当前线程，因此协程和普通线程可以混用同一个原语
+
+namespace nsCoroutine
+{
+    // 自旋等待时降低CPU占用并让出流水线
+    inline void CpuRelax()
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#elif defined(__aarch64__)
+        asm volatile("yield" ::: "memory");
+#endif
+    }
+
+    // 一次等待：记录是谁在等（协程+调度器，或者线程），以及被什么原因唤醒
+    // 唤醒分两步：claim()用CAS抢占唤醒权，保证多个唤醒源（通知、超时）中只有一个生效；
+    // resume()真正把等待者放回调度器。两步之间可以安全地把数据交给等待者
+    // 必须通过std::make_shared创建，超时定时器等异步唤醒源只持有它的shared_ptr
+    class FiberWaiter : public std::enable_shared_from_this<FiberWaiter>
+    {
+    public:
+        // 唤醒原因
+        enum Result
+        {
+            WAITING = 0,  // 还在等待
+            NOTIFIED = 1, // 被正常唤醒
+            TIMEOUT = 2,  // 等待超时
+            CANCELED = 3, // 所在的TaskGroup被取消
+            USER = 16,    // 各原语自定义的唤醒原因从这里开始
+        };
+
+        // 记录当前执行上下文，需在挂起前、加入等待队列时创建
+        // timed为true表示之后会调用waitFor()：超时定时器依赖IOManager，在普通Scheduler里只能退化为阻塞线程
+        // cancelable为true时，协程所在的TaskGroup被取消会以CANCELED唤醒它；唤醒方不检查claim结果的原语（FiberMutex）必须传false
+        explicit FiberWaiter(bool timed = false, bool cancelable = true);
+
+        // 挂起当前协程（或阻塞当前线程）直到resume()，返回唤醒原因
+        int wait();
+        // 最多等待ms毫秒，被正常唤醒返回true；超时或取消返回false，原因见result()
+        bool waitFor(uint64_t ms);
+        // 抢占唤醒权，只有第一个调用者返回true
+        bool claim(int result = NOTIFIED)
+        {
+            int expected = WAITING;
+            return _m_result.compare_exchange_strong(expected, result, std::memory_order_acq_rel);
+        }
+        // 把等待者放回调度器或唤醒线程，只能由claim()成功的一方调用一次
+        void resume();
+        // claim + resume
+        bool wake(int result = NOTIFIED)
+        {
+            if (!claim(result))
+            {
+                return false;
+            }
+            resume();
+            return true;
+        }
+        int result() const { return _m_result.load(std::memory_order_acquire); }
+
+        // 唤醒一批等待者：claim成功的协程按调度器分组，每个调度器只调用一次scheduleBatch
+        static void WakeAll(std::vector<std::shared_ptr<FiberWaiter>> &waiters, int result = NOTIFIED);
+
+    private:
+        std::shared_ptr<Fiber> _m_fiber; // 挂起的协程，resume时移动进调度器的任务队列
+        Scheduler *_m_scheduler = nullptr;
+        std::unique_ptr<Semaphore> _m_sem; // 不在任务协程里时用来阻塞线程
+        bool _m_cancelable;
+        std::atomic<int> _m_result{WAITING};
+    };
+
+    // 协程互斥锁
+    // 无竞争时lock/unlock各是一次CAS；有竞争时先短暂自旋，再把协程挂到等待队列里，不会阻塞工作线程
+    // 正常模式下解锁只唤醒队首让它重新抢锁，新来的协程可以插队，吞吐量高；
+    // 某个等待者等待超过STARVE_NS后进入饥饿模式：解锁直接把锁移交给队首，禁止插队和自旋，等待队列清空后退出饥饿模式
+    // 持有锁期间可以调用任何会让出协程的操作（hook的I/O、sleep等）
+    class FiberMutex
+    {
+    public:
+        FiberMutex() = default;
+        FiberMutex(const FiberMutex &) = delete;
+        FiberMutex &operator=(const FiberMutex &) = delete;
+
+        void lock();
+        bool try_lock();
+        void unlock();
+
+    private:
+        // 状态位
+        enum State : uint32_t
+        {
+            LOCKED = 0x1,   // 已加锁
+            WAITERS = 0x2,  // 等待队列非空，解锁要走慢路径
+            STARVING = 0x4, // 饥饿模式
+        };
+        // 唤醒原因：让等待者重新抢锁，或者锁已经直接移交给它
+        enum WakeReason
+        {
+            RETRY = FiberWaiter::NOTIFIED,
+            HANDOFF = FiberWaiter::USER,
+        };
+        // 自旋次数，超过之后挂起
+        static const int SPIN_COUNT = 64;
+        // 等待超过1ms进入饥饿模式
+        static const uint64_t STARVE_NS = 1000 * 1000;
+
+        // 自旋尝试加锁
+        bool spinLock();
+
+    private:
+        std::atomic<uint32_t> _m_state{0};
+        std::mutex _m_mutex; // 只保护等待队列，持有时间是O(1)的
+        std::deque<std::shared_ptr<FiberWaiter>> _m_waiters;
+    };
+
+    // 协程条件变量，可以配合任何提供lock()/unlock()的锁使用（FiberMutex、std::unique_lock<FiberMutex>等）
+    // 等待者先入队再释放锁，notify不会丢失；超时/被取消的等待者自己从队列里移除
+    // 返回bool的等待函数失败时设置errno：ETIMEDOUT超时，ECANCELED所在的TaskGroup被取消；无论成败返回时都已重新持有锁
+    class FiberCondVar
+    {
+    public:
+        FiberCondVar() = default;
+        FiberCondVar(const FiberCondVar &) = delete;
+        FiberCondVar &operator=(const FiberCondVar &) = delete;
+
+        template <typename Lock>
+        bool wait(Lock &lock)
+        {
+            std::shared_ptr<FiberWaiter> waiter = enqueue(false);
+            lock.unlock();
+            bool notified = waiter->wait() != FiberWaiter::CANCELED;
+            if (!notified)
+            {
+                remove(waiter);
+                errno = ECANCELED;
+            }
+            lock.lock();
+            return notified;
+        }
+
+        // 等到pred()为真，被取消返回false
+        template <typename Lock, typename Predicate>
+        bool wait(Lock &lock, Predicate pred)
+        {
+            while (!pred())
+            {
+                if (!wait(lock))
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        // 最多等待ms毫秒，超时返回false
+        template <typename Lock>
+        bool waitFor(Lock &lock, uint64_t ms)
+        {
+            std::shared_ptr<FiberWaiter> waiter = enqueue(true);
+            lock.unlock();
+            bool notified = waiter->waitFor(ms);
+            if (!notified)
+            {
+                remove(waiter);
+                errno = waiter->result() == FiberWaiter::CANCELED ? ECANCELED : ETIMEDOUT;
+            }
+            lock.lock();
+            return notified;
+        }
+
+        // 等到pred()为真或超时/被取消，返回pred()的最终结果
+        template <typename Lock, typename Predicate>
+        bool waitFor(Lock &lock, uint64_t ms, Predicate pred)
+        {
+            auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(ms);
+            while (!pred())
+            {
+                auto now = std::chrono::steady_clock::now();
+                if (now >= deadline)
+                {
+                    return false;
+                }
+                uint64_t left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now).count();
+                if (!waitFor(lock, left ? left : 1) && errno == ECANCELED)
+                {
+                    return pred();
+                }
+            }
+            return true;
+        }
+
+        void notify_one();
+        void notify_all();
+
+    private:
+        std::shared_ptr<FiberWaiter> enqueue(bool timed);
+        void remove(const std::shared_ptr<FiberWaiter> &waiter);
+
+    private:
+        std::mutex _m_mutex;
+        std::deque<std::shared_ptr<FiberWaiter>> _m_waiters;
+    };
+
+    // 协程计数信号量
+    // signal()时如果有等待者，许可直接交给队首等待者，不经过计数，新来的wait()无法抢走
+    class FiberSemaphore
+    {
+    public:
+        explicit FiberSemaphore(size_t count = 0) : _m_count(count) {}
+        FiberSemaphore(const FiberSemaphore &) = delete;
+        FiberSemaphore &operator=(const FiberSemaphore &) = delete;
+
+        // P操作，-1；被取消返回false且errno = ECANCELED
+        bool wait();
+        // 不等待，拿不到许可返回false
+        bool tryWait();
+        // 最多等待ms毫秒，超时返回false且errno = ETIMEDOUT（被取消为ECANCELED）
+        bool waitFor(uint64_t ms);
+        // V操作，+n
+        void signal(size_t n = 1);
+
+    private:
+        void remove(const std::shared_ptr<FiberWaiter> &waiter);
+
+    private:
+        std::mutex _m_mutex;
+        size_t _m_count;
+        std::deque<std::shared_ptr<FiberWaiter>> _m_waiters;
+    };
+
+    // 等待一组任务结束（同Go的sync.WaitGroup）
+    // add()登记任务数，任务结束时done()，wait()挂起直到计数归零；计数归零时一次唤醒全部等待者
+    // 计数归零后可以再次add()复用，但不能和还没返回的wait()并发
+    class FiberWaitGroup
+    {
+    public:
+        FiberWaitGroup() = default;
+        FiberWaitGroup(const FiberWaitGroup &) = delete;
+        FiberWaitGroup &operator=(const FiberWaitGroup &) = delete;
+
+        // 计数加delta，可以为负，计数不能小于0
+        void add(long delta = 1);
+        void done() { add(-1); }
+        // 挂起直到计数为0；被取消返回false且errno = ECANCELED
+        bool wait();
+        long count() const { return _m_count.load(std::memory_order_acquire); }
+
+    private:
+        std::atomic<long> _m_count{0};
+        std::mutex _m_mutex;
+        std::vector<std::shared_ptr<FiberWaiter>> _m_waiters;
+    };
+
+    // 可重复使用的屏障：每轮count个协程调用wait()，最后一个到达的协程一次唤醒本轮其余等待者
+    // 等待不可取消：屏障的计数属于整组参与者，单个协程中途退出会让其他参与者永远等不齐
+    class FiberBarrier
+    {
+    public:
+        explicit FiberBarrier(size_t count);
+        FiberBarrier(const FiberBarrier &) = delete;
+        FiberBarrier &operator=(const FiberBarrier &) = delete;
+
+        // 挂起直到本轮所有参与者到达；最后到达的协程返回true（可用来做每轮一次的收尾工作），其余返回false
+        bool wait();
+
+    private:
+        std::mutex _m_mutex;
+        const size_t _m_count;
+        size_t _m_arrived = 0;
+        std::vector<std::shared_ptr<FiberWaiter>> _m_waiters;
+    };
+
+    // 协程读写锁，针对读多写少的数据（配置、路由表、fd表）
+    // 读计数分散在多个独占缓存行的槽里，每个线程固定使用一个槽：没有写者时加读锁只是对本线程槽的一次原子加，
+    // 不同线程的读者之间没有共享写。协程持有读锁期间可能被调度到别的线程，解锁时减的是当时所在线程的槽，
+    // 单个槽可能为负，但所有槽的和始终等于持有读锁的数量
+    // 写者优先：写者到达后新来的读者挂起等待，写者挂起等已有读者全部退出；写者之间由FiberMutex串行化
+    // 等待不可取消。可以配合std::shared_lock/std::unique_lock使用
+    class FiberRWMutex
+    {
+    public:
+        FiberRWMutex();
+        FiberRWMutex(const FiberRWMutex &) = delete;
+        FiberRWMutex &operator=(const FiberRWMutex &) = delete;
+
+        void lock_shared();
+        bool try_lock_shared();
+        void unlock_shared();
+
+        void lock();
+        void unlock();
+
+    private:
+        static constexpr size_t MIN_SLOTS = 16;
+
+        // 独占一个缓存行的读计数，避免伪共享
+        struct alignas(64) Slot
+        {
+            std::atomic<long> readers{0};
+        };
+
+        Slot &mySlot();
+        long readerCount();
+        // 读者退出：有写者在等待并且自己是最后一个读者时唤醒写者
+        void readerExit(Slot &slot);
+
+    private:
+        size_t _m_slotCount;
+        std::unique_ptr<Slot[]> _m_slots;
+        std::atomic<bool> _m_writer{false};
+        FiberMutex _m_writerLock;                          // 写者之间互斥
+        std::mutex _m_mutex;                               // 保护下面两个等待队列
+        std::shared_ptr<FiberWaiter> _m_writerWaiter;      // 等待读者退出的写者
+        std::vector<std::shared_ptr<FiberWaiter>> _m_readerWaiters; // 等待写者解锁的读者
+    };
+}
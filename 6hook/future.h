@@ -0,0 +1,348 @@
+#pragma once
+
+#include <atomic>
+#include <cassert>
+#include <cerrno>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "fiberSync.h"
+#include "scheduler.h"
+
+// 协程的Future/Promise
+// Future::get()在结果就绪前挂起当前协程（不在任务协程里时阻塞线程），异常通过get()重新抛给等待方
+// spawn(f)把f放进调度器执行并返回它的Future（子协程继承截止时间，见deadline.h）；when_all/when_any组合多个Future，完成回调里直接设置结果，不需要额外的协程
+
+namespace nsCoroutine
+{
+    // Future和Promise共享的状态
+    template <typename T>
+    class FutureState
+    {
+    public:
+        // void没有值，用一个占位类型
+        using Storage = std::conditional_t<std::is_void_v<T>, char, T>;
+
+        bool ready()
+        {
+            std::lock_guard<std::mutex> lock(_m_mutex);
+            return _m_ready;
+        }
+
+        // 挂起直到结果就绪；timed为true时最多等ms毫秒，超时或被取消返回false（errno为ETIMEDOUT/ECANCELED）
+        bool wait(bool timed = false, uint64_t ms = 0)
+        {
+            std::shared_ptr<FiberWaiter> waiter;
+            {
+                std::lock_guard<std::mutex> lock(_m_mutex);
+                if (_m_ready)
+                {
+                    return true;
+                }
+                waiter = std::make_shared<FiberWaiter>(timed);
+                _m_waiters.push_back(waiter);
+            }
+            if (timed ? waiter->waitFor(ms) : waiter->wait() != FiberWaiter::CANCELED)
+            {
+                return true;
+            }
+            errno = waiter->result() == FiberWaiter::CANCELED ? ECANCELED : ETIMEDOUT;
+            std::lock_guard<std::mutex> lock(_m_mutex);
+            for (auto it = _m_waiters.begin(); it != _m_waiters.end(); ++it)
+            {
+                if (*it == waiter)
+                {
+                    _m_waiters.erase(it);
+                    break;
+                }
+            }
+            return false;
+        }
+
+        template <typename... Args>
+        void setValue(Args &&...args)
+        {
+            complete([&]()
+                     { _m_value.emplace(std::forward<Args>(args)...); });
+        }
+
+        void setException(std::exception_ptr error)
+        {
+            complete([&]()
+                     { _m_error = std::move(error); });
+        }
+
+        // 注册完成回调，已经完成的话立即在当前上下文调用
+        // 回调在设置结果的协程里执行，不能挂起，只适合做转发
+        void then(std::function<void()> cb)
+        {
+            {
+                std::lock_guard<std::mutex> lock(_m_mutex);
+                if (!_m_ready)
+                {
+                    _m_callbacks.push_back(std::move(cb));
+                    return;
+                }
+            }
+            cb();
+        }
+
+        // 取走结果，必须在就绪之后调用；有异常时重新抛出
+        T take()
+        {
+            std::lock_guard<std::mutex> lock(_m_mutex);
+            assert(_m_ready);
+            if (_m_error)
+            {
+                std::rethrow_exception(_m_error);
+            }
+            if constexpr (!std::is_void_v<T>)
+            {
+                return std::move(*_m_value);
+            }
+        }
+
+    private:
+        // 在锁内写入结果，锁外唤醒等待者、执行回调
+        template <typename F>
+        void complete(F set)
+        {
+            std::vector<std::shared_ptr<FiberWaiter>> waiters;
+            std::vector<std::function<void()>> callbacks;
+            {
+                std::lock_guard<std::mutex> lock(_m_mutex);
+                if (_m_ready)
+                {
+                    throw std::future_error(std::future_errc::promise_already_satisfied);
+                }
+                set();
+                _m_ready = true;
+                waiters.swap(_m_waiters);
+                callbacks.swap(_m_callbacks);
+            }
+            for (auto &w : waiters)
+            {
+                w->wake();
+            }
+            for (auto &cb : callbacks)
+            {
+                cb();
+            }
+        }
+
+    private:
+        std::mutex _m_mutex;
+        bool _m_ready = false;
+        std::optional<Storage> _m_value;
+        std::exception_ptr _m_error;
+        std::vector<std::shared_ptr<FiberWaiter>> _m_waiters;
+        std::vector<std::function<void()>> _m_callbacks;
+    };
+
+    // 异步结果的读取端，只能移动；get()只能调用一次
+    template <typename T>
+    class Future
+    {
+    public:
+        Future() = default;
+        explicit Future(std::shared_ptr<FutureState<T>> state) : _m_state(std::move(state)) {}
+        Future(Future &&) = default;
+        Future &operator=(Future &&) = default;
+        Future(const Future &) = delete;
+        Future &operator=(const Future &) = delete;
+
+        // 是否关联了结果（get()之后变为false）
+        bool valid() const { return _m_state != nullptr; }
+        bool ready() const { return _m_state->ready(); }
+        // 挂起直到结果就绪，被取消返回false
+        bool wait() const { return _m_state->wait(); }
+        // 最多等待ms毫秒，超时或被取消返回false
+        bool waitFor(uint64_t ms) const { return _m_state->wait(true, ms); }
+
+        // 挂起直到结果就绪并取走结果，异步任务抛出的异常在这里重新抛出
+        // 等待期间被取消时抛出std::system_error(ECANCELED)，Future仍然有效
+        T get()
+        {
+            if (!_m_state->wait())
+            {
+                throw std::system_error(std::make_error_code(std::errc::operation_canceled));
+            }
+            std::shared_ptr<FutureState<T>> state = std::move(_m_state);
+            return state->take();
+        }
+
+        // 供when_all/when_any等组合函数使用
+        const std::shared_ptr<FutureState<T>> &state() const { return _m_state; }
+
+    private:
+        std::shared_ptr<FutureState<T>> _m_state;
+    };
+
+    // 异步结果的写入端，只能移动；析构时还没有设置结果的话，Future会得到broken_promise异常
+    template <typename T>
+    class Promise
+    {
+    public:
+        Promise() : _m_state(std::make_shared<FutureState<T>>()) {}
+        Promise(Promise &&) = default;
+        Promise &operator=(Promise &&) = default;
+        Promise(const Promise &) = delete;
+        Promise &operator=(const Promise &) = delete;
+
+        ~Promise()
+        {
+            if (_m_state && !_m_state->ready())
+            {
+                _m_state->setException(std::make_exception_ptr(std::future_error(std::future_errc::broken_promise)));
+            }
+        }
+
+        Future<T> getFuture() { return Future<T>(_m_state); }
+
+        // void版本调用setValue()
+        template <typename... Args>
+        void setValue(Args &&...args) { _m_state->setValue(std::forward<Args>(args)...); }
+        void setException(std::exception_ptr error) { _m_state->setException(std::move(error)); }
+
+    private:
+        std::shared_ptr<FutureState<T>> _m_state;
+    };
+
+    // 在scheduler上异步执行f，返回f结果的Future，f抛出的异常由Future::get()重新抛出
+    template <typename F>
+    auto spawn(Scheduler *scheduler, F &&f) -> Future<std::invoke_result_t<std::decay_t<F>>>
+    {
+        using R = std::invoke_result_t<std::decay_t<F>>;
+        std::shared_ptr<FutureState<R>> state = std::make_shared<FutureState<R>>();
+        // 子协程继承当前协程的截止时间和优先级
+        Fiber *self = Fiber::GetThisRaw();
+        uint64_t deadline = self->getDeadline();
+        scheduler->scheduleLock(std::function<void()>([state, fn = std::forward<F>(f)]() mutable
+        {
+            try
+            {
+                if constexpr (std::is_void_v<R>)
+                {
+                    fn();
+                    state->setValue();
+                }
+                else
+                {
+                    state->setValue(fn());
+                }
+            }
+            catch (...)
+            {
+                state->setException(std::current_exception());
+            }
+        }), -1, self->getPriority(), deadline);
+        return Future<R>(std::move(state));
+    }
+
+    // 在当前线程的调度器上异步执行f
+    template <typename F>
+    auto spawn(F &&f) -> Future<std::invoke_result_t<std::decay_t<F>>>
+    {
+        Scheduler *scheduler = Scheduler::GetThis();
+        assert(scheduler != nullptr);
+        return spawn(scheduler, std::forward<F>(f));
+    }
+
+    // 所有Future都完成后完成，结果按输入顺序排列（void版本没有结果）
+    // 有Future以异常结束时，结果Future得到按输入顺序的第一个异常
+    template <typename T>
+    auto when_all(std::vector<Future<T>> futures)
+        -> Future<std::conditional_t<std::is_void_v<T>, void, std::vector<T>>>
+    {
+        using R = std::conditional_t<std::is_void_v<T>, void, std::vector<T>>;
+        struct Context
+        {
+            std::atomic<size_t> left;
+            std::vector<std::shared_ptr<FutureState<T>>> states;
+        };
+        std::shared_ptr<FutureState<R>> out = std::make_shared<FutureState<R>>();
+        std::shared_ptr<Context> ctx = std::make_shared<Context>();
+        ctx->left.store(futures.size());
+        for (auto &f : futures)
+        {
+            ctx->states.push_back(f.state());
+        }
+
+        // 最后一个完成的Future负责收集结果
+        auto collect = [ctx, out]()
+        {
+            if (ctx->left.fetch_sub(1) != 1)
+            {
+                return;
+            }
+            try
+            {
+                if constexpr (std::is_void_v<T>)
+                {
+                    for (auto &s : ctx->states)
+                    {
+                        s->take();
+                    }
+                    out->setValue();
+                }
+                else
+                {
+                    std::vector<T> values;
+                    values.reserve(ctx->states.size());
+                    for (auto &s : ctx->states)
+                    {
+                        values.push_back(s->take());
+                    }
+                    out->setValue(std::move(values));
+                }
+            }
+            catch (...)
+            {
+                out->setException(std::current_exception());
+            }
+        };
+
+        if (futures.empty())
+        {
+            ctx->left.store(1);
+            collect();
+        }
+        for (auto &s : ctx->states)
+        {
+            s->then(collect);
+        }
+        return Future<R>(std::move(out));
+    }
+
+    // 任一Future完成（包括以异常结束）后完成，结果是它在futures里的下标，之后可以调用futures[i].get()取值
+    template <typename T>
+    Future<size_t> when_any(std::vector<Future<T>> &futures)
+    {
+        std::shared_ptr<FutureState<size_t>> out = std::make_shared<FutureState<size_t>>();
+        if (futures.empty())
+        {
+            out->setException(std::make_exception_ptr(std::invalid_argument("when_any: no futures")));
+            return Future<size_t>(std::move(out));
+        }
+        std::shared_ptr<std::atomic<bool>> done = std::make_shared<std::atomic<bool>>(false);
+        for (size_t i = 0; i < futures.size(); ++i)
+        {
+            futures[i].state()->then([out, done, i]()
+            {
+                if (!done->exchange(true))
+                {
+                    out->setValue(i);
+                }
+            });
+        }
+        return Future<size_t>(std::move(out));
+    }
+}
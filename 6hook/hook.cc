@@ -1,10 +1,18 @@
 #include "hook.h"
 #include "ioManager.h"
 #include "fdManager.h"
+#include "fiberSync.h"
+#include "taskGroup.h"
+#include "deadline.h"
+#include "offload.h"
+#include "resolver.h"
+#include "log.h"
 #include <iostream>
 #include <dlfcn.h>
 #include <cstdarg>
 #include <cstring>
+#include <algorithm>
+#include <arpa/inet.h>
 
 // 宏定义，用于声明所有需要hook的函数
 // 配合 #define XX(name) name##_f = (name##_fun)dlsym(RTLD_NEXT, #name); 使用
@@ -29,7 +37,28 @@
     XX(fcntl)        \
     XX(ioctl)        \
     XX(getsockopt)   \
-    XX(setsockopt)
+    XX(setsockopt)   \
+    XX(pread)        \
+    XX(pwrite)       \
+    XX(preadv)       \
+    XX(pwritev)      \
+    XX(fsync)        \
+    XX(fdatasync)    \
+    XX(open)         \
+    XX(openat)       \
+    XX(poll)         \
+    XX(ppoll)        \
+    XX(select)       \
+    XX(epoll_wait)   \
+    XX(accept4)      \
+    XX(socketpair)   \
+    XX(pipe)         \
+    XX(pipe2)        \
+    XX(eventfd)      \
+    XX(dup)          \
+    XX(dup2)         \
+    XX(dup3)         \
+    XX(getaddrinfo)
 
 namespace nsCoroutine
 {
@@ -90,6 +119,9 @@ static ssize_t do_io(int fd, OriginFun fun, const char *hook_fun_name, uint32_t
         return fun(fd, std::forward<Args>(args)...);
     }
 
+    // hook的I/O调用是抢占的安全点：时间片用完的协程在这里让出
+    nsCoroutine::yield_point();
+
     // 获取与文件描述符fd相关联的上下文ctx，如果上下文不存在，则直接调用原始的I/O函数
     std::shared_ptr<nsCoroutine::FdCtx> ctx = nsCoroutine::FdMgr::GetInstance()->get(fd);
     if (!ctx)
@@ -104,12 +136,21 @@ static ssize_t do_io(int fd, OriginFun fun, const char *hook_fun_name, uint32_t
         return -1;
     }
 
-    // 如果文件描述符不是一个socket或者用户设置了非阻塞模式，则直接调用原始的I/O操作函数
-    if (!ctx->isSocket() || ctx->getUserNonblock())
+    // 用户设置了非阻塞模式，直接调用原始的I/O操作函数
+    if (ctx->getUserNonblock())
     {
         return fun(fd, std::forward<Args>(args)...);
     }
 
+    // 普通文件等epoll帮不上忙的fd交给卸载池执行，工作线程不被阻塞
+    if (!ctx->isPollable())
+    {
+        return nsCoroutine::offload([&]()
+        {
+            return fun(fd, std::forward<Args>(args)...);
+        });
+    }
+
     // 获取超时设置并初始化timer_info结构体，用于后续的超时管理和取消操作。
     uint64_t timeout = ctx->getTimeout(timeout_so);
     // 条件定时器的条件
@@ -135,10 +176,23 @@ retry:
         std::shared_ptr<nsCoroutine::Timer> timer;
         std::weak_ptr<timer_info> winfo(tinfo);
 
+        // 协程设置了截止时间的话，等待时间不超过剩余预算；预算已经用完直接超时
+        uint64_t wait_ms = timeout;
+        uint64_t left = nsCoroutine::deadline_left_ms();
+        if (left == 0)
+        {
+            errno = ETIMEDOUT;
+            return -1;
+        }
+        if (left < wait_ms)
+        {
+            wait_ms = left;
+        }
+
         // 如果执行的read等函数在Fdmanager管理的Fdctx中fd设置了超时时间，就会走到这里，添加addconditionTimer事件
-        if (timeout != (uint64_t)-1)
+        if (wait_ms != (uint64_t)-1)
         {
-            timer = iom->addConditionTimer(timeout, [winfo, fd, iom, event]()
+            timer = iom->addConditionTimer(wait_ms, [winfo, fd, iom, event]()
              {
                 auto t = winfo.lock();
                 // 如果 timer_info 对象已被释放（!t），或者操作已被取消（t->cancelled 非 0），则直接返回。
@@ -156,7 +210,7 @@ retry:
         int rt = iom->addEvent(fd, (nsCoroutine::IOManager::Event)(event));
         if (rt == -1)
         {
-            std::cout << hook_fun_name << " addEvent(" << fd << ", " << event << ")";
+            LOG_ERROR("{} addEvent({}, {}) failed", hook_fun_name, fd, event);
             // 如果 rt 为-1，说明 addEvent 失败。此时，会打印一条调试信息，并且因为添加事件失败所以要取消之前设置的定时器，避免误触发。
             if (timer)
             {
@@ -166,8 +220,34 @@ retry:
         }
         else
         {
+            // 所在的TaskGroup被取消时，和超时一样取消事件并唤醒协程；已经被取消的话直接触发一次，yield消化掉这次唤醒
+            nsCoroutine::CancelState *cancel = nsCoroutine::CancelState::GetThis();
+            if (cancel)
+            {
+                auto cancel_io = [winfo, fd, iom, event]()
+                {
+                    auto t = winfo.lock();
+                    if (!t || t->cancelled)
+                    {
+                        return;
+                    }
+                    t->cancelled = ECANCELED;
+                    iom->cancelEvent(fd, (nsCoroutine::IOManager::Event)(event));
+                };
+                if (!cancel->arm(cancel_io))
+                {
+                    cancel_io();
+                    cancel = nullptr;
+                }
+            }
+
             // 如果 addEvent 成功（rt 为 0），当前协程会调用 yield() 函数，将自己挂起，等待事件的触发。
-            nsCoroutine::Fiber::GetThis()->yield();
+            // 协程已经由addEvent保存在事件上下文中，这里用裸指针yield即可
+            nsCoroutine::Fiber::GetThisRaw()->yield();
+            if (cancel)
+            {
+                cancel->disarm();
+            }
 
             // 当协程被恢复时（例如，事件触发后），它会继续执行 yield() 之后的代码。
             // 如果之前设置了定时器（timer 不为 nullptr），则在事件处理完毕后取消该定时器。取消定时器的原因是，该定时器的唯一目的是在 I/O 操作超时时取消事件。如果事件已经正常处理完毕，那么定时器就不再需要了。
@@ -176,7 +256,8 @@ retry:
                 timer->cancel();
             }
             // 接下来检查 tinfo->cancelled 是否等于 ETIMEDOUT。如果等于，说明该操作因超时而被取消，因此设置 errno 为 ETIMEDOUT 并返回 -1，表示操作失败。
-            if (tinfo->cancelled == ETIMEDOUT)
+            // 被TaskGroup取消时为ECANCELED
+            if (tinfo->cancelled == ETIMEDOUT || tinfo->cancelled == ECANCELED)
             {
                 errno = tinfo->cancelled;
                 return -1;
@@ -188,6 +269,234 @@ retry:
     return n;
 }
 
+// sleep系列的公共实现，睡满返回0；被TaskGroup取消返回ECANCELED；先到了协程的截止时间返回ETIMEDOUT
+static int sleep_ms(uint64_t ms)
+{
+    int expired = 0;
+    uint64_t left = nsCoroutine::deadline_left_ms();
+    if (left < ms)
+    {
+        ms = left;
+        expired = ETIMEDOUT;
+    }
+
+    //获取当前正在执行的协程（Fiber），并将其保存到fiber变量中
+    nsCoroutine::Fiber *fiber = nsCoroutine::Fiber::GetThisRaw();
+    nsCoroutine::IOManager *iom = nsCoroutine::IOManager::GetThis();
+    if (fiber->cancelState() == nullptr)
+    {
+        // 添加一个定时器，在指定的时间后触发一个回调函数
+        // 这个回调函数会将当前协程（fiber）添加到 IOManager 的调度队列中，等待被调度执行
+        // 定时器是唯一持有协程的地方，shared_ptr只在这里取一次，触发时移动进任务队列
+        iom->addTimer(ms, [sp = fiber->shared_from_this(), iom]() mutable
+                      { iom->scheduleLock(std::move(sp), -1); });
+        // 挂起当前协程，等待被调度执行
+        fiber->yield();
+        return expired;
+    }
+    // TaskGroup的子任务：取消要能提前唤醒，由FiberWaiter决出超时和取消谁先到
+    std::shared_ptr<nsCoroutine::FiberWaiter> waiter = std::make_shared<nsCoroutine::FiberWaiter>(true);
+    waiter->waitFor(ms);
+    return waiter->result() == nsCoroutine::FiberWaiter::CANCELED ? ECANCELED : expired;
+}
+
+// 文件I/O的通用模板：磁盘读写和fsync没法用epoll等待，整个调用交给卸载池执行，只挂起当前协程
+// 不在任务协程里时offload()直接在当前线程执行
+template <typename OriginFun, typename... Args>
+static auto do_file_io(OriginFun fun, Args &&...args)
+{
+    if (!nsCoroutine::t_hook_enable)
+    {
+        return fun(std::forward<Args>(args)...);
+    }
+    nsCoroutine::yield_point();
+    return nsCoroutine::offload([&]()
+    {
+        return fun(std::forward<Args>(args)...);
+    });
+}
+
+// 登记hook创建的fd（open、pipe、socketpair、dup等），FdCtx初始化时判断类型，套接字、管道、eventfd设为非阻塞
+// user_nonblock是用户创建时要求的非阻塞（O_NONBLOCK、SOCK_NONBLOCK等），保持原来的语义，由do_io直接调用
+static int register_fd(int fd, bool user_nonblock)
+{
+    if (fd >= 0 && nsCoroutine::t_hook_enable)
+    {
+        std::shared_ptr<nsCoroutine::FdCtx> ctx = nsCoroutine::FdMgr::GetInstance()->get(fd, true);
+        if (ctx && user_nonblock)
+        {
+            ctx->setUserNonblock(true);
+        }
+    }
+    return fd;
+}
+
+// dup系列：新fd和旧fd共享打开的文件描述，沿用旧fd的非阻塞和超时设置；旧fd没有登记时新fd也不登记
+static int register_dup(int oldfd, int newfd)
+{
+    if (newfd < 0 || !nsCoroutine::t_hook_enable)
+    {
+        return newfd;
+    }
+    std::shared_ptr<nsCoroutine::FdCtx> old_ctx = nsCoroutine::FdMgr::GetInstance()->get(oldfd);
+    if (old_ctx)
+    {
+        std::shared_ptr<nsCoroutine::FdCtx> ctx = nsCoroutine::FdMgr::GetInstance()->get(newfd, true);
+        ctx->setUserNonblock(old_ctx->getUserNonblock());
+        ctx->setTimeout(SO_RCVTIMEO, old_ctx->getTimeout(SO_RCVTIMEO));
+        ctx->setTimeout(SO_SNDTIMEO, old_ctx->getTimeout(SO_SNDTIMEO));
+    }
+    return newfd;
+}
+
+// dup2/dup3会关闭newfd原来的文件：和close一样唤醒等在它上面的协程并删除它的FdCtx
+// 必须在替换之前调用：这时EPOLL_CTL_DEL针对的还是原来的文件，替换之后就删不掉了，
+// 原来的文件还有别的dup时它在epoll里的登记会一直留着，事件继续触发到newfd的FdContext上
+static void release_fd(int fd)
+{
+    if (nsCoroutine::t_hook_enable && nsCoroutine::FdMgr::GetInstance()->get(fd))
+    {
+        nsCoroutine::IOManager *iom = nsCoroutine::IOManager::GetThis();
+        if (iom)
+        {
+            iom->cancelAll(fd);
+        }
+        nsCoroutine::FdMgr::GetInstance()->del(fd);
+    }
+}
+
+// 轮询间隔的上限：无法登记到epoll的fd靠定时poll发现就绪，间隔从1ms翻倍到这个值
+static const uint64_t POLL_RETRY_MAX_MS = 16;
+
+// 无法用epoll等待时的poll：不阻塞地poll，没有就绪就睡一会儿再试，直到end（NowMonoMs的时间）
+// 不占用卸载池的线程，长时间甚至无限期的poll也不会拖住文件I/O
+static int poll_by_sleep(struct pollfd *fds, nfds_t nfds, uint64_t end)
+{
+    uint64_t retry_ms = 1;
+    while (true)
+    {
+        int rt = poll_f(fds, nfds, 0);
+        if (rt != 0)
+        {
+            return rt;
+        }
+        uint64_t now = nsCoroutine::NowMonoMs();
+        if (now >= end)
+        {
+            return 0;
+        }
+        if (nsCoroutine::deadline_left_ms() == 0)
+        {
+            errno = ETIMEDOUT;
+            return -1;
+        }
+        // 截止时间由sleep_ms截断，下一轮poll之后按上面的检查返回
+        if (sleep_ms(std::min(retry_ms, end - now)) == ECANCELED)
+        {
+            errno = ECANCELED;
+            return -1;
+        }
+        retry_ms = std::min(retry_ms * 2, POLL_RETRY_MAX_MS);
+    }
+}
+
+// poll系列的公共实现：把fds登记到IOManager，挂起当前协程，直到其中一个就绪、超时（返回0）或者被取消
+// 先不阻塞地poll一次，已经有就绪的fd就直接返回；事件触发后重新poll一次得到revents
+// 登记失败（同一个fd的同一个事件已经有别的协程在等，或者epoll不支持这个fd）时改为在协程里轮询
+// 受协程截止时间限制：先到截止时间返回-1且errno = ETIMEDOUT
+static int poll_fibered(struct pollfd *fds, nfds_t nfds, int timeout_ms)
+{
+    nsCoroutine::IOManager *iom = nsCoroutine::IOManager::GetThis();
+    if (!nsCoroutine::t_hook_enable || !iom || !nsCoroutine::Scheduler::InTaskFiber())
+    {
+        return poll_f(fds, nfds, timeout_ms);
+    }
+    nsCoroutine::yield_point();
+
+    uint64_t end = timeout_ms < 0 ? (uint64_t)-1 : nsCoroutine::NowMonoMs() + timeout_ms;
+    while (true)
+    {
+        int rt = poll_f(fds, nfds, 0);
+        if (rt != 0)
+        {
+            return rt;
+        }
+        uint64_t now = nsCoroutine::NowMonoMs();
+        if (now >= end)
+        {
+            return 0;
+        }
+        uint64_t wait_ms = end == (uint64_t)-1 ? (uint64_t)-1 : end - now;
+        uint64_t left = nsCoroutine::deadline_left_ms();
+        if (left == 0)
+        {
+            errno = ETIMEDOUT;
+            return -1;
+        }
+        bool by_deadline = left < wait_ms;
+        if (by_deadline)
+        {
+            wait_ms = left;
+        }
+
+        // 任意一个事件触发都唤醒协程，之后的触发claim失败，什么也不做
+        std::shared_ptr<nsCoroutine::FiberWaiter> waiter = std::make_shared<nsCoroutine::FiberWaiter>(wait_ms != (uint64_t)-1);
+        std::vector<std::pair<int, nsCoroutine::IOManager::Event>> added;
+        bool registered = true;
+        for (nfds_t i = 0; i < nfds && registered; ++i)
+        {
+            if (fds[i].fd < 0)
+            {
+                continue;
+            }
+            for (nsCoroutine::IOManager::Event event : {nsCoroutine::IOManager::READ, nsCoroutine::IOManager::WRITE})
+            {
+                short mask = event == nsCoroutine::IOManager::READ ? (POLLIN | POLLPRI | POLLRDHUP) : POLLOUT;
+                if (!(fds[i].events & mask))
+                {
+                    continue;
+                }
+                if (iom->addEvent(fds[i].fd, event, [waiter]() { waiter->wake(); }) != 0)
+                {
+                    registered = false;
+                    break;
+                }
+                added.emplace_back(fds[i].fd, event);
+            }
+        }
+        if (!registered)
+        {
+            for (auto &a : added)
+            {
+                iom->delEvent(a.first, a.second);
+            }
+            return poll_by_sleep(fds, nfds, end);
+        }
+
+        bool notified = wait_ms == (uint64_t)-1 ? waiter->wait() == nsCoroutine::FiberWaiter::NOTIFIED : waiter->waitFor(wait_ms);
+        // 已经触发的事件已经从epoll上摘掉了，delEvent返回false
+        for (auto &a : added)
+        {
+            iom->delEvent(a.first, a.second);
+        }
+        if (!notified)
+        {
+            if (waiter->result() == nsCoroutine::FiberWaiter::CANCELED)
+            {
+                errno = ECANCELED;
+                return -1;
+            }
+            rt = poll_f(fds, nfds, 0);
+            if (rt == 0 && by_deadline)
+            {
+                errno = ETIMEDOUT;
+                return -1;
+            }
+            return rt;
+        }
+    }
+}
+
 extern "C"
 {
 
@@ -205,16 +514,14 @@ extern "C"
             return sleep_f(seconds);
         }
 
-        //获取当前正在执行的协程（Fiber），并将其保存到fiber变量中
-        std::shared_ptr<nsCoroutine::Fiber> fiber = nsCoroutine::Fiber::GetThis();
-        nsCoroutine::IOManager *iom = nsCoroutine::IOManager::GetThis();
-        // 添加一个定时器，在指定的时间后触发一个回调函数
-        // 这个回调函数会将当前协程（fiber）添加到 IOManager 的调度队列中，等待被调度执行
-        iom->addTimer(seconds * 1000, [fiber, iom]()
-                      { iom->scheduleLock(fiber, -1); });
-        // 挂起当前协程，等待被调度执行
-        fiber->yield();
-        return 0;
+        // 被TaskGroup取消或者到了截止时间时提前返回，返回值为没有睡够的秒数
+        uint64_t start = nsCoroutine::NowMonoMs();
+        if (sleep_ms(seconds * 1000) == 0)
+        {
+            return 0;
+        }
+        uint64_t slept = nsCoroutine::NowMonoMs() - start;
+        return slept >= seconds * 1000ull ? 0 : seconds - slept / 1000;
     }
 
     int usleep(useconds_t usec)
@@ -224,13 +531,12 @@ extern "C"
             return usleep_f(usec);
         }
 
-        std::shared_ptr<nsCoroutine::Fiber> fiber = nsCoroutine::Fiber::GetThis();
-        nsCoroutine::IOManager *iom = nsCoroutine::IOManager::GetThis();
-        
-        iom->addTimer(usec / 1000, [fiber, iom]()
-                      { iom->scheduleLock(fiber); });
-
-        fiber->yield();
+        int rt = sleep_ms(usec / 1000);
+        if (rt != 0)
+        {
+            errno = rt;
+            return -1;
+        }
         return 0;
     }
 
@@ -243,13 +549,12 @@ extern "C"
 
         int timeout_ms = req->tv_sec * 1000 + req->tv_nsec / 1000 / 1000;
 
-        std::shared_ptr<nsCoroutine::Fiber> fiber = nsCoroutine::Fiber::GetThis();
-        nsCoroutine::IOManager *iom = nsCoroutine::IOManager::GetThis();
-
-        iom->addTimer(timeout_ms, [fiber, iom]()
-                      { iom->scheduleLock(fiber, -1); });
-
-        fiber->yield();
+        int rt = sleep_ms(timeout_ms);
+        if (rt != 0)
+        {
+            errno = rt;
+            return -1;
+        }
         return 0;
     }
 
@@ -264,7 +569,7 @@ extern "C"
         // fd无效
         if (fd == -1)
         {
-            std::cerr << "socket() failed:" << strerror(errno) << std::endl;
+            LOG_ERROR("socket() failed: {}", strerror(errno));
             return fd;
         }
         //如果socket创建成功会利用Fdmanager的文件描述符管理类来进行管理，判断是否在其管理的文件描述符中，如果不在扩展存储文件描述数组大小，并且利用FDctx进行初始化判断是不是套接字，是不是系统非阻塞模式。
@@ -281,6 +586,8 @@ extern "C"
             return connect_f(fd, addr, addrlen);
         }
 
+        nsCoroutine::yield_point();
+
         std::shared_ptr<nsCoroutine::FdCtx> ctx = nsCoroutine::FdMgr::GetInstance()->get(fd);
         if (!ctx || ctx->isClosed())
         {
@@ -316,6 +623,18 @@ extern "C"
         std::shared_ptr<timer_info> tinfo(new timer_info);
         std::weak_ptr<timer_info> winfo(tinfo);
 
+        // 和do_io一样受协程截止时间限制
+        uint64_t left = nsCoroutine::deadline_left_ms();
+        if (left == 0)
+        {
+            errno = ETIMEDOUT;
+            return -1;
+        }
+        if (left < timeout_ms)
+        {
+            timeout_ms = left;
+        }
+
         if (timeout_ms != (uint64_t)-1)
         {
             timer = iom->addConditionTimer(timeout_ms, [winfo, fd, iom]()
@@ -333,7 +652,32 @@ extern "C"
         int rt = iom->addEvent(fd, nsCoroutine::IOManager::WRITE);
         if (rt == 0)
         {
-            nsCoroutine::Fiber::GetThis()->yield();
+            // 取消的处理和do_io相同
+            nsCoroutine::CancelState *cancel = nsCoroutine::CancelState::GetThis();
+            if (cancel)
+            {
+                auto cancel_io = [winfo, fd, iom]()
+                {
+                    auto t = winfo.lock();
+                    if (!t || t->cancelled)
+                    {
+                        return;
+                    }
+                    t->cancelled = ECANCELED;
+                    iom->cancelEvent(fd, nsCoroutine::IOManager::WRITE);
+                };
+                if (!cancel->arm(cancel_io))
+                {
+                    cancel_io();
+                    cancel = nullptr;
+                }
+            }
+
+            nsCoroutine::Fiber::GetThisRaw()->yield();
+            if (cancel)
+            {
+                cancel->disarm();
+            }
 
             if (timer)
             {
@@ -352,7 +696,7 @@ extern "C"
             {
                 timer->cancel();
             }
-            std::cerr << "connect addEvent(" << fd << ", WRITE) error";
+            LOG_ERROR("connect addEvent({}, WRITE) error", fd);
         }
 
         // 检查连接是否成功
@@ -392,6 +736,74 @@ extern "C"
         return fd;
     }
 
+    int accept4(int sockfd, struct sockaddr *addr, socklen_t *addrlen, int flags)
+    {
+        int fd = do_io(sockfd, accept4_f, "accept4", nsCoroutine::IOManager::READ, SO_RCVTIMEO, addr, addrlen, flags);
+        return register_fd(fd, flags & SOCK_NONBLOCK);
+    }
+
+    int socketpair(int domain, int type, int protocol, int sv[2])
+    {
+        int rt = socketpair_f(domain, type, protocol, sv);
+        if (rt == 0)
+        {
+            register_fd(sv[0], type & SOCK_NONBLOCK);
+            register_fd(sv[1], type & SOCK_NONBLOCK);
+        }
+        return rt;
+    }
+
+    int pipe(int pipefd[2])
+    {
+        int rt = pipe_f(pipefd);
+        if (rt == 0)
+        {
+            register_fd(pipefd[0], false);
+            register_fd(pipefd[1], false);
+        }
+        return rt;
+    }
+
+    int pipe2(int pipefd[2], int flags)
+    {
+        int rt = pipe2_f(pipefd, flags);
+        if (rt == 0)
+        {
+            register_fd(pipefd[0], flags & O_NONBLOCK);
+            register_fd(pipefd[1], flags & O_NONBLOCK);
+        }
+        return rt;
+    }
+
+    int eventfd(unsigned int initval, int flags)
+    {
+        return register_fd(eventfd_f(initval, flags), flags & EFD_NONBLOCK);
+    }
+
+    int dup(int oldfd)
+    {
+        return register_dup(oldfd, dup_f(oldfd));
+    }
+
+    // 能预先判断的失败（oldfd无效、oldfd == newfd、dup3的flags非法）不动newfd
+    int dup2(int oldfd, int newfd)
+    {
+        if (oldfd != newfd && fcntl_f(oldfd, F_GETFD) != -1)
+        {
+            release_fd(newfd);
+        }
+        return register_dup(oldfd, dup2_f(oldfd, newfd));
+    }
+
+    int dup3(int oldfd, int newfd, int flags)
+    {
+        if (oldfd != newfd && !(flags & ~O_CLOEXEC) && fcntl_f(oldfd, F_GETFD) != -1)
+        {
+            release_fd(newfd);
+        }
+        return register_dup(oldfd, dup3_f(oldfd, newfd, flags));
+    }
+
     ssize_t read(int fd, void *buf, size_t count)
     {
         return do_io(fd, read_f, "read", nsCoroutine::IOManager::READ, SO_RCVTIMEO, buf, count);
@@ -465,6 +877,249 @@ extern "C"
         return close_f(fd);
     }
 
+    ssize_t pread(int fd, void *buf, size_t count, off_t offset)
+    {
+        return do_file_io(pread_f, fd, buf, count, offset);
+    }
+
+    ssize_t pwrite(int fd, const void *buf, size_t count, off_t offset)
+    {
+        return do_file_io(pwrite_f, fd, buf, count, offset);
+    }
+
+    ssize_t preadv(int fd, const struct iovec *iov, int iovcnt, off_t offset)
+    {
+        return do_file_io(preadv_f, fd, iov, iovcnt, offset);
+    }
+
+    ssize_t pwritev(int fd, const struct iovec *iov, int iovcnt, off_t offset)
+    {
+        return do_file_io(pwritev_f, fd, iov, iovcnt, offset);
+    }
+
+    int fsync(int fd)
+    {
+        return do_file_io(fsync_f, fd);
+    }
+
+    int fdatasync(int fd)
+    {
+        return do_file_io(fdatasync_f, fd);
+    }
+
+    // open可能在静态初始化阶段（hook_init之前）就被其他库调用
+    int open(const char *pathname, int flags, ...)
+    {
+        if (!open_f)
+        {
+            nsCoroutine::hook_init();
+        }
+        // 只有创建文件时才有mode参数
+        mode_t mode = 0;
+        if ((flags & O_CREAT) || (flags & O_TMPFILE) == O_TMPFILE)
+        {
+            va_list va;
+            va_start(va, flags);
+            mode = va_arg(va, mode_t);
+            va_end(va);
+        }
+        return register_fd(do_file_io(open_f, pathname, flags, mode), flags & O_NONBLOCK);
+    }
+
+    int openat(int dirfd, const char *pathname, int flags, ...)
+    {
+        if (!openat_f)
+        {
+            nsCoroutine::hook_init();
+        }
+        mode_t mode = 0;
+        if ((flags & O_CREAT) || (flags & O_TMPFILE) == O_TMPFILE)
+        {
+            va_list va;
+            va_start(va, flags);
+            mode = va_arg(va, mode_t);
+            va_end(va);
+        }
+        return register_fd(do_file_io(openat_f, dirfd, pathname, flags, mode), flags & O_NONBLOCK);
+    }
+
+    int poll(struct pollfd *fds, nfds_t nfds, int timeout)
+    {
+        return poll_fibered(fds, nfds, timeout);
+    }
+
+    // 带信号掩码的ppoll没法在协程里模拟（掩码属于线程），直接调用原始函数
+    int ppoll(struct pollfd *fds, nfds_t nfds, const struct timespec *tmo_p, const sigset_t *sigmask)
+    {
+        if (sigmask || !nsCoroutine::t_hook_enable)
+        {
+            return ppoll_f(fds, nfds, tmo_p, sigmask);
+        }
+        // 超时向上取整到毫秒
+        int timeout = tmo_p ? (int)(tmo_p->tv_sec * 1000 + (tmo_p->tv_nsec + 999999) / 1000000) : -1;
+        return poll_fibered(fds, nfds, timeout);
+    }
+
+    // 转换成pollfd数组，exceptfds对应POLLPRI；超时时不修改timeout（POSIX允许）
+    int select(int nfds, fd_set *readfds, fd_set *writefds, fd_set *exceptfds, struct timeval *timeout)
+    {
+        if (!nsCoroutine::t_hook_enable || !nsCoroutine::Scheduler::InTaskFiber())
+        {
+            return select_f(nfds, readfds, writefds, exceptfds, timeout);
+        }
+        std::vector<struct pollfd> pfds;
+        for (int fd = 0; fd < nfds; ++fd)
+        {
+            short events = 0;
+            if (readfds && FD_ISSET(fd, readfds))
+            {
+                events |= POLLIN;
+            }
+            if (writefds && FD_ISSET(fd, writefds))
+            {
+                events |= POLLOUT;
+            }
+            if (exceptfds && FD_ISSET(fd, exceptfds))
+            {
+                events |= POLLPRI;
+            }
+            if (events)
+            {
+                pfds.push_back({fd, events, 0});
+            }
+        }
+        int timeout_ms = timeout ? (int)(timeout->tv_sec * 1000 + (timeout->tv_usec + 999) / 1000) : -1;
+        int rt = poll_fibered(pfds.data(), pfds.size(), timeout_ms);
+        if (rt < 0)
+        {
+            return rt;
+        }
+        // 无效的fd在select里是EBADF
+        for (auto &p : pfds)
+        {
+            if (p.revents & POLLNVAL)
+            {
+                errno = EBADF;
+                return -1;
+            }
+        }
+        rt = 0;
+        for (fd_set *set : {readfds, writefds, exceptfds})
+        {
+            if (set)
+            {
+                FD_ZERO(set);
+            }
+        }
+        for (auto &p : pfds)
+        {
+            if (readfds && (p.events & POLLIN) && (p.revents & (POLLIN | POLLHUP | POLLERR)))
+            {
+                FD_SET(p.fd, readfds);
+                ++rt;
+            }
+            if (writefds && (p.events & POLLOUT) && (p.revents & (POLLOUT | POLLERR)))
+            {
+                FD_SET(p.fd, writefds);
+                ++rt;
+            }
+            if (exceptfds && (p.events & POLLPRI) && (p.revents & POLLPRI))
+            {
+                FD_SET(p.fd, exceptfds);
+                ++rt;
+            }
+        }
+        return rt;
+    }
+
+    // epoll的fd本身可以被poll：等它可读后不阻塞地取事件，被别的线程抢先取走时继续等剩余的时间
+    int epoll_wait(int epfd, struct epoll_event *events, int maxevents, int timeout)
+    {
+        if (!nsCoroutine::t_hook_enable || !nsCoroutine::Scheduler::InTaskFiber())
+        {
+            return epoll_wait_f(epfd, events, maxevents, timeout);
+        }
+        uint64_t end = timeout < 0 ? (uint64_t)-1 : nsCoroutine::NowMonoMs() + timeout;
+        while (true)
+        {
+            uint64_t now = nsCoroutine::NowMonoMs();
+            int wait_ms = end == (uint64_t)-1 ? -1 : (now >= end ? 0 : (int)(end - now));
+            struct pollfd pfd = {epfd, POLLIN, 0};
+            int rt = poll_fibered(&pfd, 1, wait_ms);
+            if (rt <= 0)
+            {
+                return rt;
+            }
+            rt = epoll_wait_f(epfd, events, maxevents, 0);
+            if (rt != 0 || wait_ms == 0)
+            {
+                return rt;
+            }
+        }
+    }
+
+    // 域名交给协程版的解析器，得到的数字地址再用原始的getaddrinfo加上AI_NUMERICHOST展开：
+    // 端口、socktype/protocol、AI_PASSIVE、AI_ADDRCONFIG的处理和libc一致，结果同样用freeaddrinfo释放
+    int getaddrinfo(const char *node, const char *service, const struct addrinfo *hints, struct addrinfo **res)
+    {
+        if (!nsCoroutine::t_hook_enable || !nsCoroutine::Scheduler::InTaskFiber())
+        {
+            return getaddrinfo_f(node, service, hints, res);
+        }
+        int flags = hints ? hints->ai_flags : 0;
+        int family = hints ? hints->ai_family : AF_UNSPEC;
+        // 没有主机名或者是数字地址（包括inet_aton接受的"127.1"这类写法、带scope的IPv6地址）时libc不会阻塞
+        struct in6_addr numeric;
+        if (!node || (flags & AI_NUMERICHOST) || inet_aton(node, (struct in_addr *)&numeric) || inet_pton(AF_INET6, node, &numeric) == 1 || strchr(node, '%'))
+        {
+            return getaddrinfo_f(node, service, hints, res);
+        }
+
+        std::vector<std::string> addrs;
+        // IPv4映射地址这类少见的组合交给libc
+        int rt = (flags & (AI_V4MAPPED | AI_ALL)) ? nsCoroutine::Resolver::FALLBACK : nsCoroutine::Resolver::GetInstance()->lookup(node, family, addrs);
+        if (rt == nsCoroutine::Resolver::FALLBACK)
+        {
+            return nsCoroutine::offload([&]() { return getaddrinfo_f(node, service, hints, res); });
+        }
+        if (rt != 0)
+        {
+            return rt;
+        }
+
+        struct addrinfo numeric_hints = {};
+        numeric_hints.ai_family = family;
+        numeric_hints.ai_socktype = hints ? hints->ai_socktype : 0;
+        numeric_hints.ai_protocol = hints ? hints->ai_protocol : 0;
+        numeric_hints.ai_flags = (flags | AI_NUMERICHOST) & ~AI_CANONNAME;
+        struct addrinfo *head = nullptr;
+        struct addrinfo **tail = &head;
+        for (auto &addr : addrs)
+        {
+            struct addrinfo *list = nullptr;
+            rt = getaddrinfo_f(addr.c_str(), service, &numeric_hints, &list);
+            if (rt == 0)
+            {
+                *tail = list;
+                while (*tail)
+                {
+                    tail = &(*tail)->ai_next;
+                }
+            }
+        }
+        if (!head)
+        {
+            return rt;
+        }
+        // 规范名返回查询的名字，没有跟随CNAME；freeaddrinfo会free掉它
+        if (flags & AI_CANONNAME)
+        {
+            head->ai_canonname = strdup(node);
+        }
+        *res = head;
+        return 0;
+    }
+
     int fcntl(int fd, int cmd, ... /* arg */)
     {
         va_list va; // to access a list of mutable parameters
@@ -477,8 +1132,8 @@ extern "C"
             int arg = va_arg(va, int); // Access the next int argument
             va_end(va);
             std::shared_ptr<nsCoroutine::FdCtx> ctx = nsCoroutine::FdMgr::GetInstance()->get(fd);
-            //如果ctx无效，或者文件描述符关闭不是一个套接字就调用原始调用
-            if (!ctx || ctx->isClosed() || !ctx->isSocket())
+            //如果ctx无效，或者文件描述符关闭，或者不是hook设置了非阻塞的fd（套接字、管道等）就调用原始调用
+            if (!ctx || ctx->isClosed() || !ctx->isPollable())
             {
                 return fcntl_f(fd, cmd, arg);
             }
@@ -502,8 +1157,8 @@ extern "C"
             va_end(va);
             int arg = fcntl_f(fd, cmd);//调用原始的 fcntl 函数获取文件描述符的当前状态标志。
             std::shared_ptr<nsCoroutine::FdCtx> ctx = nsCoroutine::FdMgr::GetInstance()->get(fd);
-            //如果上下文无效、文件描述符已关闭或不是套接字，则直接返回状态标志。
-            if (!ctx || ctx->isClosed() || !ctx->isSocket())
+            //如果上下文无效、文件描述符已关闭或不是可以epoll等待的fd，则直接返回状态标志。
+            if (!ctx || ctx->isClosed() || !ctx->isPollable())
             {
                 return arg;
             }
@@ -588,8 +1243,8 @@ extern "C"
         {
             bool user_nonblock = !!*(int *)arg;//当前 ioctl 调用是为了设置或清除非阻塞模式。
             std::shared_ptr<nsCoroutine::FdCtx> ctx = nsCoroutine::FdMgr::GetInstance()->get(fd);
-            //检查获取的上下文对象是否有效（即 ctx 是否为空）。如果上下文对象无效、文件描述符已关闭或不是一个套接字，则直接调用原始的 ioctl 函数，返回处理结果。
-            if (!ctx || ctx->isClosed() || !ctx->isSocket())
+            //检查获取的上下文对象是否有效（即 ctx 是否为空）。如果上下文对象无效、文件描述符已关闭或不是可以epoll等待的fd，则直接调用原始的 ioctl 函数，返回处理结果。
+            if (!ctx || ctx->isClosed() || !ctx->isPollable())
             {
                 return ioctl_f(fd, request, arg);
             }
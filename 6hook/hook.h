@@ -7,6 +7,12 @@
 #include <sys/uio.h>
 #include <sys/ioctl.h>
 #include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/select.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <netdb.h>
 #include "fdManager.h"
 
 namespace nsCoroutine
@@ -15,6 +21,8 @@ namespace nsCoroutine
     bool is_hook_enable();
     // 设置钩子功能的启用和禁用状态
     void set_hook_enable(bool flag);
+    // 用dlsym取得所有原始函数，只执行一次（静态初始化时自动调用）
+    void hook_init();
 }
 
 // 确保正确调用库中的系统调用（C语言编写），C++编译器不会对这些函数名进行修饰
@@ -89,6 +97,69 @@ extern "C"
     typedef int (*setsockopt_fun)(int sockfd, int level, int optname, const void *optval, socklen_t optlen);
     extern setsockopt_fun setsockopt_f;
 
+    typedef ssize_t (*pread_fun)(int fd, void *buf, size_t count, off_t offset);
+    extern pread_fun pread_f;
+
+    typedef ssize_t (*pwrite_fun)(int fd, const void *buf, size_t count, off_t offset);
+    extern pwrite_fun pwrite_f;
+
+    typedef ssize_t (*preadv_fun)(int fd, const struct iovec *iov, int iovcnt, off_t offset);
+    extern preadv_fun preadv_f;
+
+    typedef ssize_t (*pwritev_fun)(int fd, const struct iovec *iov, int iovcnt, off_t offset);
+    extern pwritev_fun pwritev_f;
+
+    typedef int (*fsync_fun)(int fd);
+    extern fsync_fun fsync_f;
+
+    typedef int (*fdatasync_fun)(int fd);
+    extern fdatasync_fun fdatasync_f;
+
+    typedef int (*open_fun)(const char *pathname, int flags, ...);
+    extern open_fun open_f;
+
+    typedef int (*openat_fun)(int dirfd, const char *pathname, int flags, ...);
+    extern openat_fun openat_f;
+
+    typedef int (*poll_fun)(struct pollfd *fds, nfds_t nfds, int timeout);
+    extern poll_fun poll_f;
+
+    typedef int (*ppoll_fun)(struct pollfd *fds, nfds_t nfds, const struct timespec *tmo_p, const sigset_t *sigmask);
+    extern ppoll_fun ppoll_f;
+
+    typedef int (*select_fun)(int nfds, fd_set *readfds, fd_set *writefds, fd_set *exceptfds, struct timeval *timeout);
+    extern select_fun select_f;
+
+    typedef int (*epoll_wait_fun)(int epfd, struct epoll_event *events, int maxevents, int timeout);
+    extern epoll_wait_fun epoll_wait_f;
+
+    typedef int (*accept4_fun)(int sockfd, struct sockaddr *addr, socklen_t *addrlen, int flags);
+    extern accept4_fun accept4_f;
+
+    typedef int (*socketpair_fun)(int domain, int type, int protocol, int sv[2]);
+    extern socketpair_fun socketpair_f;
+
+    typedef int (*pipe_fun)(int pipefd[2]);
+    extern pipe_fun pipe_f;
+
+    typedef int (*pipe2_fun)(int pipefd[2], int flags);
+    extern pipe2_fun pipe2_f;
+
+    typedef int (*eventfd_fun)(unsigned int initval, int flags);
+    extern eventfd_fun eventfd_f;
+
+    typedef int (*dup_fun)(int oldfd);
+    extern dup_fun dup_f;
+
+    typedef int (*dup2_fun)(int oldfd, int newfd);
+    extern dup2_fun dup2_f;
+
+    typedef int (*dup3_fun)(int oldfd, int newfd, int flags);
+    extern dup3_fun dup3_f;
+
+    typedef int (*getaddrinfo_fun)(const char *node, const char *service, const struct addrinfo *hints, struct addrinfo **res);
+    extern getaddrinfo_fun getaddrinfo_f;
+
     // 函数原型 -> 对应.h中已经存在 可以省略
     
     // sleep function
@@ -100,6 +171,16 @@ extern "C"
     int socket(int domain, int type, int protocol);
     int connect(int sockfd, const struct sockaddr *addr, socklen_t addrlen);
     int accept(int sockfd, struct sockaddr *addr, socklen_t *addrlen);
+    int accept4(int sockfd, struct sockaddr *addr, socklen_t *addrlen, int flags);
+    int socketpair(int domain, int type, int protocol, int sv[2]);
+
+    // 创建fd的其他入口：新fd登记到FdManager，管道和eventfd和套接字一样走异步路径
+    int pipe(int pipefd[2]);
+    int pipe2(int pipefd[2], int flags);
+    int eventfd(unsigned int initval, int flags);
+    int dup(int oldfd);
+    int dup2(int oldfd, int newfd);
+    int dup3(int oldfd, int newfd, int flags);
 
     // read
     ssize_t read(int fd, void *buf, size_t count);
@@ -126,4 +207,25 @@ extern "C"
 
     int getsockopt(int sockfd, int level, int optname, void *optval, socklen_t *optlen);
     int setsockopt(int sockfd, int level, int optname, const void *optval, socklen_t optlen);
+
+    // file，磁盘I/O交给卸载池（见offload.h）执行
+    // open/openat打开的fd会登记到FdManager，之后的read/write同样经过卸载池
+    ssize_t pread(int fd, void *buf, size_t count, off_t offset);
+    ssize_t pwrite(int fd, const void *buf, size_t count, off_t offset);
+    ssize_t preadv(int fd, const struct iovec *iov, int iovcnt, off_t offset);
+    ssize_t pwritev(int fd, const struct iovec *iov, int iovcnt, off_t offset);
+    int fsync(int fd);
+    int fdatasync(int fd);
+    int open(const char *pathname, int flags, ...);
+    int openat(int dirfd, const char *pathname, int flags, ...);
+
+    // poll，第三方库（数据库驱动等）等待自己的socket时只挂起当前协程
+    // fd登记到IOManager，超时用定时器；IOManager::idle使用原始的epoll_wait_f
+    int poll(struct pollfd *fds, nfds_t nfds, int timeout);
+    int ppoll(struct pollfd *fds, nfds_t nfds, const struct timespec *tmo_p, const sigset_t *sigmask);
+    int select(int nfds, fd_set *readfds, fd_set *writefds, fd_set *exceptfds, struct timeval *timeout);
+    int epoll_wait(int epfd, struct epoll_event *events, int maxevents, int timeout);
+
+    // 域名解析，任务协程里查询DNS时只挂起当前协程，结果按TTL缓存（见resolver.h）
+    int getaddrinfo(const char *node, const char *service, const struct addrinfo *hints, struct addrinfo **res);
 }
\ No newline at end of file
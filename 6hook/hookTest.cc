@@ -0,0 +1,1423 @@
+// hook的功能测试
+// 编译：g++ -std=c++17 -g -I. hookTest.cc $(ls *.cc | grep -v -i test.cc) -o hookTest -ldl -pthread
+// 运行：./hookTest [用例名]，不带参数时运行全部用例，全部通过时返回0
+#include "ioManager.h"
+#include "hook.h"
+#include "fdManager.h"
+#include "fiberSync.h"
+#include "select.h"
+#include "channel.h"
+#include "future.h"
+#include "taskGroup.h"
+#include "fiberLocal.h"
+#include "deadline.h"
+#include "pthreadHook.h"
+#include "resolver.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <chrono>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+
+static int s_failed = 0;
+
+#define CHECK(cond)                                                  \
+    do                                                               \
+    {                                                                \
+        if (!(cond))                                                 \
+        {                                                            \
+            printf("  FAILED %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+            ++s_failed;                                              \
+        }                                                            \
+    } while (0)
+
+// 在单线程IOManager的任务协程里运行f（hook已开启），等它结束
+static void run_in_fiber(const std::function<void()> &f)
+{
+    std::atomic<bool> done{false};
+    nsCoroutine::IOManager iom(1, false, "test");
+    iom.scheduleLock([&]()
+    {
+        f();
+        done = true;
+    });
+    while (!done)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+// 10ms后在另一个协程里向fd写一个字节，检验读端是否还由hook挂起等待
+static void write_later(int fd)
+{
+    nsCoroutine::IOManager::GetThis()->scheduleLock([fd]()
+    {
+        usleep(10000);
+        write(fd, "x", 1);
+    });
+}
+
+// 失败的dup2/dup3不能动newfd：它的FdCtx和等待者都要保留
+static void test_dup_failure()
+{
+    run_in_fiber([]()
+    {
+        int sv[2];
+        CHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+        CHECK(nsCoroutine::FdMgr::GetInstance()->get(sv[0]) != nullptr);
+
+        errno = 0;
+        CHECK(dup3(sv[0], sv[0], 0) == -1);
+        CHECK(errno == EINVAL);
+        CHECK(nsCoroutine::FdMgr::GetInstance()->get(sv[0]) != nullptr);
+
+        errno = 0;
+        CHECK(dup2(9999, sv[0]) == -1);
+        CHECK(errno == EBADF);
+        CHECK(nsCoroutine::FdMgr::GetInstance()->get(sv[0]) != nullptr);
+
+        errno = 0;
+        CHECK(dup3(9999, sv[0], 0) == -1);
+        CHECK(errno == EBADF);
+        CHECK(nsCoroutine::FdMgr::GetInstance()->get(sv[0]) != nullptr);
+
+        // 仍然按阻塞语义读：协程挂起直到数据到达，而不是返回EAGAIN
+        char c = 0;
+        write_later(sv[1]);
+        CHECK(read(sv[0], &c, 1) == 1);
+        CHECK(c == 'x');
+
+        close(sv[0]);
+        close(sv[1]);
+    });
+}
+
+// 成功的dup2：newfd换成oldfd的文件，沿用oldfd的设置
+static void test_dup_success()
+{
+    run_in_fiber([]()
+    {
+        int a[2], b[2];
+        CHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, a) == 0);
+        CHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, b) == 0);
+
+        CHECK(dup2(a[0], b[0]) == b[0]);
+        CHECK(nsCoroutine::FdMgr::GetInstance()->get(b[0]) != nullptr);
+        char c = 0;
+        write_later(a[1]);
+        CHECK(read(b[0], &c, 1) == 1);
+        CHECK(c == 'x');
+
+        CHECK(dup2(a[0], a[0]) == a[0]);
+        CHECK(nsCoroutine::FdMgr::GetInstance()->get(a[0]) != nullptr);
+
+        close(a[0]);
+        close(a[1]);
+        close(b[0]);
+        close(b[1]);
+    });
+}
+
+// dup2替换一个有协程在等、还被别的dup引用着的fd：替换之前就要把原来的文件从epoll里删掉，
+// 否则原来的文件上的事件会继续触发到newfd上；等待的协程被唤醒后改为等新的文件
+static void test_dup_replace_waited()
+{
+    run_in_fiber([]()
+    {
+        int sv[2], ov[2];
+        CHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+        CHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, ov) == 0);
+        int keep = dup(sv[0]);
+
+        std::atomic<bool> done{false};
+        ssize_t n = 0;
+        char c = 0;
+        nsCoroutine::IOManager::GetThis()->scheduleLock([&]()
+        {
+            n = read(sv[0], &c, 1);
+            done = true;
+        });
+        usleep(10000);
+        CHECK(dup2(ov[0], sv[0]) == sv[0]);
+        CHECK(nsCoroutine::FdMgr::GetInstance()->get(sv[0]) != nullptr);
+        // 写到原来的文件上，不能影响等在sv[0]上的协程
+        CHECK(write(sv[1], "x", 1) == 1);
+        usleep(10000);
+        CHECK(write(ov[1], "y", 1) == 1);
+        for (int i = 0; i < 500 && !done; ++i)
+        {
+            usleep(1000);
+        }
+        CHECK(done);
+        CHECK(n == 1 && c == 'y');
+
+        close(keep);
+        close(sv[0]);
+        close(sv[1]);
+        close(ov[0]);
+        close(ov[1]);
+    });
+}
+
+// 多个协程无限期poll同一个管道的读端：只有第一个能登记到epoll，其余在协程里轮询，
+// 不能占住卸载池的线程（默认4个），期间卸载到池里的文件读照常完成
+static void test_poll_shared_fd()
+{
+    run_in_fiber([]()
+    {
+        int p[2];
+        CHECK(pipe(p) == 0);
+        std::atomic<int> ready{0};
+        nsCoroutine::FiberWaitGroup wg;
+        for (int i = 0; i < 6; ++i)
+        {
+            wg.add(1);
+            nsCoroutine::IOManager::GetThis()->scheduleLock([&]()
+            {
+                struct pollfd pfd = {p[0], POLLIN, 0};
+                if (poll(&pfd, 1, -1) == 1 && (pfd.revents & POLLIN))
+                {
+                    ++ready;
+                }
+                wg.done();
+            });
+        }
+        usleep(20000);
+
+        int fd = open("/proc/self/stat", O_RDONLY);
+        CHECK(fd >= 0);
+        char buf[64];
+        auto start = std::chrono::steady_clock::now();
+        CHECK(pread(fd, buf, sizeof(buf), 0) > 0);
+        auto cost = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+        CHECK(cost < 100);
+        close(fd);
+
+        write(p[1], "x", 1);
+        wg.wait();
+        CHECK(ready == 6);
+        close(p[0]);
+        close(p[1]);
+    });
+}
+
+// Select的fd分支：已经就绪的fd不挂起直接选中（普通文件总是就绪），注册失败时errno是真实的原因
+static void test_select_fd()
+{
+    run_in_fiber([]()
+    {
+        int p[2];
+        CHECK(pipe(p) == 0);
+        CHECK(write(p[1], "x", 1) == 1);
+        {
+            nsCoroutine::Select sel;
+            int idx = sel.readable(p[0]);
+            CHECK(sel.poll() == idx);
+        }
+
+        int file = open("/proc/self/stat", O_RDONLY);
+        CHECK(file >= 0);
+        {
+            nsCoroutine::Select sel;
+            int idx = sel.readable(file);
+            sel.timeout(1000);
+            CHECK(sel.wait() == idx);
+        }
+        close(file);
+
+        // 已经关闭的fd：poll报告POLLNVAL，不算就绪，epoll_ctl的EBADF原样返回
+        int bad = dup(p[0]);
+        close(bad);
+        {
+            nsCoroutine::Select sel;
+            sel.readable(bad);
+            errno = 0;
+            CHECK(sel.wait() == -1);
+            CHECK(errno == EBADF);
+        }
+
+        // 同一个fd的读事件已经有协程在等：EEXIST
+        char c;
+        CHECK(read(p[0], &c, 1) == 1);
+        std::atomic<bool> done{false};
+        nsCoroutine::IOManager::GetThis()->scheduleLock([&]()
+        {
+            char c2;
+            read(p[0], &c2, 1);
+            done = true;
+        });
+        usleep(10000);
+        {
+            nsCoroutine::Select sel;
+            sel.readable(p[0]);
+            errno = 0;
+            CHECK(sel.wait() == -1);
+            CHECK(errno == EEXIST);
+        }
+        write(p[1], "x", 1);
+        while (!done)
+        {
+            usleep(1000);
+        }
+        close(p[0]);
+        close(p[1]);
+    });
+}
+
+// 协程在pthread_cond_wait里被外层的唤醒（这里是一个先创建的FiberWaiter）提前恢复：
+// cond_wait按虚假唤醒返回，欠外层的那次恢复要补上，等待者也不能留在条件变量的队列里被之后的signal取到
+static void test_pthread_cond_early_resume()
+{
+    nsCoroutine::set_pthread_hook_enable(true);
+    run_in_fiber([]()
+    {
+        pthread_mutex_t mtx = PTHREAD_MUTEX_INITIALIZER;
+        pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
+        nsCoroutine::IOManager *iom = nsCoroutine::IOManager::GetThis();
+
+        auto outer = std::make_shared<nsCoroutine::FiberWaiter>();
+        iom->scheduleLock([outer]()
+        {
+            usleep(5000);
+            outer->wake();
+        });
+        pthread_mutex_lock(&mtx);
+        CHECK(pthread_cond_wait(&cond, &mtx) == 0);
+        pthread_mutex_unlock(&mtx);
+        // 外层的恢复已经被提前消耗，cond_wait补上之后这里马上返回
+        CHECK(outer->wait() == nsCoroutine::FiberWaiter::NOTIFIED);
+
+        // 之后的signal不能恢复正在usleep的协程
+        iom->scheduleLock([&]()
+        {
+            usleep(5000);
+            pthread_mutex_lock(&mtx);
+            pthread_cond_signal(&cond);
+            pthread_mutex_unlock(&mtx);
+        });
+        auto start = std::chrono::steady_clock::now();
+        usleep(30000);
+        auto cost = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+        CHECK(cost >= 29);
+    });
+    nsCoroutine::set_pthread_hook_enable(false);
+}
+
+static long elapsed_ms(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+// 普通文件的open/pwrite/pread/fsync交给卸载池，结果和原始调用一致
+static void test_file_io()
+{
+    run_in_fiber([]()
+    {
+        char path[] = "/tmp/hookTestXXXXXX";
+        int tmp = mkstemp(path);
+        CHECK(tmp >= 0);
+        close(tmp);
+
+        int fd = open(path, O_RDWR | O_TRUNC);
+        CHECK(fd >= 0);
+        CHECK(pwrite(fd, "hello fiber", 11, 0) == 11);
+        CHECK(fsync(fd) == 0);
+        char buf[16] = {0};
+        CHECK(pread(fd, buf, 5, 6) == 5);
+        CHECK(strcmp(buf, "fiber") == 0);
+        close(fd);
+
+        errno = 0;
+        CHECK(open("/nonexistent/hookTest", O_RDONLY) == -1);
+        CHECK(errno == ENOENT);
+        unlink(path);
+    });
+}
+
+// poll管道：超时返回0，数据到达前协程挂起，到达后返回1且revents带POLLIN
+static void test_poll_pipe()
+{
+    run_in_fiber([]()
+    {
+        int p[2];
+        CHECK(pipe(p) == 0);
+        struct pollfd pfd = {p[0], POLLIN, 0};
+
+        auto start = std::chrono::steady_clock::now();
+        CHECK(poll(&pfd, 1, 30) == 0);
+        CHECK(elapsed_ms(start) >= 29);
+
+        start = std::chrono::steady_clock::now();
+        write_later(p[1]);
+        CHECK(poll(&pfd, 1, 1000) == 1);
+        CHECK(pfd.revents & POLLIN);
+        CHECK(elapsed_ms(start) < 500);
+
+        // 已经就绪时不挂起
+        CHECK(poll(&pfd, 1, -1) == 1);
+        close(p[0]);
+        close(p[1]);
+    });
+}
+
+// select(2)：epoll不支持的普通文件总是就绪，和空管道一起等待时只有文件被置位；只有空管道时超时返回0
+static void test_select_unpollable()
+{
+    run_in_fiber([]()
+    {
+        int p[2];
+        CHECK(pipe(p) == 0);
+        int file = open("/proc/self/stat", O_RDONLY);
+        CHECK(file >= 0);
+
+        fd_set rfds;
+        FD_ZERO(&rfds);
+        FD_SET(p[0], &rfds);
+        FD_SET(file, &rfds);
+        struct timeval tv = {1, 0};
+        auto start = std::chrono::steady_clock::now();
+        CHECK(select(std::max(p[0], file) + 1, &rfds, nullptr, nullptr, &tv) == 1);
+        CHECK(FD_ISSET(file, &rfds));
+        CHECK(!FD_ISSET(p[0], &rfds));
+        CHECK(elapsed_ms(start) < 500);
+
+        FD_ZERO(&rfds);
+        FD_SET(p[0], &rfds);
+        tv = {0, 30000};
+        start = std::chrono::steady_clock::now();
+        CHECK(select(p[0] + 1, &rfds, nullptr, nullptr, &tv) == 0);
+        CHECK(elapsed_ms(start) >= 29);
+
+        close(file);
+        close(p[0]);
+        close(p[1]);
+    });
+}
+
+// 测试用的DNS服务器：名字以"nx"开头回NXDOMAIN，其余回一条A记录10.0.0.1
+static void dns_stub(int fd, std::atomic<bool> &stop)
+{
+    struct timeval tv = {0, 10000};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    unsigned char buf[512];
+    while (!stop)
+    {
+        struct sockaddr_in from;
+        socklen_t len = sizeof(from);
+        ssize_t n = recvfrom(fd, buf, sizeof(buf), 0, (struct sockaddr *)&from, &len);
+        if (n <= 13)
+        {
+            continue;
+        }
+        std::string reply((char *)buf, n);
+        bool nx = buf[13] == 'n' && buf[14] == 'x';
+        reply[2] = (char)0x81;
+        reply[3] = (char)(nx ? 0x83 : 0x80);
+        if (!nx)
+        {
+            reply[7] = 1;
+            const unsigned char answer[] = {0xc0, 0x0c, 0, 1, 0, 1, 0, 0, 0x01, 0x2c, 0, 4, 10, 0, 0, 1};
+            reply.append((const char *)answer, sizeof(answer));
+        }
+        sendto(fd, reply.data(), reply.size(), 0, (struct sockaddr *)&from, len);
+    }
+}
+
+// 解析器：hosts文件命中不发查询；DNS结果和NXDOMAIN都被缓存，第二次解析不再发查询
+static void test_resolver()
+{
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(addr);
+    bind(fd, (struct sockaddr *)&addr, len);
+    getsockname(fd, (struct sockaddr *)&addr, &len);
+    std::atomic<bool> stop{false};
+    std::thread stub(dns_stub, fd, std::ref(stop));
+
+    char hosts[] = "/tmp/hookTestHostsXXXXXX";
+    int hfd = mkstemp(hosts);
+    const char *content = "10.1.2.3 myhost.test\n";
+    CHECK(write(hfd, content, strlen(content)) == (ssize_t)strlen(content));
+    close(hfd);
+
+    nsCoroutine::Resolver *resolver = nsCoroutine::Resolver::GetInstance();
+    resolver->setNameservers({"127.0.0.1:" + std::to_string(ntohs(addr.sin_port))});
+    resolver->setHostsFile(hosts);
+    resolver->setTimeout(1000);
+    resolver->clearCache();
+
+    run_in_fiber([resolver]()
+    {
+        uint64_t queries = resolver->getQueries();
+        std::vector<std::string> addrs;
+        CHECK(resolver->lookup("myhost.test", AF_INET, addrs) == 0);
+        CHECK(addrs.size() == 1 && addrs[0] == "10.1.2.3");
+        CHECK(resolver->getQueries() == queries);
+
+        addrs.clear();
+        CHECK(resolver->lookup("www.example.test", AF_INET, addrs) == 0);
+        CHECK(addrs.size() == 1 && addrs[0] == "10.0.0.1");
+        CHECK(resolver->getQueries() == queries + 1);
+        addrs.clear();
+        uint64_t hits = resolver->getCacheHits();
+        CHECK(resolver->lookup("www.example.test", AF_INET, addrs) == 0);
+        CHECK(addrs.size() == 1 && addrs[0] == "10.0.0.1");
+        CHECK(resolver->getQueries() == queries + 1);
+        CHECK(resolver->getCacheHits() == hits + 1);
+
+        addrs.clear();
+        CHECK(resolver->lookup("nxdomain.test", AF_INET, addrs) == EAI_NONAME);
+        CHECK(addrs.empty());
+        CHECK(resolver->getQueries() == queries + 2);
+        CHECK(resolver->lookup("nxdomain.test", AF_INET, addrs) == EAI_NONAME);
+        CHECK(resolver->getQueries() == queries + 2);
+
+        // hook的getaddrinfo走同一个解析器
+        struct addrinfo hints = {};
+        hints.ai_family = AF_INET;
+        hints.ai_socktype = SOCK_STREAM;
+        struct addrinfo *res = nullptr;
+        CHECK(getaddrinfo("myhost.test", "80", &hints, &res) == 0);
+        if (res)
+        {
+            CHECK(((struct sockaddr_in *)res->ai_addr)->sin_addr.s_addr == inet_addr("10.1.2.3"));
+            CHECK(ntohs(((struct sockaddr_in *)res->ai_addr)->sin_port) == 80);
+            freeaddrinfo(res);
+        }
+        CHECK(getaddrinfo("nxdomain.test", "80", &hints, &res) == EAI_NONAME);
+    });
+
+    resolver->setHostsFile("/etc/hosts");
+    resolver->clearCache();
+    unlink(hosts);
+    stop = true;
+    stub.join();
+    close(fd);
+}
+
+// pthread_cond_timedwait：到时返回ETIMEDOUT且重新持有互斥锁，signal能在超时前唤醒它
+static void test_pthread_cond_timedwait()
+{
+    nsCoroutine::set_pthread_hook_enable(true);
+    run_in_fiber([]()
+    {
+        pthread_mutex_t mtx = PTHREAD_MUTEX_INITIALIZER;
+        pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
+        struct timespec abstime;
+
+        pthread_mutex_lock(&mtx);
+        clock_gettime(CLOCK_REALTIME, &abstime);
+        abstime.tv_nsec += 30 * 1000000;
+        if (abstime.tv_nsec >= 1000000000)
+        {
+            abstime.tv_sec += 1;
+            abstime.tv_nsec -= 1000000000;
+        }
+        auto start = std::chrono::steady_clock::now();
+        CHECK(pthread_cond_timedwait(&cond, &mtx, &abstime) == ETIMEDOUT);
+        CHECK(elapsed_ms(start) >= 29);
+        CHECK(pthread_mutex_trylock(&mtx) == EBUSY);
+
+        // 已经过去的时间点立即返回
+        CHECK(pthread_cond_timedwait(&cond, &mtx, &abstime) == ETIMEDOUT);
+
+        bool flag = false;
+        nsCoroutine::IOManager::GetThis()->scheduleLock([&]()
+        {
+            usleep(5000);
+            pthread_mutex_lock(&mtx);
+            flag = true;
+            pthread_cond_signal(&cond);
+            pthread_mutex_unlock(&mtx);
+        });
+        clock_gettime(CLOCK_REALTIME, &abstime);
+        abstime.tv_sec += 2;
+        start = std::chrono::steady_clock::now();
+        int rt = 0;
+        while (!flag && rt == 0)
+        {
+            rt = pthread_cond_timedwait(&cond, &mtx, &abstime);
+        }
+        CHECK(rt == 0 && flag);
+        CHECK(elapsed_ms(start) < 1000);
+        pthread_mutex_unlock(&mtx);
+    });
+    nsCoroutine::set_pthread_hook_enable(false);
+}
+
+// 共享栈协程在多个工作线程之间换栈：每次恢复后栈上的局部变量都要原样还在
+static void test_shared_stack()
+{
+    const int fibers = 200;
+    std::atomic<int> done{0};
+    std::atomic<int> corrupted{0};
+    {
+        nsCoroutine::IOManager iom(4, false, "test");
+        iom.setSharedStack(true);
+        for (int i = 0; i < fibers; ++i)
+        {
+            iom.scheduleLock([i, &done, &corrupted]()
+            {
+                char buf[4096];
+                memset(buf, i, sizeof(buf));
+                for (int round = 0; round < 20; ++round)
+                {
+                    usleep(1000);
+                    for (char c : buf)
+                    {
+                        if (c != (char)i)
+                        {
+                            corrupted++;
+                            break;
+                        }
+                    }
+                }
+                done++;
+            });
+        }
+        while (done < fibers)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+    CHECK(corrupted == 0);
+}
+
+// FiberCondVar的限时等待：超时返回ETIMEDOUT并重新持有锁，notify在超时前唤醒；带谓词的重载
+static void test_condvar()
+{
+    run_in_fiber([]()
+    {
+        nsCoroutine::IOManager *iom = nsCoroutine::IOManager::GetThis();
+        nsCoroutine::FiberMutex mtx;
+        nsCoroutine::FiberCondVar cv;
+        int value = 0;
+
+        std::unique_lock<nsCoroutine::FiberMutex> lock(mtx);
+        auto start = std::chrono::steady_clock::now();
+        errno = 0;
+        CHECK(!cv.waitFor(lock, 30));
+        CHECK(errno == ETIMEDOUT);
+        CHECK(elapsed_ms(start) >= 29);
+        CHECK(lock.owns_lock() && !mtx.try_lock());
+
+        iom->scheduleLock([&]()
+        {
+            usleep(10000);
+            std::lock_guard<nsCoroutine::FiberMutex> guard(mtx);
+            value = 1;
+            cv.notify_one();
+        });
+        start = std::chrono::steady_clock::now();
+        CHECK(cv.waitFor(lock, 1000));
+        CHECK(value == 1);
+        CHECK(elapsed_ms(start) < 500);
+
+        // 谓词一直不成立：等满时间后返回false
+        start = std::chrono::steady_clock::now();
+        CHECK(!cv.waitFor(lock, 30, [&]() { return value == 2; }));
+        CHECK(elapsed_ms(start) >= 29);
+
+        // 中途的notify不满足谓词，继续等到谓词成立
+        iom->scheduleLock([&]()
+        {
+            for (int i = 2; i <= 4; ++i)
+            {
+                usleep(5000);
+                std::lock_guard<nsCoroutine::FiberMutex> guard(mtx);
+                value = i;
+                cv.notify_all();
+            }
+        });
+        CHECK(cv.waitFor(lock, 1000, [&]() { return value == 3; }));
+        CHECK(value == 3);
+        CHECK(cv.wait(lock, [&]() { return value == 4; }));
+        CHECK(value == 4);
+    });
+}
+
+// FiberSemaphore的限时等待：超时返回ETIMEDOUT，signal在超时前唤醒；超时的等待者不能吞掉之后的许可
+static void test_semaphore()
+{
+    run_in_fiber([]()
+    {
+        nsCoroutine::FiberSemaphore sem(0);
+
+        auto start = std::chrono::steady_clock::now();
+        errno = 0;
+        CHECK(!sem.waitFor(30));
+        CHECK(errno == ETIMEDOUT);
+        CHECK(elapsed_ms(start) >= 29);
+
+        sem.signal();
+        CHECK(sem.tryWait());
+        CHECK(!sem.tryWait());
+
+        nsCoroutine::IOManager::GetThis()->scheduleLock([&]()
+        {
+            usleep(10000);
+            sem.signal(2);
+        });
+        start = std::chrono::steady_clock::now();
+        CHECK(sem.waitFor(1000));
+        CHECK(elapsed_ms(start) < 500);
+        // 一个许可交给了等待者，另一个留在计数里
+        CHECK(sem.waitFor(0));
+        CHECK(!sem.tryWait());
+    });
+}
+
+// Channel关闭后send失败、recv取完剩余消息再返回EPIPE，挂起的收发双方都被唤醒
+static void test_channel_close()
+{
+    run_in_fiber([]()
+    {
+        nsCoroutine::IOManager *iom = nsCoroutine::IOManager::GetThis();
+        nsCoroutine::Channel<int> ch(4);
+        CHECK(ch.send(1));
+        CHECK(ch.send(2));
+        ch.close();
+        CHECK(ch.isClosed());
+        errno = 0;
+        CHECK(!ch.send(3));
+        CHECK(errno == EPIPE);
+        int v = 0;
+        CHECK(ch.recv(v) && v == 1);
+        CHECK(ch.recv(v) && v == 2);
+        errno = 0;
+        CHECK(!ch.recv(v));
+        CHECK(errno == EPIPE);
+
+        // 空通道上挂起的接收者
+        nsCoroutine::Channel<int> empty(2);
+        nsCoroutine::FiberWaitGroup wg;
+        std::atomic<int> woken{0};
+        wg.add();
+        iom->scheduleLock([&]()
+        {
+            int x;
+            if (!empty.recv(x) && errno == EPIPE)
+            {
+                woken++;
+            }
+            wg.done();
+        });
+        // 满通道上挂起的发送者
+        nsCoroutine::Channel<int> full(2);
+        CHECK(full.send(1) && full.send(2));
+        wg.add();
+        iom->scheduleLock([&]()
+        {
+            if (!full.send(3) && errno == EPIPE)
+            {
+                woken++;
+            }
+            wg.done();
+        });
+        usleep(10000);
+        CHECK(woken == 0);
+        empty.close();
+        full.close();
+        CHECK(wg.wait());
+        CHECK(woken == 2);
+        CHECK(full.recv(v) && v == 1);
+        CHECK(full.recv(v) && v == 2);
+        CHECK(!full.recv(v));
+    });
+}
+
+// sendFor/recvFor超时返回ETIMEDOUT，对端在超时前腾出位置/送来消息时成功
+static void test_channel_timeout()
+{
+    run_in_fiber([]()
+    {
+        nsCoroutine::IOManager *iom = nsCoroutine::IOManager::GetThis();
+        nsCoroutine::Channel<int> ch(2);
+        int v = 0;
+
+        auto start = std::chrono::steady_clock::now();
+        errno = 0;
+        CHECK(!ch.recvFor(v, 30));
+        CHECK(errno == ETIMEDOUT);
+        CHECK(elapsed_ms(start) >= 29);
+
+        CHECK(ch.send(1) && ch.send(2));
+        start = std::chrono::steady_clock::now();
+        errno = 0;
+        CHECK(!ch.sendFor(3, 30));
+        CHECK(errno == ETIMEDOUT);
+        CHECK(elapsed_ms(start) >= 29);
+        CHECK(ch.size() == 2);
+
+        iom->scheduleLock([&]()
+        {
+            usleep(10000);
+            int x;
+            ch.recv(x);
+        });
+        start = std::chrono::steady_clock::now();
+        CHECK(ch.sendFor(3, 1000));
+        CHECK(elapsed_ms(start) < 500);
+        CHECK(ch.recv(v) && v == 2);
+        CHECK(ch.recv(v) && v == 3);
+
+        iom->scheduleLock([&]()
+        {
+            usleep(10000);
+            ch.send(4);
+        });
+        start = std::chrono::steady_clock::now();
+        CHECK(ch.recvFor(v, 1000) && v == 4);
+        CHECK(elapsed_ms(start) < 500);
+    });
+}
+
+// 无界通道：超过环形队列的消息进溢出队列，send不挂起；接收时按发送顺序取完，关闭后再返回EPIPE
+static void test_channel_unbounded()
+{
+    run_in_fiber([]()
+    {
+        typedef nsCoroutine::Channel<int> IntChannel;
+        IntChannel ch(IntChannel::UNBOUNDED);
+        const int first = (int)IntChannel::UNBOUNDED_RING_SIZE * 3;
+        for (int i = 0; i < first; ++i)
+        {
+            CHECK(ch.trySend(i));
+        }
+        CHECK(ch.size() == (size_t)first);
+
+        int v = 0;
+        int next = 0;
+        for (int i = 0; i < first / 2; ++i)
+        {
+            CHECK(ch.recv(v) && v == next);
+            ++next;
+        }
+        // 溢出队列还没取空时新消息排在后面
+        const int total = first + (int)IntChannel::UNBOUNDED_RING_SIZE;
+        for (int i = first; i < total; ++i)
+        {
+            CHECK(ch.send(i));
+        }
+        ch.close();
+        while (ch.recv(v))
+        {
+            if (v != next)
+            {
+                break;
+            }
+            ++next;
+        }
+        CHECK(next == total);
+        CHECK(errno == EPIPE);
+        CHECK(ch.size() == 0);
+    });
+}
+
+// Future::get()挂起等到结果就绪；spawn的异常由get()重新抛出；Promise没设置结果就析构时得到broken_promise；waitFor超时
+static void test_future()
+{
+    run_in_fiber([]()
+    {
+        // 调度的任务要能拷贝，Promise只能移动，放进shared_ptr
+        auto promise = std::make_shared<nsCoroutine::Promise<int>>();
+        nsCoroutine::Future<int> future = promise->getFuture();
+        nsCoroutine::IOManager::GetThis()->scheduleLock([promise]()
+        {
+            usleep(10000);
+            promise->setValue(42);
+        });
+        CHECK(!future.ready());
+        auto start = std::chrono::steady_clock::now();
+        CHECK(future.get() == 42);
+        CHECK(elapsed_ms(start) >= 9);
+        CHECK(!future.valid());
+
+        nsCoroutine::Future<int> failing = nsCoroutine::spawn([]() -> int
+        {
+            usleep(1000);
+            throw std::runtime_error("boom");
+        });
+        bool thrown = false;
+        try
+        {
+            failing.get();
+        }
+        catch (const std::runtime_error &e)
+        {
+            thrown = strcmp(e.what(), "boom") == 0;
+        }
+        CHECK(thrown);
+
+        nsCoroutine::Future<void> broken;
+        {
+            nsCoroutine::Promise<void> p;
+            broken = p.getFuture();
+        }
+        thrown = false;
+        try
+        {
+            broken.get();
+        }
+        catch (const std::future_error &e)
+        {
+            thrown = e.code() == std::future_errc::broken_promise;
+        }
+        CHECK(thrown);
+
+        nsCoroutine::Promise<int> late;
+        nsCoroutine::Future<int> timed = late.getFuture();
+        start = std::chrono::steady_clock::now();
+        errno = 0;
+        CHECK(!timed.waitFor(30));
+        CHECK(errno == ETIMEDOUT);
+        CHECK(elapsed_ms(start) >= 29);
+        CHECK(timed.valid());
+        late.setValue(7);
+        CHECK(timed.waitFor(30));
+        CHECK(timed.get() == 7);
+    });
+}
+
+// when_all按输入顺序给出结果和第一个异常，when_any给出最先完成的下标
+static void test_future_combine()
+{
+    run_in_fiber([]()
+    {
+        auto delayed = [](int ms, int value)
+        {
+            return nsCoroutine::spawn([ms, value]()
+            {
+                usleep(ms * 1000);
+                return value;
+            });
+        };
+
+        std::vector<nsCoroutine::Future<int>> all;
+        all.push_back(delayed(30, 1));
+        all.push_back(delayed(10, 2));
+        all.push_back(delayed(20, 3));
+        CHECK(nsCoroutine::when_all(std::move(all)).get() == std::vector<int>({1, 2, 3}));
+
+        // 后完成的a在输入里排在前面，得到的是a的异常
+        std::vector<nsCoroutine::Future<int>> failing;
+        failing.push_back(nsCoroutine::spawn([]() -> int
+        {
+            usleep(20000);
+            throw std::runtime_error("a");
+        }));
+        failing.push_back(nsCoroutine::spawn([]() -> int
+        {
+            usleep(5000);
+            throw std::runtime_error("b");
+        }));
+        failing.push_back(delayed(1, 3));
+        std::string what;
+        try
+        {
+            nsCoroutine::when_all(std::move(failing)).get();
+        }
+        catch (const std::runtime_error &e)
+        {
+            what = e.what();
+        }
+        CHECK(what == "a");
+
+        std::vector<nsCoroutine::Future<int>> any;
+        any.push_back(delayed(30, 1));
+        any.push_back(delayed(5, 2));
+        any.push_back(delayed(20, 3));
+        size_t first = nsCoroutine::when_any(any).get();
+        CHECK(first == 1);
+        CHECK(any[first].get() == 2);
+        CHECK(!any[0].ready());
+        CHECK(any[0].get() == 1);
+        CHECK(any[2].get() == 3);
+    });
+}
+
+// TaskGroup::cancel()立即唤醒阻塞在read、sleep/usleep、FiberSemaphore、Channel、Future上的子任务，返回ECANCELED
+static void test_taskgroup_cancel()
+{
+    run_in_fiber([]()
+    {
+        int p[2];
+        CHECK(pipe(p) == 0);
+        nsCoroutine::FiberSemaphore sem(0);
+        nsCoroutine::Channel<int> ch(2);
+        nsCoroutine::Promise<int> never;
+        nsCoroutine::Future<int> pending = never.getFuture();
+        std::atomic<int> cancelled{0};
+
+        nsCoroutine::TaskGroup group;
+        group.spawn([&]()
+        {
+            char c;
+            if (read(p[0], &c, 1) == -1 && errno == ECANCELED)
+            {
+                cancelled++;
+            }
+        });
+        group.spawn([&]()
+        {
+            if (sleep(10) != 0)
+            {
+                cancelled++;
+            }
+        });
+        group.spawn([&]()
+        {
+            if (usleep(10000000) == -1 && errno == ECANCELED)
+            {
+                cancelled++;
+            }
+        });
+        group.spawn([&]()
+        {
+            if (!sem.wait() && errno == ECANCELED)
+            {
+                cancelled++;
+            }
+        });
+        group.spawn([&]()
+        {
+            int v;
+            if (!ch.recv(v) && errno == ECANCELED)
+            {
+                cancelled++;
+            }
+        });
+        group.spawn([&]()
+        {
+            try
+            {
+                pending.get();
+            }
+            catch (const std::system_error &e)
+            {
+                if (e.code().value() == ECANCELED)
+                {
+                    cancelled++;
+                }
+            }
+        });
+        usleep(10000);
+        CHECK(cancelled == 0);
+        CHECK(!group.cancelled());
+        auto start = std::chrono::steady_clock::now();
+        group.cancel();
+        group.wait();
+        CHECK(elapsed_ms(start) < 500);
+        CHECK(group.cancelled());
+        CHECK(cancelled == 6);
+        // 被取消的get()不取走结果，Future仍然有效
+        CHECK(pending.valid());
+        close(p[0]);
+        close(p[1]);
+    });
+}
+
+// 子任务抛出异常时其余子任务被取消，wait()重新抛出第一个异常
+static void test_taskgroup_error()
+{
+    run_in_fiber([]()
+    {
+        std::atomic<int> cancelled{0};
+        nsCoroutine::TaskGroup group;
+        group.spawn([]()
+        {
+            usleep(10000);
+            throw std::runtime_error("first");
+        });
+        group.spawn([&]()
+        {
+            if (usleep(10000000) == -1 && errno == ECANCELED)
+            {
+                cancelled++;
+            }
+            // 被取消之后抛出的异常排在第一个异常之后
+            throw std::runtime_error("second");
+        });
+        nsCoroutine::Future<int> sibling = group.spawn([&]()
+        {
+            CHECK(usleep(10000000) == -1);
+            if (errno == ECANCELED && nsCoroutine::TaskGroup::IsCancelled())
+            {
+                cancelled++;
+            }
+            return 1;
+        });
+        auto start = std::chrono::steady_clock::now();
+        std::string what;
+        try
+        {
+            group.wait();
+        }
+        catch (const std::runtime_error &e)
+        {
+            what = e.what();
+        }
+        CHECK(what == "first");
+        CHECK(elapsed_ms(start) < 500);
+        CHECK(cancelled == 2);
+        CHECK(group.cancelled());
+        CHECK(sibling.get() == 1);
+    });
+}
+
+// 子任务里创建的TaskGroup是子组，外层组取消时孙任务也被唤醒
+static void test_taskgroup_nested()
+{
+    run_in_fiber([]()
+    {
+        int p[2];
+        CHECK(pipe(p) == 0);
+        std::atomic<bool> grandchild_cancelled{false};
+        std::atomic<bool> inner_cancelled{false};
+        std::atomic<bool> inner_started{false};
+
+        nsCoroutine::TaskGroup outer;
+        outer.spawn([&]()
+        {
+            nsCoroutine::TaskGroup inner;
+            inner.spawn([&]()
+            {
+                char c;
+                inner_started = true;
+                grandchild_cancelled = read(p[0], &c, 1) == -1 && errno == ECANCELED;
+            });
+            inner.wait();
+            inner_cancelled = inner.cancelled();
+        });
+        while (!inner_started)
+        {
+            usleep(1000);
+        }
+        usleep(5000);
+        CHECK(!grandchild_cancelled);
+        auto start = std::chrono::steady_clock::now();
+        outer.cancel();
+        outer.wait();
+        CHECK(elapsed_ms(start) < 500);
+        CHECK(grandchild_cancelled);
+        CHECK(inner_cancelled);
+        close(p[0]);
+        close(p[1]);
+    });
+}
+
+// 记录存活对象个数，检验FiberLocal的值什么时候被销毁
+struct LiveCounter
+{
+    static std::atomic<int> s_live;
+    int value;
+    explicit LiveCounter(int v = 0) : value(v) { ++s_live; }
+    ~LiveCounter() { --s_live; }
+};
+std::atomic<int> LiveCounter::s_live{0};
+
+// FiberLocal的值跟着协程走：yield之后迁移到别的工作线程上仍然是自己的值
+static void test_fiber_local_migrate()
+{
+    static nsCoroutine::FiberLocal<int> s_local;
+    const int fibers = 50;
+    std::atomic<int> done{0};
+    std::atomic<int> wrong{0};
+    std::atomic<int> migrated{0};
+    {
+        nsCoroutine::IOManager iom(4, false, "test");
+        for (int i = 0; i < fibers; ++i)
+        {
+            iom.scheduleLock([i, &done, &wrong, &migrated]()
+            {
+                s_local.emplace(i);
+                std::thread::id first = std::this_thread::get_id();
+                bool moved = false;
+                for (int round = 0; round < 20; ++round)
+                {
+                    usleep(1000);
+                    if (!s_local.get() || *s_local != i)
+                    {
+                        wrong++;
+                    }
+                    moved = moved || std::this_thread::get_id() != first;
+                }
+                if (moved)
+                {
+                    migrated++;
+                }
+                done++;
+            });
+        }
+        while (done < fibers)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+    CHECK(wrong == 0);
+    CHECK(migrated > 0);
+}
+
+// 同一线程上的协程互相看不到对方的值；reset()销毁值，之后get()返回nullptr
+static void test_fiber_local_isolation()
+{
+    static nsCoroutine::FiberLocal<LiveCounter> s_local;
+    run_in_fiber([]()
+    {
+        CHECK(s_local.get() == nullptr);
+        s_local.emplace(1);
+        CHECK(LiveCounter::s_live == 1);
+
+        std::atomic<bool> other_done{false};
+        nsCoroutine::IOManager::GetThis()->scheduleLock([&]()
+        {
+            CHECK(s_local.get() == nullptr);
+            CHECK(s_local->value == 0); // 第一次解引用时默认构造
+            s_local->value = 2;
+            usleep(5000);
+            CHECK(s_local->value == 2);
+            other_done = true;
+        });
+        usleep(2000);
+        CHECK(s_local->value == 1);
+        while (!other_done)
+        {
+            usleep(1000);
+        }
+        CHECK(s_local->value == 1);
+        // 另一个协程结束时销毁了它的值
+        CHECK(LiveCounter::s_live == 1);
+
+        s_local.reset();
+        CHECK(s_local.get() == nullptr);
+        CHECK(LiveCounter::s_live == 0);
+    });
+}
+
+// 协程结束、或者挂起中被析构时销毁它的值；reset()复用的协程从空的存储开始
+static void test_fiber_local_lifetime()
+{
+    static nsCoroutine::FiberLocal<LiveCounter> s_local;
+    nsCoroutine::Fiber::GetThis();
+    bool empty_after_reset = false;
+    auto fiber = std::make_shared<nsCoroutine::Fiber>([]()
+    {
+        s_local.emplace(1);
+    }, 0, false);
+    fiber->resume();
+    CHECK(fiber->getState() == nsCoroutine::Fiber::TERM);
+    CHECK(LiveCounter::s_live == 0);
+
+    fiber->reset([&]()
+    {
+        empty_after_reset = s_local.get() == nullptr;
+        s_local.emplace(2);
+        nsCoroutine::Fiber::GetThisRaw()->yield();
+    });
+    fiber->resume();
+    CHECK(empty_after_reset);
+    CHECK(LiveCounter::s_live == 1);
+    fiber.reset();
+    CHECK(LiveCounter::s_live == 0);
+}
+
+// 截止时间到了之后hook的recv、usleep返回-1且errno = ETIMEDOUT，预算用完后的调用立即失败；嵌套只能收紧
+static void test_deadline()
+{
+    run_in_fiber([]()
+    {
+        CHECK(nsCoroutine::deadline_left_ms() == (uint64_t)-1);
+        int sv[2];
+        CHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+        char c;
+        {
+            nsCoroutine::DeadlineScope budget(30);
+            CHECK(nsCoroutine::deadline_left_ms() <= 30);
+            auto start = std::chrono::steady_clock::now();
+            errno = 0;
+            CHECK(recv(sv[0], &c, 1, 0) == -1);
+            CHECK(errno == ETIMEDOUT);
+            CHECK(elapsed_ms(start) >= 29);
+            CHECK(elapsed_ms(start) < 500);
+            CHECK(nsCoroutine::deadline_left_ms() == 0);
+
+            start = std::chrono::steady_clock::now();
+            errno = 0;
+            CHECK(usleep(100000) == -1);
+            CHECK(errno == ETIMEDOUT);
+            errno = 0;
+            CHECK(recv(sv[0], &c, 1, 0) == -1);
+            CHECK(errno == ETIMEDOUT);
+            CHECK(elapsed_ms(start) < 10);
+        }
+        CHECK(nsCoroutine::deadline_left_ms() == (uint64_t)-1);
+
+        {
+            nsCoroutine::DeadlineScope budget(1000);
+            CHECK(usleep(10000) == 0);
+            auto start = std::chrono::steady_clock::now();
+            CHECK(usleep(100000) == 0);
+            CHECK(elapsed_ms(start) >= 99);
+        }
+
+        // 内层更宽的预算不放宽外层
+        {
+            nsCoroutine::DeadlineScope outer(30);
+            auto start = std::chrono::steady_clock::now();
+            {
+                nsCoroutine::DeadlineScope inner(1000);
+                CHECK(nsCoroutine::deadline_left_ms() <= 30);
+                errno = 0;
+                CHECK(usleep(100000) == -1);
+                CHECK(errno == ETIMEDOUT);
+            }
+            CHECK(elapsed_ms(start) < 500);
+        }
+        // 内层更紧的预算生效，离开后恢复外层
+        {
+            nsCoroutine::DeadlineScope outer(1000);
+            auto start = std::chrono::steady_clock::now();
+            {
+                nsCoroutine::DeadlineScope inner(20);
+                errno = 0;
+                CHECK(usleep(100000) == -1);
+                CHECK(errno == ETIMEDOUT);
+            }
+            CHECK(elapsed_ms(start) < 500);
+            uint64_t left = nsCoroutine::deadline_left_ms();
+            CHECK(left > 500 && left <= 1000);
+        }
+        close(sv[0]);
+        close(sv[1]);
+    });
+}
+
+// 对端不应答SYN时connect等到截止时间返回ETIMEDOUT
+static void test_deadline_connect()
+{
+    run_in_fiber([]()
+    {
+        int server = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t len = sizeof(addr);
+        CHECK(bind(server, (sockaddr *)&addr, len) == 0);
+        CHECK(getsockname(server, (sockaddr *)&addr, &len) == 0);
+        // 不accept：全连接队列满了之后内核丢弃新的SYN，connect一直等
+        CHECK(listen(server, 0) == 0);
+
+        std::vector<int> clients;
+        bool timed_out = false;
+        for (int i = 0; i < 8 && !timed_out; ++i)
+        {
+            int fd = socket(AF_INET, SOCK_STREAM, 0);
+            clients.push_back(fd);
+            nsCoroutine::DeadlineScope budget(50);
+            auto start = std::chrono::steady_clock::now();
+            errno = 0;
+            if (connect(fd, (sockaddr *)&addr, sizeof(addr)) == -1)
+            {
+                CHECK(errno == ETIMEDOUT);
+                CHECK(elapsed_ms(start) >= 49);
+                CHECK(elapsed_ms(start) < 1000);
+                timed_out = true;
+            }
+        }
+        CHECK(timed_out);
+        for (int fd : clients)
+        {
+            close(fd);
+        }
+        close(server);
+    });
+}
+
+// spawn()和TaskGroup::spawn()启动的子协程继承截止时间
+static void test_deadline_inherit()
+{
+    run_in_fiber([]()
+    {
+        auto sleeper = []()
+        {
+            return usleep(1000000) == -1 && errno == ETIMEDOUT;
+        };
+        auto start = std::chrono::steady_clock::now();
+        nsCoroutine::Future<bool> spawned;
+        nsCoroutine::TaskGroup group;
+        nsCoroutine::Future<bool> grouped;
+        {
+            nsCoroutine::DeadlineScope budget(30);
+            spawned = nsCoroutine::spawn(sleeper);
+            grouped = group.spawn(sleeper);
+        }
+        // 离开作用域之后启动的子协程没有截止时间
+        nsCoroutine::Future<uint64_t> unbounded = nsCoroutine::spawn([]()
+        {
+            return nsCoroutine::deadline_left_ms();
+        });
+        CHECK(spawned.get());
+        CHECK(grouped.get());
+        group.wait();
+        CHECK(elapsed_ms(start) < 500);
+        CHECK(unbounded.get() == (uint64_t)-1);
+    });
+}
+
+int main(int argc, char *argv[])
+{
+    std::vector<std::pair<std::string, std::function<void()>>> cases = {
+        {"shared_stack", test_shared_stack},
+        {"condvar", test_condvar},
+        {"semaphore", test_semaphore},
+        {"channel_close", test_channel_close},
+        {"channel_timeout", test_channel_timeout},
+        {"channel_unbounded", test_channel_unbounded},
+        {"future", test_future},
+        {"future_combine", test_future_combine},
+        {"taskgroup_cancel", test_taskgroup_cancel},
+        {"taskgroup_error", test_taskgroup_error},
+        {"taskgroup_nested", test_taskgroup_nested},
+        {"fiber_local_migrate", test_fiber_local_migrate},
+        {"fiber_local_isolation", test_fiber_local_isolation},
+        {"fiber_local_lifetime", test_fiber_local_lifetime},
+        {"deadline", test_deadline},
+        {"deadline_connect", test_deadline_connect},
+        {"deadline_inherit", test_deadline_inherit},
+        {"file_io", test_file_io},
+        {"poll_pipe", test_poll_pipe},
+        {"poll_shared_fd", test_poll_shared_fd},
+        {"select_unpollable", test_select_unpollable},
+        {"select_fd", test_select_fd},
+        {"dup_failure", test_dup_failure},
+        {"dup_success", test_dup_success},
+        {"dup_replace_waited", test_dup_replace_waited},
+        {"resolver", test_resolver},
+        {"pthread_cond_timedwait", test_pthread_cond_timedwait},
+        {"pthread_cond_early_resume", test_pthread_cond_early_resume},
+    };
+    for (auto &c : cases)
+    {
+        if (argc < 2 || c.first == argv[1])
+        {
+            printf("==== %s ====\n", c.first.c_str());
+            c.second();
+        }
+    }
+    if (s_failed)
+    {
+        printf("%d check(s) failed\n", s_failed);
+        return 1;
+    }
+    printf("all passed\n");
+    return 0;
+}
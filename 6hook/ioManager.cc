@@ -5,8 +5,8 @@
 #include <cstring>
 
 #include "ioManager.h"
-
-static bool debug = true;
+#include "hook.h"
+#include "log.h"
 
 namespace nsCoroutine
 {
@@ -79,8 +79,8 @@ namespace nsCoroutine
     }
 
     // IOManager的构造函数和析构函数
-    IOManager::IOManager(size_t threads, bool use_caller, const std::string &name)
-        : Scheduler::Scheduler(threads, use_caller, name),
+    IOManager::IOManager(size_t threads, bool use_caller, const std::string &name, std::unique_ptr<SchedulePolicy> policy)
+        : Scheduler::Scheduler(threads, use_caller, name, std::move(policy)),
           TimerManager::TimerManager()
     {
         // 创建epoll句柄
@@ -173,6 +173,7 @@ namespace nsCoroutine
         // 判断事件是否已经存在？是就返回-1，因为相同的事件不能重复添加
         if (fd_ctx->events & event)
         {
+            errno = EEXIST;
             return -1;
         }
 
@@ -185,7 +186,10 @@ namespace nsCoroutine
         int rt = epoll_ctl(_m_epfd, op, fd, &epevnet);
         if (rt)
         {
-            std::cerr << "addEvent::epoll_ctl failed: " << strerror(errno) << std::endl;
+            // 调用方靠errno区分失败原因，写日志可能改掉它
+            int err = errno;
+            LOG_ERROR("addEvent::epoll_ctl failed: {}", strerror(err));
+            errno = err;
             return -1;
         }
 
@@ -250,7 +254,7 @@ namespace nsCoroutine
         int rt = epoll_ctl(_m_epfd, op, fd, &epevnet);
         if (rt)
         {
-            std::cerr << "delEvent::epoll_ctl failed: " << strerror(errno) << std::endl;
+            LOG_ERROR("delEvent::epoll_ctl failed: {}", strerror(errno));
             return -1;
         }
 
@@ -298,7 +302,7 @@ namespace nsCoroutine
         int rt = epoll_ctl(_m_epfd, op, fd, &epevnet);
         if (rt)
         {
-            std::cerr << "cancelEvent::epoll_ctl failed: " << strerror(errno) << std::endl;
+            LOG_ERROR("cancelEvent::epoll_ctl failed: {}", strerror(errno));
             return -1;
         }
 
@@ -342,7 +346,7 @@ namespace nsCoroutine
         int rt = epoll_ctl(_m_epfd, op, fd, &epevnet);
         if (rt)
         {
-            std::cerr << "cancelAll::epoll_ctl failed: " << strerror(errno) << std::endl;
+            LOG_ERROR("cancelAll::epoll_ctl failed: {}", strerror(errno));
             return -1;
         }
 
@@ -392,17 +396,15 @@ namespace nsCoroutine
 
         while (true)
         {
-            if (debug)
-                std::cout << "IOManager::idle(),run in thread: " << Thread::GetThreadId() << std::endl;
+            LOG_DEBUG("IOManager::idle(),run in thread: {}", Thread::GetThreadId());
 
             if (stopping())
             {
-                if (debug)
-                    std::cout << "name = " << getName() << " idle exits in thread: " << Thread::GetThreadId() << std::endl;
+                LOG_DEBUG("name = {} idle exits in thread: {}", getName(), Thread::GetThreadId());
                 break;
             }
 
-            // 在epoll_wait阻塞
+            // 在epoll_wait阻塞，用原始的epoll_wait_f：hook的版本会把这个线程当成协程挂起
             int rt = 0;
             while (true)
             {
@@ -410,7 +412,7 @@ namespace nsCoroutine
                 uint64_t next_timeout = getNextTimer();
                 next_timeout = std::min(next_timeout, MAX_TIMEOUT);
 
-                rt = epoll_wait(_m_epfd, events.get(), MAX_EVENTS, (int)next_timeout);
+                rt = epoll_wait_f(_m_epfd, events.get(), MAX_EVENTS, (int)next_timeout);
                 // EINTR -> retry，EINTR说明调用被信号中断，这是最常见的错误，通常的处理方式就是直接重新调用epoll_wait
                 if (rt < 0 && errno == EINTR)
                 {
@@ -428,9 +430,10 @@ namespace nsCoroutine
             listExpiredCb(cbs);
             if (!cbs.empty())
             {
-                for (const auto &cb : cbs)
+                // 传指针走swap的重载，回调及其捕获的shared_ptr直接转移进任务队列，不做复制
+                for (auto &cb : cbs)
                 {
-                    scheduleLock(cb);
+                    scheduleLock(&cb);
                 }
                 cbs.clear();
             }
@@ -483,7 +486,7 @@ namespace nsCoroutine
                 int rt2 = epoll_ctl(_m_epfd, op, fd_ctx->fd, &event);
                 if (rt2)
                 {
-                    std::cerr << "idle::epoll_ctl failed: " << strerror(errno) << std::endl;
+                    LOG_ERROR("idle::epoll_ctl failed: {}", strerror(errno));
                     continue;
                 }
 
@@ -500,7 +503,7 @@ namespace nsCoroutine
                 }
             } // end for
 
-            Fiber::GetThis()->yield();
+            Fiber::GetThisRaw()->yield();
 
         } // end while(true)
     }
@@ -53,8 +53,9 @@ namespace nsCoroutine
 
     public:
         //threads线程数量，use_caller是否将主线程或调度线程包含进行，name调度器的名字
-        //允许设置线程数量、是否使用调度者线程以及名称
-        IOManager(size_t threads = 1, bool use_caller = true, const std::string& name = "IOManager");
+        //允许设置线程数量、是否使用调度者线程以及名称，policy是调度策略，为空时使用默认的PriorityPolicy
+        IOManager(size_t threads = 1, bool use_caller = true, const std::string& name = "IOManager",
+                  std::unique_ptr<SchedulePolicy> policy = nullptr);
         ~IOManager();
         //事件管理方法
         //添加一个事件到文件描述符fd上，并关联一个回调函数cb
@@ -0,0 +1,430 @@
+#include "log.h"
+#include "thread.h"
+#include "fiber.h"
+
+#include <cstdio>
+#include <cstdarg>
+#include <cstdlib>
+#include <ctime>
+#include <chrono>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+namespace nsCoroutine
+{
+    LogRecord *LogRing::reserve()
+    {
+        size_t tail = _m_tail.load(std::memory_order_relaxed);
+        // 只有生产者自己会修改tail，消费者的head用acquire读取，确保看到的槽位已经被取走
+        if (tail - _m_head.load(std::memory_order_acquire) == CAPACITY)
+        {
+            _m_dropped.fetch_add(1, std::memory_order_relaxed);
+            return nullptr;
+        }
+        return &_m_records[tail & (CAPACITY - 1)];
+    }
+
+    void LogRing::publish()
+    {
+        _m_tail.store(_m_tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    const LogRecord *LogRing::front()
+    {
+        size_t head = _m_head.load(std::memory_order_relaxed);
+        if (head == _m_tail.load(std::memory_order_acquire))
+        {
+            return nullptr;
+        }
+        return &_m_records[head & (CAPACITY - 1)];
+    }
+
+    void LogRing::pop()
+    {
+        _m_head.store(_m_head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    // 线程局部的队列持有者，线程退出时把队列标记为关闭，由后台线程取空后释放
+    struct LogRingHolder
+    {
+        std::shared_ptr<LogRing> ring;
+        ~LogRingHolder()
+        {
+            if (ring)
+            {
+                ring->_m_closed.store(true, std::memory_order_release);
+            }
+        }
+    };
+    static thread_local LogRingHolder t_log_ring;
+
+    struct Logger::Backend
+    {
+        std::unique_ptr<Thread> thread;
+    };
+
+    static void FlushAtExit()
+    {
+        Logger::GetInstance()->flush();
+    }
+
+    Logger *Logger::GetInstance()
+    {
+        // 故意不释放：静态析构阶段（例如全局IOManager析构）仍然可能写日志
+        static Logger *s_logger = new Logger();
+        return s_logger;
+    }
+
+    Logger::Logger()
+        : _m_fd(STDERR_FILENO), _m_backend(new Backend)
+    {
+        _m_backend->thread.reset(new Thread(std::bind(&Logger::backend, this), "log"));
+        atexit(&FlushAtExit);
+    }
+
+    Logger::~Logger()
+    {
+        _m_stop.store(true, std::memory_order_release);
+        _m_backend->thread->join();
+    }
+
+    bool Logger::setFile(const std::string &path)
+    {
+        int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if (fd < 0)
+        {
+            return false;
+        }
+        int old = _m_fd.exchange(fd);
+        // 等后台线程走完一轮，确认它已经不再使用旧的fd
+        flush();
+        if (old > STDERR_FILENO)
+        {
+            close(old);
+        }
+        return true;
+    }
+
+    LogRing *Logger::localRing()
+    {
+        LogRing *ring = t_log_ring.ring.get();
+        if (ring == nullptr)
+        {
+            t_log_ring.ring = std::make_shared<LogRing>();
+            ring = t_log_ring.ring.get();
+            std::lock_guard<std::mutex> lock(_m_mutex);
+            _m_rings.push_back(t_log_ring.ring);
+        }
+        return ring;
+    }
+
+    void Logger::fillHeader(LogRecord *r, LogLevel level, const char *file, int line, const char *fmt)
+    {
+        r->time_us = std::chrono::duration_cast<std::chrono::microseconds>(
+                         std::chrono::system_clock::now().time_since_epoch())
+                         .count();
+        r->fiber_id = Fiber::GetFiberId();
+        r->file = file;
+        r->fmt = fmt;
+        r->line = line;
+        r->level = level;
+        const std::string &name = Thread::GetName();
+        size_t n = std::min(name.size(), sizeof(r->thread_name) - 1);
+        memcpy(r->thread_name, name.data(), n);
+        r->thread_name[n] = '\0';
+    }
+
+    void Logger::flush()
+    {
+        uint64_t req = _m_flushReq.fetch_add(1, std::memory_order_acq_rel) + 1;
+        // 这里不能用sleep_for：调用线程可能开启了hook，nanosleep会被转成协程定时器
+        while (_m_flushDone.load(std::memory_order_acquire) < req)
+        {
+            std::this_thread::yield();
+        }
+    }
+
+    uint64_t Logger::dropped()
+    {
+        std::lock_guard<std::mutex> lock(_m_mutex);
+        uint64_t n = _m_droppedRetired;
+        for (auto &ring : _m_rings)
+        {
+            n += ring->dropped();
+        }
+        return n;
+    }
+
+    static const char *LevelName(LogLevel level)
+    {
+        switch (level)
+        {
+        case LogLevel::DEBUG:
+            return "DEBUG";
+        case LogLevel::INFO:
+            return "INFO";
+        case LogLevel::WARN:
+            return "WARN";
+        case LogLevel::ERROR:
+            return "ERROR";
+        }
+        return "UNKNOWN";
+    }
+
+    // 后台线程的输出缓冲，格式化好的日志行连续存放，每行对应一个iovec，攒满后一次writev
+    class LogWriter
+    {
+    public:
+        static const size_t BUF_CAPACITY = 64 * 1024;
+        static const size_t LINE_MAX = 512;
+        static const int IOV_CAPACITY = 64;
+
+        // 追加一条格式化后的日志
+        void append(const LogRecord &r, int fd);
+        // 把缓冲区内容写到fd
+        void flush(int fd);
+
+    private:
+        void put(const char *s, size_t n)
+        {
+            n = std::min(n, (size_t)(_m_lineEnd - _m_cur));
+            memcpy(_m_cur, s, n);
+            _m_cur += n;
+        }
+        void put(const char *s) { put(s, strlen(s)); }
+        void putf(const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+        // 解码一个参数，返回下一个参数的位置
+        const uint8_t *putArg(const uint8_t *p, const uint8_t *end);
+
+    private:
+        char _m_buf[BUF_CAPACITY];
+        size_t _m_len = 0;
+        char *_m_cur = nullptr;
+        char *_m_lineEnd = nullptr;
+        struct iovec _m_iov[IOV_CAPACITY];
+        int _m_iovcnt = 0;
+        // 缓存上一次格式化的秒级时间，同一秒内的日志不再调用localtime_r
+        time_t _m_lastSec = -1;
+        char _m_secStr[32];
+    };
+
+    void LogWriter::putf(const char *fmt, ...)
+    {
+        if (_m_cur >= _m_lineEnd)
+        {
+            return;
+        }
+        va_list va;
+        va_start(va, fmt);
+        int n = vsnprintf(_m_cur, _m_lineEnd - _m_cur, fmt, va);
+        va_end(va);
+        if (n > 0)
+        {
+            _m_cur += std::min((size_t)n, (size_t)(_m_lineEnd - _m_cur - 1));
+        }
+    }
+
+    const uint8_t *LogWriter::putArg(const uint8_t *p, const uint8_t *end)
+    {
+        LogArgs::Type type = (LogArgs::Type)*p++;
+        switch (type)
+        {
+        case LogArgs::I64:
+        {
+            int64_t v;
+            memcpy(&v, p, sizeof(v));
+            putf("%lld", (long long)v);
+            return p + sizeof(v);
+        }
+        case LogArgs::U64:
+        {
+            uint64_t v;
+            memcpy(&v, p, sizeof(v));
+            putf("%llu", (unsigned long long)v);
+            return p + sizeof(v);
+        }
+        case LogArgs::F64:
+        {
+            double v;
+            memcpy(&v, p, sizeof(v));
+            putf("%g", v);
+            return p + sizeof(v);
+        }
+        case LogArgs::BOOL:
+        {
+            put(*p ? "true" : "false");
+            return p + sizeof(bool);
+        }
+        case LogArgs::PTR:
+        {
+            const void *v;
+            memcpy(&v, p, sizeof(v));
+            putf("%p", v);
+            return p + sizeof(v);
+        }
+        case LogArgs::STR:
+        {
+            uint16_t n;
+            memcpy(&n, p, sizeof(n));
+            put((const char *)p + sizeof(n), n);
+            return p + sizeof(n) + n;
+        }
+        }
+        return end;
+    }
+
+    void LogWriter::append(const LogRecord &r, int fd)
+    {
+        if (_m_iovcnt == IOV_CAPACITY || _m_len + LINE_MAX > BUF_CAPACITY)
+        {
+            flush(fd);
+        }
+        _m_cur = _m_buf + _m_len;
+        _m_lineEnd = _m_cur + LINE_MAX - 1; // 留一个字节给换行
+
+        time_t sec = r.time_us / 1000000;
+        if (sec != _m_lastSec)
+        {
+            struct tm tm;
+            localtime_r(&sec, &tm);
+            strftime(_m_secStr, sizeof(_m_secStr), "%Y-%m-%d %H:%M:%S", &tm);
+            _m_lastSec = sec;
+        }
+        const char *file = strrchr(r.file, '/');
+        file = file ? file + 1 : r.file;
+        if (r.fiber_id == (uint64_t)-1)
+        {
+            putf("%s.%06u [%s] [%s:-] %s:%u ", _m_secStr, (unsigned)(r.time_us % 1000000),
+                 LevelName(r.level), r.thread_name, file, r.line);
+        }
+        else
+        {
+            putf("%s.%06u [%s] [%s:%llu] %s:%u ", _m_secStr, (unsigned)(r.time_us % 1000000),
+                 LevelName(r.level), r.thread_name, (unsigned long long)r.fiber_id, file, r.line);
+        }
+
+        // 按"{}"占位符依次填入参数，参数不够时原样输出"{}"
+        const uint8_t *arg = r.args.data;
+        const uint8_t *arg_end = r.args.data + r.args.len;
+        const char *fmt = r.fmt;
+        while (true)
+        {
+            const char *p = strstr(fmt, "{}");
+            if (p == nullptr)
+            {
+                put(fmt);
+                break;
+            }
+            put(fmt, p - fmt);
+            if (arg < arg_end)
+            {
+                arg = putArg(arg, arg_end);
+            }
+            else
+            {
+                put("{}", 2);
+            }
+            fmt = p + 2;
+        }
+        *_m_cur++ = '\n';
+
+        char *line = _m_buf + _m_len;
+        _m_iov[_m_iovcnt].iov_base = line;
+        _m_iov[_m_iovcnt].iov_len = _m_cur - line;
+        ++_m_iovcnt;
+        _m_len = _m_cur - _m_buf;
+    }
+
+    void LogWriter::flush(int fd)
+    {
+        struct iovec *iov = _m_iov;
+        int cnt = _m_iovcnt;
+        while (cnt > 0)
+        {
+            ssize_t n = writev(fd, iov, cnt);
+            if (n < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                break;
+            }
+            // 处理部分写入：跳过已写完的iovec，调整写了一半的那个
+            while (cnt > 0 && (size_t)n >= iov->iov_len)
+            {
+                n -= iov->iov_len;
+                ++iov;
+                --cnt;
+            }
+            if (cnt > 0)
+            {
+                iov->iov_base = (char *)iov->iov_base + n;
+                iov->iov_len -= n;
+            }
+        }
+        _m_iovcnt = 0;
+        _m_len = 0;
+    }
+
+    bool Logger::drain()
+    {
+        static LogWriter s_writer;
+        std::vector<std::shared_ptr<LogRing>> rings;
+        {
+            std::lock_guard<std::mutex> lock(_m_mutex);
+            rings = _m_rings;
+        }
+
+        int fd = _m_fd.load();
+        bool busy = false;
+        for (auto &ring : rings)
+        {
+            const LogRecord *r;
+            while ((r = ring->front()) != nullptr)
+            {
+                busy = true;
+                s_writer.append(*r, fd);
+                ring->pop();
+            }
+        }
+        s_writer.flush(fd);
+
+        // 回收已经退出且取空的线程队列
+        std::lock_guard<std::mutex> lock(_m_mutex);
+        for (auto it = _m_rings.begin(); it != _m_rings.end();)
+        {
+            if ((*it)->_m_closed.load(std::memory_order_acquire) && (*it)->empty())
+            {
+                _m_droppedRetired += (*it)->dropped();
+                it = _m_rings.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+        return busy;
+    }
+
+    void Logger::backend()
+    {
+        while (true)
+        {
+            // 先记下flush请求再取空，保证请求之前提交的日志都已经输出
+            uint64_t req = _m_flushReq.load(std::memory_order_acquire);
+            bool busy = drain();
+            _m_flushDone.store(req, std::memory_order_release);
+            if (_m_stop.load(std::memory_order_acquire))
+            {
+                drain();
+                break;
+            }
+            if (!busy)
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            }
+        }
+    }
+}
@@ -0,0 +1,254 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+// 日志级别，同时用于预处理期判断
+#define NSCO_LOG_LEVEL_DEBUG 0
+#define NSCO_LOG_LEVEL_INFO 1
+#define NSCO_LOG_LEVEL_WARN 2
+#define NSCO_LOG_LEVEL_ERROR 3
+#define NSCO_LOG_LEVEL_NONE 4
+
+// 编译期日志级别：低于该级别的日志语句在预处理阶段整条删除，参数也不会被求值
+// 默认只保留INFO及以上，调试时用 -DNSCO_LOG_LEVEL=0 打开DEBUG
+#ifndef NSCO_LOG_LEVEL
+#define NSCO_LOG_LEVEL NSCO_LOG_LEVEL_INFO
+#endif
+
+namespace nsCoroutine
+{
+    enum class LogLevel
+    {
+        DEBUG = NSCO_LOG_LEVEL_DEBUG,
+        INFO = NSCO_LOG_LEVEL_INFO,
+        WARN = NSCO_LOG_LEVEL_WARN,
+        ERROR = NSCO_LOG_LEVEL_ERROR,
+    };
+
+    // 日志参数的二进制编码：类型标签 + 原始字节，格式化推迟到后台线程
+    // 写日志的线程只做几次memcpy，不调用snprintf也不分配内存；超出容量的参数被丢弃
+    struct LogArgs
+    {
+        enum Type : uint8_t
+        {
+            I64,
+            U64,
+            F64,
+            BOOL,
+            PTR,
+            STR, // 后跟uint16_t长度和字符串内容，字符串在写日志时就被复制，之后原对象可以随意释放
+        };
+
+        static const size_t CAPACITY = 200;
+        uint16_t len = 0;
+        uint8_t data[CAPACITY];
+
+        void put(Type type, const void *p, size_t n)
+        {
+            if (len + 1 + n > CAPACITY)
+            {
+                return;
+            }
+            data[len] = type;
+            memcpy(data + len + 1, p, n);
+            len += 1 + n;
+        }
+
+        void putStr(const char *s, size_t n)
+        {
+            size_t used = len;
+            if (used + 3 > CAPACITY)
+            {
+                return;
+            }
+            n = std::min(n, CAPACITY - used - 3);
+            uint16_t n16 = n;
+            data[len] = STR;
+            memcpy(data + len + 1, &n16, sizeof(n16));
+            memcpy(data + len + 3, s, n);
+            len += 3 + n;
+        }
+
+        template <typename T>
+        void encode(const T &v)
+        {
+            if constexpr (std::is_same_v<T, bool>)
+            {
+                put(BOOL, &v, sizeof(v));
+            }
+            else if constexpr (std::is_same_v<T, char>)
+            {
+                putStr(&v, 1);
+            }
+            else if constexpr (std::is_same_v<T, std::string>)
+            {
+                putStr(v.data(), v.size());
+            }
+            else if constexpr (std::is_convertible_v<const T &, const char *>)
+            {
+                const char *s = v;
+                s ? putStr(s, strlen(s)) : putStr("(null)", 6);
+            }
+            else if constexpr (std::is_enum_v<T> || (std::is_integral_v<T> && std::is_signed_v<T>))
+            {
+                int64_t x = (int64_t)v;
+                put(I64, &x, sizeof(x));
+            }
+            else if constexpr (std::is_integral_v<T>)
+            {
+                uint64_t x = (uint64_t)v;
+                put(U64, &x, sizeof(x));
+            }
+            else if constexpr (std::is_floating_point_v<T>)
+            {
+                double x = (double)v;
+                put(F64, &x, sizeof(x));
+            }
+            else
+            {
+                static_assert(std::is_pointer_v<T>, "unsupported log argument type");
+                const void *x = (const void *)v;
+                put(PTR, &x, sizeof(x));
+            }
+        }
+    };
+
+    // 一条日志记录，直接在环形队列的槽位里原地填写
+    struct LogRecord
+    {
+        uint64_t time_us;   // 墙上时间，微秒
+        uint64_t fiber_id;  // Fiber::GetFiberId()，不在协程里为UINT64_MAX
+        const char *file;   // __FILE__，静态字符串
+        const char *fmt;    // 格式串，必须是字符串字面量，后台线程格式化时才读取
+        uint32_t line;
+        LogLevel level;
+        char thread_name[16]; // Thread::GetName()的前15个字符
+        LogArgs args;
+    };
+
+    // 单生产者单消费者环形队列，每个线程一个，生产者是写日志的线程，消费者是后台日志线程
+    // 生产者在槽位里原地写记录，只有一次release store，不加锁也不会被消费者阻塞；队列满时丢弃并计数
+    class LogRing
+    {
+    public:
+        static const size_t CAPACITY = 1024; // 必须是2的幂
+
+        // 取得下一个可写槽位，队列满返回nullptr；写完后调用publish()
+        LogRecord *reserve();
+        void publish();
+        // 消费者：查看/弹出队首记录
+        const LogRecord *front();
+        void pop();
+
+        bool empty() const
+        {
+            return _m_head.load(std::memory_order_acquire) == _m_tail.load(std::memory_order_acquire);
+        }
+        uint64_t dropped() const { return _m_dropped.load(std::memory_order_relaxed); }
+
+        // 所属线程退出后置位，消费者取空后回收
+        std::atomic<bool> _m_closed{false};
+
+    private:
+        LogRecord _m_records[CAPACITY];
+        alignas(64) std::atomic<size_t> _m_head{0}; // 消费者读位置
+        alignas(64) std::atomic<size_t> _m_tail{0}; // 生产者写位置
+        std::atomic<uint64_t> _m_dropped{0};
+    };
+
+    // 异步日志器：前端把二进制记录写进本线程的LogRing，后台线程轮询所有LogRing，
+    // 格式化后用writev批量写到文件（默认stderr），调用方永远不会阻塞在iostream或磁盘/终端上
+    class Logger
+    {
+    public:
+        static Logger *GetInstance();
+
+        // 运行期级别过滤，只能在编译期级别的基础上进一步收紧
+        void setLevel(LogLevel level) { _m_level.store((int)level, std::memory_order_relaxed); }
+        bool enabled(LogLevel level) const { return (int)level >= _m_level.load(std::memory_order_relaxed); }
+
+        // 设置输出文件（追加写），失败返回false并保持原来的输出
+        bool setFile(const std::string &path);
+
+        template <typename... Args>
+        void log(LogLevel level, const char *file, int line, const char *fmt, const Args &...args)
+        {
+            if (!enabled(level))
+            {
+                return;
+            }
+            LogRing *ring = localRing();
+            LogRecord *r = ring->reserve();
+            if (r == nullptr)
+            {
+                return;
+            }
+            fillHeader(r, level, file, line, fmt);
+            r->args.len = 0;
+            (r->args.encode(args), ...);
+            ring->publish();
+        }
+
+        // 等待当前所有已提交的日志输出完毕
+        void flush();
+        // 所有线程因队列满而丢弃的日志条数
+        uint64_t dropped();
+
+    private:
+        Logger();
+        ~Logger();
+        // 当前线程的环形队列，第一次调用时创建并注册
+        LogRing *localRing();
+        // 填写时间戳、协程id、线程名等公共字段
+        static void fillHeader(LogRecord *r, LogLevel level, const char *file, int line, const char *fmt);
+        // 后台线程主循环
+        void backend();
+        // 取空所有队列，返回是否处理了日志
+        bool drain();
+
+    private:
+        std::atomic<int> _m_level{NSCO_LOG_LEVEL};
+        std::mutex _m_mutex; // 只保护_m_rings的注册和回收，不在写日志路径上
+        std::vector<std::shared_ptr<LogRing>> _m_rings;
+        uint64_t _m_droppedRetired = 0; // 已回收队列的丢弃计数
+        std::atomic<int> _m_fd;
+        std::atomic<bool> _m_stop{false};
+        std::atomic<uint64_t> _m_flushReq{0};
+        std::atomic<uint64_t> _m_flushDone{0};
+        struct Backend;
+        std::unique_ptr<Backend> _m_backend;
+    };
+}
+
+#define NSCO_LOG(level, ...) ::nsCoroutine::Logger::GetInstance()->log(level, __FILE__, __LINE__, __VA_ARGS__)
+
+#if NSCO_LOG_LEVEL <= NSCO_LOG_LEVEL_DEBUG
+#define LOG_DEBUG(...) NSCO_LOG(::nsCoroutine::LogLevel::DEBUG, __VA_ARGS__)
+#else
+#define LOG_DEBUG(...) ((void)0)
+#endif
+
+#if NSCO_LOG_LEVEL <= NSCO_LOG_LEVEL_INFO
+#define LOG_INFO(...) NSCO_LOG(::nsCoroutine::LogLevel::INFO, __VA_ARGS__)
+#else
+#define LOG_INFO(...) ((void)0)
+#endif
+
+#if NSCO_LOG_LEVEL <= NSCO_LOG_LEVEL_WARN
+#define LOG_WARN(...) NSCO_LOG(::nsCoroutine::LogLevel::WARN, __VA_ARGS__)
+#else
+#define LOG_WARN(...) ((void)0)
+#endif
+
+#if NSCO_LOG_LEVEL <= NSCO_LOG_LEVEL_ERROR
+#define LOG_ERROR(...) NSCO_LOG(::nsCoroutine::LogLevel::ERROR, __VA_ARGS__)
+#else
+#define LOG_ERROR(...) ((void)0)
+#endif
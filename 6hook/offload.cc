@@ -0,0 +1,76 @@
+#include "offload.h"
+
+#include <atomic>
+
+namespace nsCoroutine
+{
+    static std::atomic<size_t> s_default_threads{4};
+
+    OffloadPool::OffloadPool(size_t threads, const std::string &name)
+    {
+        assert(threads > 0);
+        for (size_t i = 0; i < threads; ++i)
+        {
+            _m_threads.emplace_back(new Thread(std::bind(&OffloadPool::run, this), name + "_" + std::to_string(i)));
+        }
+    }
+
+    OffloadPool::~OffloadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(_m_mutex);
+            _m_stopping = true;
+        }
+        _m_cond.notify_all();
+        for (auto &thread : _m_threads)
+        {
+            thread->join();
+        }
+    }
+
+    void OffloadPool::submit(std::function<void()> job)
+    {
+        {
+            std::lock_guard<std::mutex> lock(_m_mutex);
+            _m_jobs.push_back(std::move(job));
+        }
+        _m_cond.notify_one();
+    }
+
+    size_t OffloadPool::pending()
+    {
+        std::lock_guard<std::mutex> lock(_m_mutex);
+        return _m_jobs.size();
+    }
+
+    void OffloadPool::run()
+    {
+        while (true)
+        {
+            std::function<void()> job;
+            {
+                std::unique_lock<std::mutex> lock(_m_mutex);
+                _m_cond.wait(lock, [this]() { return _m_stopping || !_m_jobs.empty(); });
+                if (_m_jobs.empty())
+                {
+                    return;
+                }
+                job = std::move(_m_jobs.front());
+                _m_jobs.pop_front();
+            }
+            job();
+        }
+    }
+
+    OffloadPool *OffloadPool::GetInstance()
+    {
+        // 不销毁：进程退出时可能还有协程挂在卸载的调用上
+        static OffloadPool *s_pool = new OffloadPool(s_default_threads.load());
+        return s_pool;
+    }
+
+    void OffloadPool::SetDefaultThreads(size_t threads)
+    {
+        s_default_threads = threads;
+    }
+}
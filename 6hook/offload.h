@@ -0,0 +1,111 @@
+#pragma once
+
+#include <cerrno>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include "fiber.h"
+#include "fiberSync.h"
+#include "scheduler.h"
+#include "thread.h"
+
+// 阻塞调用卸载池
+// 没办法用epoll等待的阻塞调用（普通文件的读写、fsync、getaddrinfo）和长时间的计算（压缩）会占住工作线程，
+// 排在它后面的协程都跟着卡住。offload(f)把f交给一组独立的线程执行，调用的协程挂起，
+// f执行完后由FiberWaiter把协程放回它原来的调度器，工作线程在这期间继续执行别的协程
+//
+//  ssize_t n = offload([&]() { return pread(fd, buf, len, off); });
+//
+// 卸载池线程没有开启hook，f里的调用都是原始的阻塞调用；f执行期间协程不能被取消，也不受截止时间限制
+
+namespace nsCoroutine
+{
+    class OffloadPool
+    {
+    public:
+        // 启动threads个线程，线程数固定，任务多于线程时排队
+        explicit OffloadPool(size_t threads, const std::string &name = "offload");
+        // 执行完已经提交的任务后结束线程
+        ~OffloadPool();
+        OffloadPool(const OffloadPool &) = delete;
+        OffloadPool &operator=(const OffloadPool &) = delete;
+
+        // 提交一个任务，在卸载池的某个线程上执行
+        void submit(std::function<void()> job);
+        // 排队中还没开始执行的任务数
+        size_t pending();
+
+        // 全局卸载池，第一次调用时创建，进程退出前不销毁
+        static OffloadPool *GetInstance();
+        // 全局卸载池的线程数，要在第一次GetInstance()之前设置，默认4
+        static void SetDefaultThreads(size_t threads);
+
+    private:
+        void run();
+
+    private:
+        std::mutex _m_mutex;
+        std::condition_variable _m_cond;
+        std::deque<std::function<void()>> _m_jobs;
+        std::vector<std::shared_ptr<Thread>> _m_threads;
+        bool _m_stopping = false;
+    };
+
+    // 在全局卸载池里执行f，当前协程挂起直到f返回，返回f的结果；f抛出的异常在这里重新抛出，f返回时的errno也带回来
+    // 不在任务协程里，或者当前是共享栈协程时直接在当前线程执行：
+    // f通常会访问调用方栈上的变量，共享栈协程挂起后栈上的内容可能被拷走
+    template <typename F>
+    auto offload(F &&f) -> std::invoke_result_t<std::decay_t<F>>
+    {
+        using R = std::invoke_result_t<std::decay_t<F>>;
+        if (!Scheduler::InTaskFiber() || Fiber::GetThisRaw()->isSharedStack())
+        {
+            return f();
+        }
+
+        // 结果放在协程栈上：协程挂起到被唤醒之间，卸载池线程是唯一的访问者
+        std::conditional_t<std::is_void_v<R>, bool, std::optional<R>> result{};
+        std::exception_ptr error;
+        int err = 0;
+        std::shared_ptr<FiberWaiter> waiter = std::make_shared<FiberWaiter>(false, false);
+        OffloadPool::GetInstance()->submit([&, waiter]()
+        {
+            try
+            {
+                if constexpr (std::is_void_v<R>)
+                {
+                    f();
+                }
+                else
+                {
+                    result.emplace(f());
+                }
+            }
+            catch (...)
+            {
+                error = std::current_exception();
+            }
+            err = errno;
+            // 唤醒之后协程可能立即在别的线程上继续执行并返回，这里之后不能再访问栈上的变量
+            waiter->wake();
+        });
+        waiter->wait();
+
+        if (error)
+        {
+            std::rethrow_exception(error);
+        }
+        errno = err;
+        if constexpr (!std::is_void_v<R>)
+        {
+            return std::move(*result);
+        }
+    }
+}
@@ -0,0 +1,436 @@
+#include "pthreadHook.h"
+#include "hook.h"
+#include "fiberSync.h"
+#include "ioManager.h"
+#include "scheduler.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <deque>
+#include <dlfcn.h>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#define PTHREAD_HOOK_FUN(XX)   \
+    XX(pthread_mutex_lock)     \
+    XX(pthread_mutex_trylock)  \
+    XX(pthread_mutex_unlock)   \
+    XX(pthread_cond_wait)      \
+    XX(pthread_cond_timedwait) \
+    XX(pthread_cond_signal)    \
+    XX(pthread_cond_broadcast)
+
+extern "C"
+{
+#define XX(name) name##_fun name##_f = nullptr;
+    PTHREAD_HOOK_FUN(XX)
+#undef XX
+}
+
+namespace nsCoroutine
+{
+    // 拿不到锁时先自旋的次数：库内部（调度器、FdManager...）的临界区都很短，通常自旋就能拿到
+    static const int MUTEX_SPIN = 64;
+    // 等锁的协程除了等解锁方唤醒，还定时重试：解锁不一定经过hook（glibc内部、条件变量的原始实现），重试间隔从1ms翻倍到16ms
+    static const uint64_t MUTEX_RETRY_MAX_MS = 16;
+
+    static std::atomic<bool> s_pthread_hook_enable{false};
+    // hook内部操作等待队列、调度协程时加的锁直接用原始实现
+    static thread_local bool t_in_pthread_hook = false;
+
+    // 按对象地址（互斥锁、条件变量）登记的挂起协程
+    class WaitTable
+    {
+    public:
+        void push(const void *addr, const std::shared_ptr<FiberWaiter> &waiter)
+        {
+            Shard &shard = shardOf(addr);
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            shard.waiters[addr].push_back(waiter);
+            ++_m_count;
+        }
+
+        // 等待者自己离开（超时、重试）时调用，已经被唤醒方取走时什么也不做
+        void remove(const void *addr, const std::shared_ptr<FiberWaiter> &waiter)
+        {
+            Shard &shard = shardOf(addr);
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            auto it = shard.waiters.find(addr);
+            if (it == shard.waiters.end())
+            {
+                return;
+            }
+            auto &queue = it->second;
+            for (auto w = queue.begin(); w != queue.end(); ++w)
+            {
+                if (*w == waiter)
+                {
+                    queue.erase(w);
+                    --_m_count;
+                    break;
+                }
+            }
+            if (queue.empty())
+            {
+                shard.waiters.erase(it);
+            }
+        }
+
+        // 唤醒addr上的等待者，all为false时最多一个；已经超时、自己抢到唤醒权的等待者跳过
+        void wake(const void *addr, bool all)
+        {
+            if (_m_count.load() == 0)
+            {
+                return;
+            }
+            std::vector<std::shared_ptr<FiberWaiter>> woken;
+            {
+                Shard &shard = shardOf(addr);
+                std::lock_guard<std::mutex> lock(shard.mutex);
+                auto it = shard.waiters.find(addr);
+                if (it == shard.waiters.end())
+                {
+                    return;
+                }
+                auto &queue = it->second;
+                while (!queue.empty())
+                {
+                    std::shared_ptr<FiberWaiter> waiter = std::move(queue.front());
+                    queue.pop_front();
+                    --_m_count;
+                    if (all)
+                    {
+                        woken.push_back(std::move(waiter));
+                    }
+                    else if (waiter->claim())
+                    {
+                        woken.push_back(std::move(waiter));
+                        break;
+                    }
+                }
+                if (queue.empty())
+                {
+                    shard.waiters.erase(it);
+                }
+            }
+            if (all)
+            {
+                FiberWaiter::WakeAll(woken);
+            }
+            else if (!woken.empty())
+            {
+                woken[0]->resume();
+            }
+        }
+
+    private:
+        static const size_t SHARDS = 64;
+
+        struct Shard
+        {
+            std::mutex mutex;
+            std::unordered_map<const void *, std::deque<std::shared_ptr<FiberWaiter>>> waiters;
+        };
+
+        Shard &shardOf(const void *addr)
+        {
+            return _m_shards[((uintptr_t)addr >> 6) % SHARDS];
+        }
+
+    private:
+        Shard _m_shards[SHARDS];
+        // 所有地址上的等待者总数，为0时解锁、signal不用查表
+        std::atomic<int> _m_count{0};
+    };
+
+    // 不销毁：进程退出时其他线程可能还在解锁
+    static WaitTable &mutex_waits()
+    {
+        static WaitTable *s_table = new WaitTable();
+        return *s_table;
+    }
+
+    static WaitTable &cond_waits()
+    {
+        static WaitTable *s_table = new WaitTable();
+        return *s_table;
+    }
+
+    // hook内部的操作：其中的加锁（等待队列、调度器）都走原始实现
+    template <typename F>
+    static void internal(F &&f)
+    {
+        bool saved = t_in_pthread_hook;
+        t_in_pthread_hook = true;
+        f();
+        t_in_pthread_hook = saved;
+    }
+
+    // 解锁、signal之后唤醒等在addr上的协程；hook内部的锁走原始实现，不会有协程等在上面，直接跳过（也避免了递归）
+    static void wake_waiters(WaitTable &table, const void *addr, bool all)
+    {
+        if (t_in_pthread_hook)
+        {
+            return;
+        }
+        internal([&]() { table.wake(addr, all); });
+    }
+
+    bool is_pthread_hook_enable()
+    {
+        return s_pthread_hook_enable.load(std::memory_order_relaxed);
+    }
+
+    void set_pthread_hook_enable(bool flag)
+    {
+        pthread_hook_init();
+        s_pthread_hook_enable = flag;
+    }
+
+    void pthread_hook_init()
+    {
+        static bool is_inited = false;
+        if (is_inited)
+        {
+            return;
+        }
+
+#define XX(name) name##_f = (name##_fun)dlsym(RTLD_NEXT, #name);
+        PTHREAD_HOOK_FUN(XX)
+#undef XX
+#if defined(__GLIBC__) && defined(__x86_64__)
+        // x86_64的glibc里pthread_cond_*还有一套GLIBC_2.2.5的旧实现，dlsym可能取到它，和现在的pthread_cond_t布局不兼容
+#define XX(name)                                                 \
+        if (void *sym = dlvsym(RTLD_NEXT, #name, "GLIBC_2.3.2")) \
+        {                                                        \
+            name##_f = (name##_fun)sym;                          \
+        }
+        XX(pthread_cond_wait)
+        XX(pthread_cond_timedwait)
+        XX(pthread_cond_signal)
+        XX(pthread_cond_broadcast)
+#undef XX
+#endif
+        is_inited = true;
+    }
+
+    // 是否走协程版本
+    static bool fibered()
+    {
+        return s_pthread_hook_enable.load(std::memory_order_relaxed) && is_hook_enable() && !t_in_pthread_hook && Scheduler::InTaskFiber();
+    }
+
+    // 库内部可能在登记了等待者、还没yield的时候加锁（比如select依次登记到多个通道），
+    // 这时挂起的协程可能被外层的唤醒提前恢复：这次恢复属于外层之后的yield。
+    // 自己的唤醒权抢不到说明自己的唤醒已经在路上，它会顶替外层的那一次；
+    // 抢到了就欠外层一次恢复，返回true，调用方要把waiter从等待队列里删掉，并在最后用repay()补上
+    static bool resumed_early(const std::shared_ptr<FiberWaiter> &waiter)
+    {
+        if (waiter->result() == FiberWaiter::WAITING && waiter->claim(FiberWaiter::TIMEOUT))
+        {
+            // 自己的唤醒不会再来，wait()里登记的挂起计数也要自己扣掉
+            Scheduler::GetThis()->addParkedFiber(-1);
+            return true;
+        }
+        return false;
+    }
+
+    // 把协程放回任务队列debts次，补上被提前消耗的外层恢复；协程yield之后调度器才能拿到它
+    static void repay(int debts)
+    {
+        if (debts > 0)
+        {
+            internal([&]()
+            {
+                for (int i = 0; i < debts; ++i)
+                {
+                    Scheduler::GetThis()->scheduleLock(Fiber::GetThis());
+                }
+            });
+        }
+    }
+
+    static int mutex_lock_fibered(pthread_mutex_t *mutex)
+    {
+        for (int i = 0; i < MUTEX_SPIN; ++i)
+        {
+            int rt = pthread_mutex_trylock_f(mutex);
+            if (rt != EBUSY)
+            {
+                return rt;
+            }
+        }
+
+        // 被外层的唤醒提前恢复的次数，拿到锁之后补上（见resumed_early）
+        int debts = 0;
+        bool timed = IOManager::GetThis() != nullptr;
+        uint64_t retry_ms = 1;
+        int rt;
+        while (true)
+        {
+            std::shared_ptr<FiberWaiter> waiter = std::make_shared<FiberWaiter>(timed, false);
+            internal([&]() { mutex_waits().push(mutex, waiter); });
+            // 登记之后再试一次：解锁发生在登记之前时不会有人唤醒
+            rt = pthread_mutex_trylock_f(mutex);
+            if (rt != EBUSY)
+            {
+                // 唤醒方可能已经取走并唤醒了它，抢不到说明唤醒已经在路上，要把它消化掉
+                internal([&]() { mutex_waits().remove(mutex, waiter); });
+                if (waiter->claim())
+                {
+                    break;
+                }
+            }
+            if (timed)
+            {
+                waiter->waitFor(retry_ms);
+                retry_ms = std::min(retry_ms * 2, MUTEX_RETRY_MAX_MS);
+            }
+            else
+            {
+                waiter->wait();
+            }
+            if (resumed_early(waiter))
+            {
+                ++debts;
+            }
+            internal([&]() { mutex_waits().remove(mutex, waiter); });
+            if (rt != EBUSY)
+            {
+                break;
+            }
+            rt = pthread_mutex_trylock_f(mutex);
+            if (rt != EBUSY)
+            {
+                break;
+            }
+        }
+        repay(debts);
+        return rt;
+    }
+
+    static int cond_wait_fibered(pthread_cond_t *cond, pthread_mutex_t *mutex, const struct timespec *abstime)
+    {
+        uint64_t timeout_ms = 0;
+        if (abstime)
+        {
+            struct timespec now;
+            clock_gettime(CLOCK_REALTIME, &now);
+            int64_t ns = (int64_t)(abstime->tv_sec - now.tv_sec) * 1000000000 + (abstime->tv_nsec - now.tv_nsec);
+            if (ns <= 0)
+            {
+                return ETIMEDOUT;
+            }
+            timeout_ms = (ns + 999999) / 1000000;
+        }
+
+        // pthread_cond_wait不能返回ECANCELED，等待不响应TaskGroup的取消
+        std::shared_ptr<FiberWaiter> waiter = std::make_shared<FiberWaiter>(abstime != nullptr, false);
+        internal([&]() { cond_waits().push(cond, waiter); });
+        // 登记之后才解锁：解锁后发出的signal一定能看到这个等待者
+        pthread_mutex_unlock(mutex);
+        bool notified = true;
+        if (abstime)
+        {
+            notified = waiter->waitFor(timeout_ms);
+        }
+        else
+        {
+            waiter->wait();
+        }
+        // 被外层的唤醒提前恢复时按虚假唤醒返回0（条件变量允许），
+        // 等待者必须从队列里删掉，否则之后的signal会取到它，去恢复一个正在运行的协程
+        bool early = resumed_early(waiter);
+        if (!notified || early)
+        {
+            internal([&]() { cond_waits().remove(cond, waiter); });
+        }
+
+        int rt = mutex_lock_fibered(mutex);
+        repay(early ? 1 : 0);
+        if (rt != 0)
+        {
+            return rt;
+        }
+        return notified ? 0 : ETIMEDOUT;
+    }
+}
+
+extern "C"
+{
+    int pthread_mutex_lock(pthread_mutex_t *mutex)
+    {
+        if (!pthread_mutex_lock_f)
+        {
+            nsCoroutine::pthread_hook_init();
+        }
+        if (!nsCoroutine::fibered())
+        {
+            return pthread_mutex_lock_f(mutex);
+        }
+        return nsCoroutine::mutex_lock_fibered(mutex);
+    }
+
+    int pthread_cond_wait(pthread_cond_t *cond, pthread_mutex_t *mutex)
+    {
+        if (!pthread_cond_wait_f)
+        {
+            nsCoroutine::pthread_hook_init();
+        }
+        if (!nsCoroutine::fibered())
+        {
+            return pthread_cond_wait_f(cond, mutex);
+        }
+        return nsCoroutine::cond_wait_fibered(cond, mutex, nullptr);
+    }
+
+    int pthread_cond_timedwait(pthread_cond_t *cond, pthread_mutex_t *mutex, const struct timespec *abstime)
+    {
+        if (!pthread_cond_timedwait_f)
+        {
+            nsCoroutine::pthread_hook_init();
+        }
+        if (!nsCoroutine::fibered())
+        {
+            return pthread_cond_timedwait_f(cond, mutex, abstime);
+        }
+        return nsCoroutine::cond_wait_fibered(cond, mutex, abstime);
+    }
+
+    int pthread_mutex_unlock(pthread_mutex_t *mutex)
+    {
+        if (!pthread_mutex_unlock_f)
+        {
+            nsCoroutine::pthread_hook_init();
+        }
+        int rt = pthread_mutex_unlock_f(mutex);
+        nsCoroutine::wake_waiters(nsCoroutine::mutex_waits(), mutex, false);
+        return rt;
+    }
+
+    // 线程等待者由原始实现唤醒，协程等待者由hook唤醒，两边都有时可能多唤醒一个（条件变量允许虚假唤醒）
+    int pthread_cond_signal(pthread_cond_t *cond)
+    {
+        if (!pthread_cond_signal_f)
+        {
+            nsCoroutine::pthread_hook_init();
+        }
+        int rt = pthread_cond_signal_f(cond);
+        nsCoroutine::wake_waiters(nsCoroutine::cond_waits(), cond, false);
+        return rt;
+    }
+
+    int pthread_cond_broadcast(pthread_cond_t *cond)
+    {
+        if (!pthread_cond_broadcast_f)
+        {
+            nsCoroutine::pthread_hook_init();
+        }
+        int rt = pthread_cond_broadcast_f(cond);
+        nsCoroutine::wake_waiters(nsCoroutine::cond_waits(), cond, true);
+        return rt;
+    }
+}
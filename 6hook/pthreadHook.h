@@ -0,0 +1,57 @@
+#pragma once
+
+#include <pthread.h>
+#include <time.h>
+
+// 可选的pthread互斥锁/条件变量hook
+// 旧代码里的pthread_mutex_lock/pthread_cond_wait在竞争时阻塞整个工作线程，
+// 持有锁的如果是同一线程上挂起的协程（比如持锁做了hook过的I/O），阻塞线程就是死锁。
+// 打开开关后，在开启hook的任务协程里：
+//  pthread_mutex_lock  先自旋trylock几次，拿不到就挂起协程，hook的pthread_mutex_unlock唤醒它，同时定时重试
+//  pthread_cond_wait   协程挂在按条件变量地址登记的等待队列上，释放互斥锁后挂起；pthread_cond_signal/broadcast同时唤醒其中的协程
+// 不在协程里、线程没有开启hook或者开关关闭时直接调用原始实现
+//
+//  nsCoroutine::set_pthread_hook_enable(true);
+//
+// 限制：pthread互斥锁的持有者是线程，同一线程上的协程之间递归锁不互斥、检错锁不报EDEADLK；
+// 持锁挂起后可能在别的线程上恢复，这时只有普通锁允许解锁；pthread_cond_timedwait按CLOCK_REALTIME计算超时
+
+namespace nsCoroutine
+{
+    // 进程级开关，默认关闭
+    bool is_pthread_hook_enable();
+    void set_pthread_hook_enable(bool flag);
+    // 用dlsym取得原始函数；静态初始化期间就可能有人加锁，每个hook在第一次调用时检查
+    void pthread_hook_init();
+}
+
+extern "C"
+{
+    typedef int (*pthread_mutex_lock_fun)(pthread_mutex_t *mutex);
+    extern pthread_mutex_lock_fun pthread_mutex_lock_f;
+
+    typedef int (*pthread_mutex_trylock_fun)(pthread_mutex_t *mutex);
+    extern pthread_mutex_trylock_fun pthread_mutex_trylock_f;
+
+    typedef int (*pthread_mutex_unlock_fun)(pthread_mutex_t *mutex);
+    extern pthread_mutex_unlock_fun pthread_mutex_unlock_f;
+
+    typedef int (*pthread_cond_wait_fun)(pthread_cond_t *cond, pthread_mutex_t *mutex);
+    extern pthread_cond_wait_fun pthread_cond_wait_f;
+
+    typedef int (*pthread_cond_timedwait_fun)(pthread_cond_t *cond, pthread_mutex_t *mutex, const struct timespec *abstime);
+    extern pthread_cond_timedwait_fun pthread_cond_timedwait_f;
+
+    typedef int (*pthread_cond_signal_fun)(pthread_cond_t *cond);
+    extern pthread_cond_signal_fun pthread_cond_signal_f;
+
+    typedef int (*pthread_cond_broadcast_fun)(pthread_cond_t *cond);
+    extern pthread_cond_broadcast_fun pthread_cond_broadcast_f;
+
+    int pthread_mutex_lock(pthread_mutex_t *mutex);
+    int pthread_mutex_unlock(pthread_mutex_t *mutex);
+    int pthread_cond_wait(pthread_cond_t *cond, pthread_mutex_t *mutex);
+    int pthread_cond_timedwait(pthread_cond_t *cond, pthread_mutex_t *mutex, const struct timespec *abstime);
+    int pthread_cond_signal(pthread_cond_t *cond);
+    int pthread_cond_broadcast(pthread_cond_t *cond);
+}
@@ -0,0 +1,703 @@
+#include "resolver.h"
+#include "deadline.h"
+#include "hook.h"
+#include "scheduler.h"
+#include "log.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace nsCoroutine
+{
+    static const uint16_t TYPE_A = 1;
+    static const uint16_t TYPE_CNAME = 5;
+    static const uint16_t TYPE_SOA = 6;
+    static const uint16_t TYPE_AAAA = 28;
+    static const uint16_t CLASS_IN = 1;
+    // 应答里没有SOA时否定缓存的时间(s)
+    static const uint32_t NEGATIVE_TTL = 30;
+    // 缓存条目上限，满了先清理过期的，还是满的就全部清空
+    static const size_t MAX_CACHE_ENTRIES = 10000;
+
+    struct Resolver::Query
+    {
+        enum State
+        {
+            PENDING,      // 等待应答
+            ANSWERED,     // 有地址
+            NEGATIVE,     // NXDOMAIN或者没有这个类型的记录
+            TRUNCATED,    // 应答被截断，要用TCP重新查询
+            SERVER_ERROR, // SERVFAIL/REFUSED/格式错误，换下一个服务器
+        };
+
+        uint16_t qtype;
+        uint16_t id = 0;
+        State state = PENDING;
+        bool fresh = false; // 这次从服务器拿到的结果，需要写入缓存
+        uint32_t ttl = 0;
+        std::vector<std::string> addrs;
+    };
+
+    static uint16_t get16(const unsigned char *p)
+    {
+        return (uint16_t)((p[0] << 8) | p[1]);
+    }
+
+    static uint32_t get32(const unsigned char *p)
+    {
+        return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+    }
+
+    static void put16(std::string &out, uint16_t v)
+    {
+        out.push_back((char)(v >> 8));
+        out.push_back((char)(v & 0xff));
+    }
+
+    // 域名不区分大小写，末尾的'.'去掉
+    static std::string canonical_name(const std::string &name)
+    {
+        std::string out = name;
+        std::transform(out.begin(), out.end(), out.begin(), [](unsigned char c) { return std::tolower(c); });
+        if (!out.empty() && out.back() == '.')
+        {
+            out.pop_back();
+        }
+        return out;
+    }
+
+    static bool valid_name(const std::string &name)
+    {
+        if (name.empty() || name.size() > 253)
+        {
+            return false;
+        }
+        size_t begin = 0;
+        while (begin <= name.size())
+        {
+            size_t end = name.find('.', begin);
+            if (end == std::string::npos)
+            {
+                end = name.size();
+            }
+            if (end == begin || end - begin > 63)
+            {
+                return false;
+            }
+            begin = end + 1;
+        }
+        return true;
+    }
+
+    static int64_t file_mtime(const std::string &path)
+    {
+        struct stat st;
+        if (path.empty() || stat(path.c_str(), &st) != 0)
+        {
+            return -1;
+        }
+        return (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+    }
+
+    static bool parse_server(const std::string &text, struct sockaddr_storage &addr, socklen_t &len)
+    {
+        std::string host = text;
+        uint16_t port = 53;
+        size_t colon = text.rfind(':');
+        if (!text.empty() && text[0] == '[')
+        {
+            size_t close = text.find(']');
+            if (close == std::string::npos)
+            {
+                return false;
+            }
+            host = text.substr(1, close - 1);
+            if (close + 1 < text.size())
+            {
+                if (text[close + 1] != ':')
+                {
+                    return false;
+                }
+                port = (uint16_t)atoi(text.c_str() + close + 2);
+            }
+        }
+        else if (colon != std::string::npos && text.find(':') == colon)
+        {
+            // 只有一个':'是IPv4加端口
+            host = text.substr(0, colon);
+            port = (uint16_t)atoi(text.c_str() + colon + 1);
+        }
+
+        memset(&addr, 0, sizeof(addr));
+        struct sockaddr_in *v4 = (struct sockaddr_in *)&addr;
+        struct sockaddr_in6 *v6 = (struct sockaddr_in6 *)&addr;
+        if (inet_pton(AF_INET, host.c_str(), &v4->sin_addr) == 1)
+        {
+            v4->sin_family = AF_INET;
+            v4->sin_port = htons(port);
+            len = sizeof(*v4);
+            return true;
+        }
+        if (inet_pton(AF_INET6, host.c_str(), &v6->sin6_addr) == 1)
+        {
+            v6->sin6_family = AF_INET6;
+            v6->sin6_port = htons(port);
+            len = sizeof(*v6);
+            return true;
+        }
+        return false;
+    }
+
+    // hosts文件：每行一个地址，后面是主机名和别名，'#'之后是注释
+    static void load_hosts(const std::string &path, std::map<std::string, std::vector<std::string>> &hosts)
+    {
+        std::ifstream in(path);
+        std::string line;
+        while (std::getline(in, line))
+        {
+            line = line.substr(0, line.find('#'));
+            std::istringstream fields(line);
+            std::string addr, name;
+            unsigned char buf[sizeof(struct in6_addr)];
+            if (!(fields >> addr) || (inet_pton(AF_INET, addr.c_str(), buf) != 1 && inet_pton(AF_INET6, addr.c_str(), buf) != 1))
+            {
+                continue;
+            }
+            while (fields >> name)
+            {
+                hosts[canonical_name(name)].push_back(addr);
+            }
+        }
+    }
+
+    // resolv.conf里用到的只有nameserver和options timeout:n attempts:n
+    static void load_resolv(std::vector<std::pair<struct sockaddr_storage, socklen_t>> &servers, uint64_t *timeout, int *attempts)
+    {
+        std::ifstream in("/etc/resolv.conf");
+        std::string line;
+        while (std::getline(in, line))
+        {
+            std::istringstream fields(line);
+            std::string key, value;
+            if (!(fields >> key))
+            {
+                continue;
+            }
+            if (key == "nameserver" && fields >> value)
+            {
+                struct sockaddr_storage addr;
+                socklen_t len;
+                if (parse_server(value, addr, len))
+                {
+                    servers.emplace_back(addr, len);
+                }
+            }
+            else if (key == "options")
+            {
+                while (fields >> value)
+                {
+                    if (timeout && value.compare(0, 8, "timeout:") == 0)
+                    {
+                        *timeout = std::max(1, atoi(value.c_str() + 8)) * 1000;
+                    }
+                    else if (attempts && value.compare(0, 9, "attempts:") == 0)
+                    {
+                        *attempts = std::max(1, atoi(value.c_str() + 9));
+                    }
+                }
+            }
+        }
+    }
+
+    // 读取pos处的域名（跟随压缩指针），返回域名之后的位置，格式错误返回0
+    static size_t read_name(const unsigned char *buf, size_t len, size_t pos, std::string *name)
+    {
+        size_t next = 0;
+        size_t total = 0;
+        // 压缩指针最多跟随64次，防止指针成环
+        for (int jumps = 0; jumps < 64;)
+        {
+            if (pos >= len)
+            {
+                return 0;
+            }
+            uint8_t c = buf[pos];
+            if (c == 0)
+            {
+                return next ? next : pos + 1;
+            }
+            if ((c & 0xc0) == 0xc0)
+            {
+                if (pos + 1 >= len)
+                {
+                    return 0;
+                }
+                if (!next)
+                {
+                    next = pos + 2;
+                }
+                pos = ((c & 0x3f) << 8) | buf[pos + 1];
+                ++jumps;
+                continue;
+            }
+            if ((c & 0xc0) || pos + 1 + c > len || (total += c + 1) > 255)
+            {
+                return 0;
+            }
+            if (name)
+            {
+                if (!name->empty())
+                {
+                    name->push_back('.');
+                }
+                name->append((const char *)buf + pos + 1, c);
+            }
+            pos += 1 + c;
+        }
+        return 0;
+    }
+
+    static void build_query(const std::string &name, uint16_t id, uint16_t qtype, std::string &out)
+    {
+        out.clear();
+        put16(out, id);
+        put16(out, 0x0100); // RD：请服务器递归查询
+        put16(out, 1);      // QDCOUNT
+        put16(out, 0);
+        put16(out, 0);
+        put16(out, 0);
+        size_t begin = 0;
+        while (begin < name.size())
+        {
+            size_t end = std::min(name.find('.', begin), name.size());
+            out.push_back((char)(end - begin));
+            out.append(name, begin, end - begin);
+            begin = end + 1;
+        }
+        out.push_back(0);
+        put16(out, qtype);
+        put16(out, CLASS_IN);
+    }
+
+    bool Resolver::ParseResponse(const unsigned char *buf, size_t len, const std::string &name, Query &q)
+    {
+        if (len < 12 || get16(buf) != q.id)
+        {
+            return false;
+        }
+        uint16_t flags = get16(buf + 2);
+        uint16_t qdcount = get16(buf + 4);
+        uint16_t ancount = get16(buf + 6);
+        uint16_t nscount = get16(buf + 8);
+        // 必须是应答（QR），并且问题和查询的一致
+        if (!(flags & 0x8000) || qdcount != 1)
+        {
+            return false;
+        }
+        std::string qname;
+        size_t pos = read_name(buf, len, 12, &qname);
+        if (!pos || pos + 4 > len || canonical_name(qname) != name || get16(buf + pos) != q.qtype || get16(buf + pos + 2) != CLASS_IN)
+        {
+            return false;
+        }
+        pos += 4;
+
+        if (flags & 0x0200)
+        {
+            q.state = Query::TRUNCATED;
+            return true;
+        }
+        int rcode = flags & 0x0f;
+        // 3是NXDOMAIN，其他非0的（SERVFAIL、REFUSED...）换下一个服务器
+        if (rcode != 0 && rcode != 3)
+        {
+            q.state = Query::SERVER_ERROR;
+            return true;
+        }
+
+        uint32_t ttl = UINT32_MAX;
+        std::vector<std::string> addrs;
+        // 应答部分：CNAME链和最终的地址记录，整个链的有效期取最小的TTL
+        for (int i = 0; i < ancount + nscount; ++i)
+        {
+            pos = read_name(buf, len, pos, nullptr);
+            if (!pos || pos + 10 > len || pos + 10 + get16(buf + pos + 8) > len)
+            {
+                q.state = Query::SERVER_ERROR;
+                return true;
+            }
+            uint16_t type = get16(buf + pos);
+            uint16_t cls = get16(buf + pos + 2);
+            uint32_t rttl = get32(buf + pos + 4);
+            uint16_t rdlen = get16(buf + pos + 8);
+            const unsigned char *rdata = buf + pos + 10;
+            pos += 10 + rdlen;
+            if (cls != CLASS_IN)
+            {
+                continue;
+            }
+            if (i < ancount)
+            {
+                if (type == q.qtype && rdlen == (q.qtype == TYPE_A ? 4 : 16))
+                {
+                    char text[INET6_ADDRSTRLEN];
+                    inet_ntop(q.qtype == TYPE_A ? AF_INET : AF_INET6, rdata, text, sizeof(text));
+                    addrs.push_back(text);
+                    ttl = std::min(ttl, rttl);
+                }
+                else if (type == TYPE_CNAME)
+                {
+                    ttl = std::min(ttl, rttl);
+                }
+            }
+            else if (type == TYPE_SOA && addrs.empty())
+            {
+                // 否定应答的有效期是SOA记录的TTL和SOA里MINIMUM字段中较小的一个（RFC 2308）
+                size_t p = read_name(buf, len, rdata - buf, nullptr);
+                p = p ? read_name(buf, len, p, nullptr) : 0;
+                if (p && p + 20 <= (size_t)(rdata - buf) + rdlen)
+                {
+                    ttl = std::min(rttl, get32(buf + p + 16));
+                }
+            }
+        }
+
+        q.addrs = std::move(addrs);
+        q.state = q.addrs.empty() ? Query::NEGATIVE : Query::ANSWERED;
+        q.ttl = ttl == UINT32_MAX ? (q.addrs.empty() ? NEGATIVE_TTL : 0) : ttl;
+        q.fresh = true;
+        return true;
+    }
+
+    int Resolver::exchange(const struct sockaddr_storage &server, socklen_t server_len, const std::string &name, std::vector<Query> &queries, uint64_t timeout_ms)
+    {
+        // 用的都是hook过的调用：套接字登记到FdManager，等待应答时挂起协程
+        int fd = socket(server.ss_family, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+        if (fd < 0)
+        {
+            return 0;
+        }
+        // connect之后内核只交付这个服务器发来的报文，ICMP端口不可达也会让recv立即返回ECONNREFUSED
+        if (connect(fd, (const struct sockaddr *)&server, server_len) != 0)
+        {
+            close(fd);
+            return 0;
+        }
+
+        static thread_local std::mt19937 rng(std::random_device{}());
+        std::string packet;
+        for (auto &q : queries)
+        {
+            if (q.state == Query::PENDING)
+            {
+                q.id = (uint16_t)rng();
+                build_query(name, q.id, q.qtype, packet);
+                send(fd, packet.data(), packet.size(), 0);
+                ++_m_queries;
+            }
+        }
+
+        int rt = 0;
+        {
+            DeadlineScope budget(timeout_ms);
+            unsigned char buf[1500];
+            auto pending = [&queries]()
+            {
+                return std::any_of(queries.begin(), queries.end(), [](const Query &q) { return q.state == Query::PENDING; });
+            };
+            while (pending())
+            {
+                ssize_t n = recv(fd, buf, sizeof(buf), 0);
+                if (n < 0)
+                {
+                    if (errno == EINTR)
+                    {
+                        continue;
+                    }
+                    rt = errno == ECANCELED ? -1 : 0;
+                    break;
+                }
+                for (auto &q : queries)
+                {
+                    if (q.state == Query::PENDING && ParseResponse(buf, n, name, q))
+                    {
+                        break;
+                    }
+                }
+            }
+        }
+        close(fd);
+        // 等待超时也可能是调用方的截止时间到了，这时不再尝试别的服务器
+        if (rt == 0 && deadline_left_ms() == 0)
+        {
+            errno = ETIMEDOUT;
+            rt = -1;
+        }
+        return rt;
+    }
+
+    int Resolver::lookup(const std::string &host, int family, std::vector<std::string> &addrs)
+    {
+        // 不在任务协程里或者没有开启hook，下面的套接字调用会阻塞线程，不如交给libc
+        if (!Scheduler::InTaskFiber() || !is_hook_enable())
+        {
+            return FALLBACK;
+        }
+        if (family != AF_UNSPEC && family != AF_INET && family != AF_INET6)
+        {
+            return EAI_FAMILY;
+        }
+        std::string name = canonical_name(host);
+        if (!valid_name(name))
+        {
+            return EAI_NONAME;
+        }
+
+        std::vector<Query> queries;
+        for (uint16_t qtype : {TYPE_A, TYPE_AAAA})
+        {
+            if (family == AF_UNSPEC || family == (qtype == TYPE_A ? AF_INET : AF_INET6))
+            {
+                queries.emplace_back();
+                queries.back().qtype = qtype;
+            }
+        }
+
+        std::vector<std::pair<struct sockaddr_storage, socklen_t>> servers;
+        uint64_t timeout;
+        int attempts;
+        uint32_t max_ttl;
+        {
+            std::lock_guard<std::mutex> lock(_m_mutex);
+            reloadLocked();
+            // 先查hosts文件，有这个地址族的地址就不再查DNS
+            auto it = _m_hosts.find(name);
+            if (it != _m_hosts.end())
+            {
+                size_t before = addrs.size();
+                for (auto &addr : it->second)
+                {
+                    int addr_family = addr.find(':') == std::string::npos ? AF_INET : AF_INET6;
+                    if (family == AF_UNSPEC || family == addr_family)
+                    {
+                        addrs.push_back(addr);
+                    }
+                }
+                if (addrs.size() > before)
+                {
+                    return 0;
+                }
+            }
+
+            uint64_t now = NowMonoMs();
+            for (auto &q : queries)
+            {
+                auto cached = _m_cache.find({name, q.qtype});
+                if (cached != _m_cache.end() && cached->second.expire > now)
+                {
+                    ++_m_cacheHits;
+                    q.addrs = cached->second.addrs;
+                    q.state = q.addrs.empty() ? Query::NEGATIVE : Query::ANSWERED;
+                }
+            }
+            servers = _m_servers;
+            timeout = _m_timeout;
+            attempts = _m_attempts;
+            max_ttl = _m_maxTtl;
+        }
+
+        // A和AAAA在同一个套接字上同时发出，一个服务器没有应答或者出错时换下一个，所有服务器轮流attempts轮
+        for (int attempt = 0; attempt < attempts; ++attempt)
+        {
+            for (auto &server : servers)
+            {
+                bool pending = false;
+                for (auto &q : queries)
+                {
+                    if (q.state == Query::SERVER_ERROR)
+                    {
+                        q.state = Query::PENDING;
+                    }
+                    pending = pending || q.state == Query::PENDING;
+                }
+                if (!pending)
+                {
+                    break;
+                }
+                if (exchange(server.first, server.second, name, queries, timeout) < 0)
+                {
+                    return EAI_SYSTEM;
+                }
+            }
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(_m_mutex);
+            uint64_t now = NowMonoMs();
+            for (auto &q : queries)
+            {
+                uint32_t ttl = std::min(q.ttl, max_ttl);
+                if (!q.fresh || ttl == 0)
+                {
+                    continue;
+                }
+                if (_m_cache.size() >= MAX_CACHE_ENTRIES)
+                {
+                    for (auto it = _m_cache.begin(); it != _m_cache.end();)
+                    {
+                        it = it->second.expire <= now ? _m_cache.erase(it) : std::next(it);
+                    }
+                    if (_m_cache.size() >= MAX_CACHE_ENTRIES)
+                    {
+                        _m_cache.clear();
+                    }
+                }
+                CacheEntry &entry = _m_cache[{name, q.qtype}];
+                entry.addrs = q.addrs;
+                entry.expire = now + (uint64_t)ttl * 1000;
+            }
+        }
+
+        bool found = false;
+        bool again = false;
+        for (auto &q : queries)
+        {
+            if (q.state == Query::TRUNCATED)
+            {
+                return FALLBACK;
+            }
+            found = found || q.state == Query::ANSWERED;
+            again = again || q.state == Query::PENDING || q.state == Query::SERVER_ERROR;
+        }
+        if (!found)
+        {
+            return again ? EAI_AGAIN : EAI_NONAME;
+        }
+        for (auto &q : queries)
+        {
+            addrs.insert(addrs.end(), q.addrs.begin(), q.addrs.end());
+        }
+        return 0;
+    }
+
+    void Resolver::reloadLocked()
+    {
+        uint64_t now = NowMonoMs();
+        if (_m_lastCheck && now - _m_lastCheck < 1000)
+        {
+            return;
+        }
+        _m_lastCheck = now;
+
+        // 文件很小并且只在修改后读一次，直接在当前线程读
+        int64_t mtime = file_mtime(_m_hostsFile);
+        if (mtime != _m_hostsMtime)
+        {
+            _m_hosts.clear();
+            if (mtime >= 0)
+            {
+                load_hosts(_m_hostsFile, _m_hosts);
+            }
+            _m_hostsMtime = mtime;
+        }
+
+        if (_m_customServers)
+        {
+            return;
+        }
+        mtime = file_mtime("/etc/resolv.conf");
+        if (mtime != _m_resolvMtime)
+        {
+            _m_servers.clear();
+            load_resolv(_m_servers, _m_customOptions ? nullptr : &_m_timeout, _m_customOptions ? nullptr : &_m_attempts);
+            // 和libc一样，没有配置服务器时使用本机
+            if (_m_servers.empty())
+            {
+                _m_servers.emplace_back();
+                parse_server("127.0.0.1", _m_servers.back().first, _m_servers.back().second);
+            }
+            _m_resolvMtime = mtime;
+            _m_cache.clear();
+        }
+    }
+
+    void Resolver::setNameservers(const std::vector<std::string> &servers)
+    {
+        std::lock_guard<std::mutex> lock(_m_mutex);
+        _m_servers.clear();
+        for (auto &text : servers)
+        {
+            struct sockaddr_storage addr;
+            socklen_t len;
+            if (parse_server(text, addr, len))
+            {
+                _m_servers.emplace_back(addr, len);
+            }
+            else
+            {
+                LOG_ERROR("Resolver::setNameservers invalid server: {}", text);
+            }
+        }
+        _m_customServers = true;
+        _m_cache.clear();
+    }
+
+    void Resolver::setHostsFile(const std::string &path)
+    {
+        std::lock_guard<std::mutex> lock(_m_mutex);
+        _m_hostsFile = path;
+        _m_hostsMtime = -2;
+        _m_lastCheck = 0;
+    }
+
+    void Resolver::setTimeout(uint64_t ms)
+    {
+        std::lock_guard<std::mutex> lock(_m_mutex);
+        _m_timeout = ms;
+        _m_customOptions = true;
+    }
+
+    void Resolver::setAttempts(int attempts)
+    {
+        std::lock_guard<std::mutex> lock(_m_mutex);
+        _m_attempts = std::max(1, attempts);
+        _m_customOptions = true;
+    }
+
+    void Resolver::setMaxTtl(uint32_t seconds)
+    {
+        std::lock_guard<std::mutex> lock(_m_mutex);
+        _m_maxTtl = seconds;
+    }
+
+    void Resolver::clearCache()
+    {
+        std::lock_guard<std::mutex> lock(_m_mutex);
+        _m_cache.clear();
+    }
+
+    uint64_t Resolver::getQueries()
+    {
+        return _m_queries;
+    }
+
+    uint64_t Resolver::getCacheHits()
+    {
+        return _m_cacheHits;
+    }
+
+    Resolver *Resolver::GetInstance()
+    {
+        // 和卸载池一样不销毁：进程退出时可能还有协程在查询
+        static Resolver *s_resolver = new Resolver();
+        return s_resolver;
+    }
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <sys/socket.h>
+
+// 协程版的域名解析
+// libc的getaddrinfo在查询DNS时阻塞工作线程，即使命中/etc/hosts每次也要重新读文件解析。
+// Resolver用hook过的UDP套接字查询DNS，等待应答时只挂起当前协程；
+// 查询结果按应答里的TTL缓存在进程内，NXDOMAIN/没有记录按SOA的TTL做否定缓存；/etc/hosts解析一次，文件修改后重新加载
+// hook的getaddrinfo在任务协程里使用它（见hook.cc）
+//
+//  std::vector<std::string> addrs;
+//  int rt = Resolver::GetInstance()->lookup("example.com", AF_UNSPEC, addrs);   // addrs = {"93.184.215.14", "2606:..."}
+//
+// 只实现了nsswitch里最常见的"files dns"：不支持search/ndots（名字按绝对域名查询）、mDNS等其他来源；
+// 应答被截断（TC）时返回FALLBACK，由调用方退回libc
+
+namespace nsCoroutine
+{
+    class Resolver
+    {
+    public:
+        // lookup的返回值：这个名字要交给libc解析（不在开启hook的任务协程里、应答被截断）
+        static const int FALLBACK = 1;
+
+        Resolver() = default;
+        Resolver(const Resolver &) = delete;
+        Resolver &operator=(const Resolver &) = delete;
+
+        // 解析name，family为AF_INET/AF_INET6/AF_UNSPEC（同时查A和AAAA，IPv4在前），地址以数字形式追加到addrs
+        // 成功返回0，失败返回getaddrinfo的错误码（EAI_NONAME、EAI_AGAIN...）或FALLBACK；协程被取消时返回EAI_SYSTEM且errno = ECANCELED
+        int lookup(const std::string &name, int family, std::vector<std::string> &addrs);
+
+        // DNS服务器，"1.2.3.4"、"1.2.3.4:5353"、"::1"、"[::1]:5353"；设置后不再读取/etc/resolv.conf
+        void setNameservers(const std::vector<std::string> &servers);
+        // hosts文件路径，默认/etc/hosts，设置为空字符串不使用hosts文件
+        void setHostsFile(const std::string &path);
+        // 每个服务器每次查询等待应答的时间和重试轮数，默认取/etc/resolv.conf的options，否则5000ms、2轮
+        void setTimeout(uint64_t ms);
+        void setAttempts(int attempts);
+        // 缓存时间的上限(s)，默认3600
+        void setMaxTtl(uint32_t seconds);
+        void clearCache();
+
+        // 发出的DNS查询数和命中缓存的次数
+        uint64_t getQueries();
+        uint64_t getCacheHits();
+
+        // 全局解析器，第一次调用时创建，进程退出前不销毁
+        static Resolver *GetInstance();
+
+    private:
+        struct CacheEntry
+        {
+            std::vector<std::string> addrs;
+            uint64_t expire = 0; // NowMonoMs()
+        };
+
+        struct Query;
+
+        // 文件修改后重新加载hosts和resolv.conf，最多每秒检查一次，调用时持有_m_mutex
+        void reloadLocked();
+        // 在一个服务器上发出所有还没完成的查询并等待应答，返回-1表示协程被取消或者调用方的截止时间已到
+        int exchange(const struct sockaddr_storage &server, socklen_t server_len, const std::string &name, std::vector<Query> &queries, uint64_t timeout_ms);
+        // 解析name的应答，不是这个查询的应答（id或者问题不匹配、迟到的重传应答）返回false
+        static bool ParseResponse(const unsigned char *buf, size_t len, const std::string &name, Query &q);
+
+    private:
+        std::mutex _m_mutex;
+        std::map<std::string, std::vector<std::string>> _m_hosts;
+        std::map<std::pair<std::string, uint16_t>, CacheEntry> _m_cache;
+        std::vector<std::pair<struct sockaddr_storage, socklen_t>> _m_servers;
+        bool _m_customServers = false;
+        bool _m_customOptions = false;
+        std::string _m_hostsFile = "/etc/hosts";
+        // 上次加载时文件的修改时间，-1表示文件不存在，-2表示还没加载过
+        int64_t _m_hostsMtime = -2;
+        int64_t _m_resolvMtime = -2;
+        uint64_t _m_lastCheck = 0;
+        uint64_t _m_timeout = 5000;
+        int _m_attempts = 2;
+        uint32_t _m_maxTtl = 3600;
+        std::atomic<uint64_t> _m_queries{0};
+        std::atomic<uint64_t> _m_cacheHits{0};
+    };
+}
@@ -0,0 +1,88 @@
+#include "schedulePolicy.h"
+
+namespace nsCoroutine
+{
+    void PriorityPolicy::push(ScheduleTask&& task)
+    {
+        _m_tasks[task._priority].push_back(std::move(task));
+    }
+
+    bool PriorityPolicy::take(ScheduleTask& task, int thread_id, bool& tickle_me)
+    {
+        //第一遍只看还有额度的队列；都取不到时开始新的一轮，第二遍按优先级从高到低取
+        for(int pass = 0; pass < 2; pass++)
+        {
+            for(int level = 0; level < Fiber::PRIORITY_LEVELS; level++)
+            {
+                std::vector<ScheduleTask>& tasks = _m_tasks[level];
+                if(tasks.empty() || (pass == 0 && _m_credits[level] == 0))
+                {
+                    continue;
+                }
+                auto it = tasks.begin();
+                while(it != tasks.end() && !runnable(*it, thread_id, tickle_me))
+                {
+                    it++;
+                }
+                if(it == tasks.end())
+                {
+                    continue;
+                }
+                assert(it->_fiber || it->_cb);
+                task = std::move(*it);
+                tasks.erase(it);
+                if(_m_credits[level] > 0)
+                {
+                    _m_credits[level]--;
+                }
+                //确保仍然存在未处理的任务
+                tickle_me = tickle_me || !empty();
+                return true;
+            }
+            if(pass == 0)
+            {
+                for(int level = 0; level < Fiber::PRIORITY_LEVELS; level++)
+                {
+                    _m_credits[level] = PRIORITY_WEIGHTS[level];
+                }
+            }
+        }
+        return false;
+    }
+
+    bool PriorityPolicy::empty() const
+    {
+        for(const auto& tasks : _m_tasks)
+        {
+            if(!tasks.empty())
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void EdfPolicy::push(ScheduleTask&& task)
+    {
+        uint64_t deadline = task._deadline ? task._deadline : UINT64_MAX;
+        _m_tasks.emplace(std::make_pair(deadline, _m_seq++), std::move(task));
+    }
+
+    bool EdfPolicy::take(ScheduleTask& task, int thread_id, bool& tickle_me)
+    {
+        auto it = _m_tasks.begin();
+        while(it != _m_tasks.end() && !runnable(it->second, thread_id, tickle_me))
+        {
+            it++;
+        }
+        if(it == _m_tasks.end())
+        {
+            return false;
+        }
+        assert(it->second._fiber || it->second._cb);
+        task = std::move(it->second);
+        _m_tasks.erase(it);
+        tickle_me = tickle_me || !_m_tasks.empty();
+        return true;
+    }
+}
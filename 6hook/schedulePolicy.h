@@ -0,0 +1,165 @@
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <utility>
+#include <vector>
+#include "fiber.h"
+
+// 调度策略：决定调度器的任务队列怎么存、下一个执行谁
+// 调度器在构造时接收策略对象（见Scheduler/IOManager的构造函数），不传时使用PriorityPolicy
+// 策略的所有方法都在调度器的锁内调用，实现不需要自己加锁，也不能在里面调用调度器的方法
+
+namespace nsCoroutine
+{
+    //任务
+    struct ScheduleTask
+    {
+        std::shared_ptr<Fiber> _fiber; //执行任务的协程对象 -- 调度对象是协程
+        std::function<void()> _cb;     //执行任务的函数指针 -- 调度对象是函数
+        int _thread; //指定任务需要运行的线程id
+        int _priority; //优先级，函数任务创建协程时设置给它
+        uint64_t _deadline; //截止时间（单调时钟ms，0表示没有），函数任务创建协程时设置给它
+
+        ScheduleTask()
+        {
+            _fiber = nullptr;
+            _cb = nullptr;
+            _thread = -1;
+            _priority = Fiber::PRIORITY_NORMAL;
+            _deadline = 0;
+        }
+
+        //协程+线程
+        //按值接收后移动，调用方传右值时全程没有引用计数的原子加减
+        ScheduleTask(std::shared_ptr<Fiber> f, int thr)
+        {
+            _fiber = std::move(f);
+            _thread = thr;
+            _priority = Fiber::PRIORITY_NORMAL;
+            _deadline = 0;
+        }
+
+        //协程+线程
+        ScheduleTask(std::shared_ptr<Fiber>* f, int thr)
+        {
+            //将内容转移也就是指针内部的转移和上面的赋值不同，引用计数不会增加
+            _fiber.swap(*f);
+            _thread = thr;
+            _priority = Fiber::PRIORITY_NORMAL;
+            _deadline = 0;
+        }
+
+        //函数+线程
+        ScheduleTask(std::function<void()> f, int thr)
+        {
+            _cb = std::move(f);
+            _thread = thr;
+            _priority = Fiber::PRIORITY_NORMAL;
+            _deadline = 0;
+        }
+
+        //函数+线程
+        ScheduleTask(std::function<void()>* f, int thr)
+        {
+            _cb.swap(*f);
+            _thread = thr;
+            _priority = Fiber::PRIORITY_NORMAL;
+            _deadline = 0;
+        }
+
+        //重置任务对象
+        void reset()
+        {
+            _fiber = nullptr;
+            _cb = nullptr;
+            _thread = -1;
+            _priority = Fiber::PRIORITY_NORMAL;
+            _deadline = 0;
+        }
+
+        //确定任务的优先级和截止时间
+        //协程任务：priority为-1时沿用协程的优先级，否则改为priority（以后再被放回队列也保持）；截止时间总是协程自己的
+        //函数任务：priority为-1时为PRIORITY_NORMAL，截止时间为deadline
+        void prepare(int priority, uint64_t deadline)
+        {
+            assert(priority < Fiber::PRIORITY_LEVELS);
+            if(_fiber)
+            {
+                if(priority >= 0)
+                {
+                    _fiber->setPriority(priority);
+                }
+                _priority = _fiber->getPriority();
+                _deadline = _fiber->getDeadline();
+            }
+            else
+            {
+                _priority = priority >= 0 ? priority : Fiber::PRIORITY_NORMAL;
+                _deadline = deadline;
+            }
+        }
+    };
+
+    class SchedulePolicy
+    {
+    public:
+        virtual ~SchedulePolicy() {}
+        //加入一个任务，优先级和截止时间已经确定
+        virtual void push(ScheduleTask&& task) = 0;
+        //取一个线程thread_id可以执行的任务，取到返回true
+        //tickle_me置为true表示还有任务留在队列里（可能需要唤醒其他线程）
+        virtual bool take(ScheduleTask& task, int thread_id, bool& tickle_me) = 0;
+        //是否没有任务
+        virtual bool empty() const = 0;
+
+    protected:
+        //任务能否在thread_id上执行：指定了别的线程，或者共享栈正被别的线程上的协程使用时不能
+        //共享栈被占用的任务先跳过，那个线程让出后回到调度循环会取走它；返回true时任务已经占用了共享栈
+        static bool runnable(ScheduleTask& task, int thread_id, bool& tickle_me)
+        {
+            if(task._thread != -1 && task._thread != thread_id)
+            {
+                tickle_me = true; //说明整个任务是其他线程的，有其他线程需要唤醒
+                return false;
+            }
+            return !task._fiber || task._fiber->tryLockStack();
+        }
+    };
+
+    //默认策略：每个优先级一个FIFO队列，队列之间加权轮转
+    class PriorityPolicy : public SchedulePolicy
+    {
+    public:
+        void push(ScheduleTask&& task) override;
+        bool take(ScheduleTask& task, int thread_id, bool& tickle_me) override;
+        bool empty() const override;
+
+    private:
+        //任务队列，每个优先级一个
+        std::vector<ScheduleTask> _m_tasks[Fiber::PRIORITY_LEVELS];
+        //加权轮转：每一轮各级队列最多连续取这么多个任务，高优先级用完额度后低优先级才有机会，低优先级不会饿死
+        static constexpr int PRIORITY_WEIGHTS[Fiber::PRIORITY_LEVELS] = {16, 4, 1};
+        //本轮各级剩余的额度，所有有任务的队列都用完额度后开始新的一轮
+        int _m_credits[Fiber::PRIORITY_LEVELS] = {16, 4, 1};
+    };
+
+    //最早截止时间优先(EDF)：截止时间最早的任务先执行，相同时按提交顺序；忽略优先级
+    //没有截止时间的任务排在所有有截止时间的任务之后（过载时可能一直得不到执行）
+    //协程任务按它被放回队列时的截止时间排队，用DeadlineScope设置；函数任务用scheduleLock的deadline参数
+    class EdfPolicy : public SchedulePolicy
+    {
+    public:
+        void push(ScheduleTask&& task) override;
+        bool take(ScheduleTask& task, int thread_id, bool& tickle_me) override;
+        bool empty() const override { return _m_tasks.empty(); }
+
+    private:
+        //按(截止时间, 提交序号)排序
+        std::map<std::pair<uint64_t, uint64_t>, ScheduleTask> _m_tasks;
+        uint64_t _m_seq = 0;
+    };
+}
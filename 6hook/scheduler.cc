@@ -1,18 +1,57 @@
 #include <vector>
+#include <algorithm>
+#include <chrono>
 #include "scheduler.h"
 #include "hook.h"
-
-static bool debug = true;
+#include "log.h"
+#include "deadline.h"
 
 namespace nsCoroutine
 {
     //用于保存当前线程的调度器对象
     static thread_local Scheduler* t_scheduler = nullptr;
+    //当前线程的idle协程，idle协程由run()直接resume，不能被当成普通任务挂起
+    static thread_local Fiber* t_idle_fiber = nullptr;
+    //工作线程的时间片状态，看门狗线程读写
+    struct SliceSlot
+    {
+        std::atomic<uint64_t> start{0};   //当前任务开始运行的时间(ms)，0表示没有在运行任务
+        std::atomic<uint64_t> flagged{0}; //已经标记过的那次运行的start，同一次运行只标记一次
+        std::atomic<bool> preempt{false}; //时间片已经用完，下一个安全点让出
+    };
+    static thread_local SliceSlot t_slice;
+
+    //开始运行一个任务，开启了时间片时记下开始时间
+    static void slice_begin(bool timed)
+    {
+        if(timed)
+        {
+            t_slice.start.store(NowMonoMs(), std::memory_order_relaxed);
+        }
+    }
+
+    //任务让出或者结束，清除标记
+    static void slice_end()
+    {
+        t_slice.start.store(0, std::memory_order_relaxed);
+        t_slice.preempt.store(false, std::memory_order_relaxed);
+    }
+
     //返回调度器对象
     Scheduler* Scheduler::GetThis()
     {
         return t_scheduler;
     }
+    bool Scheduler::InTaskFiber()
+    {
+        if(t_scheduler == nullptr)
+        {
+            return false;
+        }
+        Fiber* curr = Fiber::GetThisRaw();
+        return curr->isRunInScheduler() && curr != t_idle_fiber;
+    }
+
     //设置调度器对象
     void Scheduler::SetThis()
     {
@@ -21,9 +60,13 @@ namespace nsCoroutine
     //构造函数
     //构造函数负责初始化调度器对象，设置线程数量、是否使用调用线程、调度器名称等参数
     //如果use_caller为true，即为主线程也要参与调度，所以要创建协程，主要原因是为了实现更高效的任务调度和管理
-    Scheduler::Scheduler(size_t threads, bool use_caller, const std::string& name)
-        :_m_useCaller(use_caller),_m_name(name)
+    Scheduler::Scheduler(size_t threads, bool use_caller, const std::string& name, std::unique_ptr<SchedulePolicy> policy)
+        :_m_useCaller(use_caller),_m_name(name),_m_policy(std::move(policy))
     {
+        if(!_m_policy)
+        {
+            _m_policy.reset(new PriorityPolicy());
+        }
         //判断创建线程数量是否大于0，并且调度器对象上是否是空指针
         assert(threads > 0 && Scheduler::GetThis() == nullptr);
         //设置当前线程的调度器对象为当前对象
@@ -48,10 +91,7 @@ namespace nsCoroutine
         }
         
         _m_threadCount = threads;
-        if(debug)
-        {
-            std::cout << "Scheduler::Scheduler() success\n";
-        }
+        LOG_DEBUG("Scheduler::Scheduler() success");
     }
 
     //析构函数
@@ -63,10 +103,7 @@ namespace nsCoroutine
             //将其设置为nullptr防止悬空指针
             t_scheduler = nullptr;
         }
-        if(debug)
-        {
-            std::cout << "Scheduler::~Scheduler() success\n";
-        }
+        LOG_DEBUG("Scheduler::~Scheduler() success");
     }
 
     //start函数是启动调度器的核心方法之一，它负责初始化和启动调度器管理的所有调度线程。
@@ -76,7 +113,7 @@ namespace nsCoroutine
         std::lock_guard<std::mutex> lock(_m_mutex);
         if(_m_stopping)
         {
-            std::cerr << "Scheduler is stopped" << std::endl;
+            LOG_WARN("Scheduler {} is stopped", _m_name);
             return;   
         }
         //确保刚启动时候没有残留的线程
@@ -88,10 +125,7 @@ namespace nsCoroutine
             _m_threads[i].reset(new Thread(std::bind(&Scheduler::run, this), _m_name + "_" + std::to_string(i)));
             _m_threadIds.push_back(_m_threads[i]->getId());
         }
-        if(debug)
-        {
-            std::cout << "Scheduler::start() success\n";
-        }
+        LOG_DEBUG("Scheduler::start() success");
     }
 
     //作用：调取器的核心，负责从任务队列中取出任务并通过协程执行
@@ -99,10 +133,7 @@ namespace nsCoroutine
     {
         //获取当前线程的ID
         int thread_id = Thread::GetThreadId();
-        if(debug)
-        {
-            std::cout << "Scheduler::run() starts in thread: " << thread_id << std::endl; 
-        }
+        LOG_DEBUG("Scheduler::run() starts in thread: {}", thread_id);
 
         set_hook_enable(true); 
 
@@ -117,6 +148,12 @@ namespace nsCoroutine
         //创建空闲协程，std::make_shared是C++11引入的一个函数，用于创建std::shared_ptr构造函数，std::make_shared更高效而且更安全，因为它在单个内存分配中同时分配了控制块和对象，避免了额外的内存分配和指针操作。
         //子协程
         std::shared_ptr<Fiber> idle_fiber = std::make_shared<Fiber>(std::bind(&Scheduler::idle,this));
+        t_idle_fiber = idle_fiber.get();
+        //登记时间片状态，看门狗线程通过它检查本线程的任务
+        {
+            std::lock_guard<std::mutex> lock(_m_sliceMutex);
+            _m_sliceSlots.push_back(&t_slice);
+        }
         ScheduleTask task;
 
         while(true)
@@ -127,27 +164,10 @@ namespace nsCoroutine
 
             {
                 std::lock_guard<std::mutex> lock(_m_mutex);
-                auto it = _m_tasks.begin();
-                //1、遍历任务队列
-                while(it != _m_tasks.end())
+                if(_m_policy->take(task, thread_id, tickle_me))
                 {
-                    //不能等于当前线程的ID，其目的是让其他线程也能执行
-                    if(it->_thread != -1 && it->_thread != thread_id)
-                    {
-                        it++;
-                        tickle_me = true; //说明整个任务是其他线程的，有其他线程需要唤醒
-                        continue;
-                    }
-                    //2、取出任务
-                    assert(it->_fiber || it->_cb);
-                    task = *it;
-                    _m_tasks.erase(it);
                     _m_activeThreadCount++;
-                    //这里取到任务的线程就直接break所以并没有遍历到队尾
-                    break;
                 }
-                //确保仍然存在未处理的任务
-                tickle_me = tickle_me || (it != _m_tasks.end());
             }
             //这里虽然写了唤醒但是并没有具体的逻辑代码
             if(tickle_me)
@@ -162,7 +182,13 @@ namespace nsCoroutine
                     std::lock_guard<std::mutex> lock(task._fiber->_m_mutex);
                     if(task._fiber->getState() != Fiber::TERM)
                     {
+                        slice_begin(_m_timeSlice.load(std::memory_order_relaxed) != 0);
                         task._fiber->resume();
+                        slice_end();
+                    }
+                    else
+                    {
+                        task._fiber->unlockStack();
                     }
                 }
                 //线程完成任务之后就不再处于活跃状态，而是进入空闲状态，因此需要将活跃线程计数减一
@@ -172,11 +198,15 @@ namespace nsCoroutine
             //执行任务 -- 如果调度对象是函数
             else if(task._cb)
             {
-                std::shared_ptr<Fiber> cb_fiber = std::make_shared<Fiber>(task._cb);
+                std::shared_ptr<Fiber> cb_fiber = std::make_shared<Fiber>(std::move(task._cb), 0, true, _m_sharedStack);
+                cb_fiber->setPriority(task._priority);
+                cb_fiber->setDeadline(task._deadline);
 
                 {
                     std::lock_guard<std::mutex> lock(cb_fiber->_m_mutex);
+                    slice_begin(_m_timeSlice.load(std::memory_order_relaxed) != 0);
                     cb_fiber->resume();
+                    slice_end();
                 }
                 
                 _m_activeThreadCount--;
@@ -189,9 +219,11 @@ namespace nsCoroutine
                 if(idle_fiber->getState() == Fiber::TERM)
                 {
                     //如果调度器没有调度任务，那么idle协程会不断得resume/yield。不会结束进入一个忙等待，如果idle协程结束了，一定是调度器停止了，直到任务才执行上面的if/else，在这里idle_fiber就是不断和主协程进行交互的子协程
-                    if(debug)
+                    LOG_DEBUG("Scheduler::run() exits in thread: {}", thread_id);
+                    t_idle_fiber = nullptr;
                     {
-                        std::cout << "Scheduler::run() exits in thread: " << thread_id << std::endl; 
+                        std::lock_guard<std::mutex> lock(_m_sliceMutex);
+                        _m_sliceSlots.erase(std::find(_m_sliceSlots.begin(), _m_sliceSlots.end(), &t_slice));
                     }
                     break;
                 }
@@ -205,10 +237,7 @@ namespace nsCoroutine
 
     void Scheduler::stop()
     {
-        if(debug)
-        {
-            std::cout << "Schdeule::stop() starts in thread: " << Thread::GetThreadId() << std::endl;            
-        }
+        LOG_DEBUG("Schdeule::stop() starts in thread: {}", Thread::GetThreadId());
         
         if(stopping())
         {
@@ -236,10 +265,7 @@ namespace nsCoroutine
         {
             //开始任务调度
             _m_schedulerFiber->resume();
-            if(debug)
-            {
-                std::cout << "_m_schedulerFiber ends in thread: " << Thread::GetThreadId() << std::endl;
-            }
+            LOG_DEBUG("_m_schedulerFiber ends in thread: {}", Thread::GetThreadId());
         }
         //获取此时的线程通过swap不会增加引用计数的方式加入到thrs，方便下面的join保持线程正常退出
         std::vector<std::shared_ptr<Thread>> thrs;
@@ -253,10 +279,71 @@ namespace nsCoroutine
         {
             i->join();
         }
-        if(debug)
+
+        std::shared_ptr<Thread> watchdog;
+        {
+            std::lock_guard<std::mutex> lock(_m_sliceMutex);
+            _m_watchdogStop = true;
+            watchdog.swap(_m_watchdog);
+        }
+        if(watchdog)
+        {
+            watchdog->join();
+        }
+        LOG_DEBUG("Scheduler::stop() ends in thread: {}", Thread::GetThreadId());
+    }
+
+    void Scheduler::setTimeSlice(uint64_t ms)
+    {
+        _m_timeSlice = ms;
+        std::lock_guard<std::mutex> lock(_m_sliceMutex);
+        if(ms && !_m_watchdog && !_m_watchdogStop)
+        {
+            _m_watchdog.reset(new Thread(std::bind(&Scheduler::watchdog, this), _m_name + "_watchdog"));
+        }
+    }
+
+    void Scheduler::watchdog()
+    {
+        while(!_m_watchdogStop)
+        {
+            //每1/4个时间片检查一次，任务最多超出时间片的1/4才被标记
+            uint64_t slice = _m_timeSlice;
+            std::this_thread::sleep_for(std::chrono::milliseconds(slice ? std::max<uint64_t>(slice / 4, 1) : 10));
+            if(slice == 0)
+            {
+                continue;
+            }
+            uint64_t now = NowMonoMs();
+            std::lock_guard<std::mutex> lock(_m_sliceMutex);
+            for(SliceSlot* slot : _m_sliceSlots)
+            {
+                uint64_t start = slot->start.load(std::memory_order_relaxed);
+                if(start && now - start >= slice && slot->flagged.load(std::memory_order_relaxed) != start)
+                {
+                    slot->flagged.store(start, std::memory_order_relaxed);
+                    slot->preempt.store(true, std::memory_order_relaxed);
+                    _m_sliceOverruns++;
+                }
+            }
+        }
+    }
+
+    bool yield_point()
+    {
+        if(!t_slice.preempt.load(std::memory_order_relaxed))
+        {
+            return false;
+        }
+        t_slice.preempt.store(false, std::memory_order_relaxed);
+        if(!Scheduler::InTaskFiber())
         {
-            std::cout << "Scheduler::stop() ends in thread: " << Thread::GetThreadId() << std::endl;
+            return false;
         }
+        //先放回任务队列再让出：别的线程取到它时会阻塞在协程的_m_mutex上，直到这里的切换完成
+        Scheduler::GetThis()->scheduleLock(Fiber::GetThis());
+        Fiber::GetThisRaw()->yield();
+        return true;
     }
 
     void Scheduler::tickle()
@@ -268,24 +355,19 @@ namespace nsCoroutine
     {
         while(!stopping())
         {
-            if(debug)
-            {
-                std::cout << "Scheduler::idle()，sleeping in thread: " << Thread::GetThreadId() << std::endl;
-                // 写错了，如果在这里才yield，空闲协程就死循环了，调度线程就会一直在这个循环中，
-                // 这样就跳不出到调度协程了，这样就无法调度任务了
-                // 如果主线程/调度器线程参与调度，最起码还有一个线程可以执行
-                // 如果主线程/调度器线程不参与调度，那么就会一直卡住无法消化任务
-                // sleep(1);
-                // Fiber::GetThis()->yield();
-            }
+            LOG_DEBUG("Scheduler::idle()，sleeping in thread: {}", Thread::GetThreadId());
+            // 注意sleep和yield不能放在日志的条件分支里，否则空闲协程就死循环了，调度线程就会一直在这个循环中，
+            // 这样就跳不出到调度协程了，这样就无法调度任务了
+            // 如果主线程/调度器线程参与调度，最起码还有一个线程可以执行
+            // 如果主线程/调度器线程不参与调度，那么就会一直卡住无法消化任务
             sleep(1);
-            Fiber::GetThis()->yield();
+            Fiber::GetThisRaw()->yield();
         }
     }
 
     bool Scheduler::stopping()
     {
         std::lock_guard<std::mutex> lock(_m_mutex);
-        return _m_stopping && _m_tasks.empty() && _m_activeThreadCount == 0;
+        return _m_stopping && _m_policy->empty() && _m_activeThreadCount == 0 && _m_parkedFibers == 0;
     }
 }
\ No newline at end of file
@@ -5,14 +5,19 @@
 #include <string>
 #include "fiber.h"
 #include "thread.h"
+#include "schedulePolicy.h"
 
 namespace nsCoroutine
 {
+    struct SliceSlot;
+
     class Scheduler
     {
     public:
         //threads指定线程池的线程数量，use_caller指定是否将主线程作为工作线程，name调度器的名称
-        Scheduler(size_t threads = 1, bool use_caller = true, const std::string& name = "Scheduler");
+        //policy是调度策略（见schedulePolicy.h），为空时使用PriorityPolicy
+        Scheduler(size_t threads = 1, bool use_caller = true, const std::string& name = "Scheduler",
+                  std::unique_ptr<SchedulePolicy> policy = nullptr);
         //防止出现资源泄漏，基类指针删除派生类对象时不完全销毁的问题
         virtual ~Scheduler();
         //获取调度器的名字
@@ -24,69 +29,21 @@ namespace nsCoroutine
     public:
         //获取当前线程正在运行的调度器 -- 线程局部存储
         static Scheduler* GetThis();
+        //当前是否运行在调度器的任务协程中（不是主协程、调度协程或idle协程）
+        //只有任务协程可以yield之后等待别人通过scheduleLock把它重新放回任务队列
+        static bool InTaskFiber();
 
     protected:
         //设置当前线程正在运行的调度器 -- 线程局部存储
         void SetThis();
 
-    private:
-        //任务
-        struct ScheduleTask
-        {
-            std::shared_ptr<Fiber> _fiber; //执行任务的协程对象 -- 调度对象是协程
-            std::function<void()> _cb;     //执行任务的函数指针 -- 调度对象是函数
-            int _thread; //指定任务需要运行的线程id
-            
-            ScheduleTask()
-            {
-                _fiber = nullptr;
-                _cb = nullptr;
-                _thread = -1;
-            }
-
-            //协程+线程
-            ScheduleTask(std::shared_ptr<Fiber> f, int thr)
-            {
-                _fiber = f;
-                _thread = thr;
-            }
-
-            //协程+线程
-            ScheduleTask(std::shared_ptr<Fiber>* f, int thr)
-            {
-                //将内容转移也就是指针内部的转移和上面的赋值不同，引用计数不会增加
-                _fiber.swap(*f);
-                _thread = thr;
-            }
-
-            //函数+线程
-            ScheduleTask(std::function<void()> f, int thr)
-            {
-                _cb = f;
-                _thread = thr;
-            }
-
-            //函数+线程
-            ScheduleTask(std::function<void()>* f, int thr)
-            {
-                _cb.swap(*f);
-                _thread = thr;
-            }
-
-            //重置任务对象
-            void reset()
-            {
-                _fiber = nullptr;
-                _cb = nullptr;
-                _thread = -1;
-            }
-        };
-
     public:
         //添加任务到任务队列
         //FiberOrCb调度任务类型，可以是协程对象或函数指针
+        //priority是Fiber::Priority，-1表示协程任务沿用协程的优先级、函数任务为PRIORITY_NORMAL
+        //deadline是函数任务的截止时间（单调时钟ms），协程任务使用协程自己的截止时间，见ScheduleTask::prepare
         template<class FiberOrCb>
-        void scheduleLock(FiberOrCb fc, int thread = -1)
+        void scheduleLock(FiberOrCb fc, int thread = -1, int priority = -1, uint64_t deadline = 0)
         {
             //用于标记任务队列是否为空，从而判断是否需要唤醒线程。
             bool need_tickle;
@@ -94,13 +51,14 @@ namespace nsCoroutine
             {
                 std::lock_guard<std::mutex> lock(_m_mutex);
                 //empty -> 所有线程都是空闲的，需要唤醒线程
-                need_tickle = _m_tasks.empty();
+                need_tickle = _m_policy->empty();
                 //创建Task的任务对象
-                ScheduleTask task(fc, thread);
-                //存在就加入
+                ScheduleTask task(std::move(fc), thread);
+                //存在就加入，移动进队列避免再复制一次shared_ptr/std::function
                 if(task._fiber || task._cb)
                 {
-                    _m_tasks.push_back(task);
+                    task.prepare(priority, deadline);
+                    _m_policy->push(std::move(task));
                 }
             }
 
@@ -111,6 +69,47 @@ namespace nsCoroutine
             }
         }
 
+        //批量添加任务，只加一次锁、最多唤醒一次线程，fcs里的任务被移走
+        //一次唤醒一批协程（barrier、notify_all）时使用，避免逐个scheduleLock的锁竞争
+        template<class FiberOrCb>
+        void scheduleBatch(std::vector<FiberOrCb>& fcs, int thread = -1, int priority = -1)
+        {
+            bool need_tickle;
+            {
+                std::lock_guard<std::mutex> lock(_m_mutex);
+                need_tickle = _m_policy->empty();
+                for(auto& fc : fcs)
+                {
+                    ScheduleTask task(std::move(fc), thread);
+                    if(task._fiber || task._cb)
+                    {
+                        task.prepare(priority, 0);
+                        _m_policy->push(std::move(task));
+                    }
+                }
+            }
+            //工作线程取到任务后发现队列里还有任务会继续唤醒其他线程
+            if(need_tickle)
+            {
+                tickle();
+            }
+        }
+
+        //协程挂起在调度器之外的等待队列里（例如FiberWaiter）时+1，被唤醒放回任务队列后-1
+        //这些协程不在任务队列里，调度器停止时要等它们全部被唤醒并执行完，否则唤醒时调度器已经没有线程了
+        void addParkedFiber(int n) { _m_parkedFibers.fetch_add(n); }
+
+        //之后调度的函数任务是否运行在共享栈协程上（见Fiber::resume），适合大量长期空闲的连接协程：
+        //每个挂起的协程只占用它实际用到的那部分栈。这些任务不能把栈上变量的地址交给别的协程使用
+        void setSharedStack(bool on) { _m_sharedStack = on; }
+
+        //协作式抢占：ms不为0时启动看门狗线程，任务协程连续运行超过ms毫秒就被标记，
+        //在下一个安全点（yield_point()，hook的I/O调用入口会调用它）让出并排到队尾；0表示关闭（默认）
+        //纯计算的循环里没有hook的调用，需要自己调用yield_point()才能被抢占
+        void setTimeSlice(uint64_t ms);
+        //超时被标记的次数
+        uint64_t getSliceOverruns() const { return _m_sliceOverruns.load(std::memory_order_relaxed); }
+
         //启动线程池，启动调度器
         virtual void start();
         //关闭线程池，停止调度器，等所有调度任务都执行完后再返回。
@@ -129,6 +128,10 @@ namespace nsCoroutine
         //当调度协程进入idle时空闲线程数+1，从idle协程返回时空闲线程数-1
         bool hasIdleThreads() {return _m_idleThreadCount>0;}
 
+    private:
+        //看门狗线程函数：定期检查每个工作线程当前任务的运行时间
+        void watchdog();
+
     private:
         //调度器名称
         std::string _m_name;
@@ -138,14 +141,16 @@ namespace nsCoroutine
         std::vector<std::shared_ptr<Thread>> _m_threads;
         //存储工作线程的线程id
         std::vector<int> _m_threadIds;
-        //任务队列
-        std::vector<ScheduleTask> _m_tasks;
+        //任务队列，由调度策略管理，受_m_mutex保护
+        std::unique_ptr<SchedulePolicy> _m_policy;
         //需要额外创建的线程数 -- 不包含主线程（调度器线程）
         size_t _m_threadCount = 0;
         //活跃线程数
         std::atomic<size_t> _m_activeThreadCount = {0};
         //空闲线程数
         std::atomic<size_t> _m_idleThreadCount = {0};
+        //挂起在调度器之外的协程数，唤醒方可能先于挂起方计数，短暂为负
+        std::atomic<int> _m_parkedFibers = {0};
         //主线程是否参与调度
         bool _m_useCaller;
         //如果主线程参与调度->需要额外创建调度协程
@@ -154,5 +159,21 @@ namespace nsCoroutine
         int _m_rootThread = -1;
         //是否正在关闭
         bool _m_stopping = false;
+        //函数任务是否使用共享栈协程
+        bool _m_sharedStack = false;
+        //时间片(ms)，0表示不抢占
+        std::atomic<uint64_t> _m_timeSlice = {0};
+        //超时被标记的次数
+        std::atomic<uint64_t> _m_sliceOverruns = {0};
+        //看门狗线程，第一次设置时间片时启动，stop()时结束
+        std::shared_ptr<Thread> _m_watchdog;
+        std::atomic<bool> _m_watchdogStop = {false};
+        //各工作线程的时间片状态（SliceSlot见scheduler.cc），受_m_sliceMutex保护
+        std::mutex _m_sliceMutex;
+        std::vector<SliceSlot*> _m_sliceSlots;
     };
+
+    //安全点：当前任务协程的时间片已经用完（见Scheduler::setTimeSlice）时让出，重新排到任务队列里，返回true
+    //没有用完或者不在任务协程里时什么也不做，开销是读一个线程局部变量
+    bool yield_point();
 }
\ No newline at end of file
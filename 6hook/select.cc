@@ -0,0 +1,208 @@
+#include "select.h"
+#include "hook.h"
+
+#include <cerrno>
+#include <chrono>
+
+namespace nsCoroutine
+{
+    // 被唤醒的分支编号编码在唤醒原因里
+    static const int CASE_BASE = FiberWaiter::USER;
+    // 登记途中发现有分支已经可以完成，撤销等待时使用的唤醒原因
+    static const int ABORTED = FiberWaiter::USER - 1;
+
+    // fd就绪分支：通过IOManager::addEvent登记回调，事件触发时唤醒等待者
+    struct Select::FdCase : public Case
+    {
+        FdCase(int fd, IOManager::Event event) : fd(fd), event(event) {}
+        // 不阻塞地poll一次：已经就绪的fd直接选中，不用经过epoll登记和挂起
+        // 无效的fd（POLLNVAL）不算就绪，交给watch()报告EBADF
+        bool tryComplete() override
+        {
+            struct pollfd pfd = {fd, (short)(event == IOManager::READ ? POLLIN : POLLOUT), 0};
+            if (poll_f(&pfd, 1, 0) != 1)
+            {
+                return false;
+            }
+            return !(pfd.revents & POLLNVAL);
+        }
+        int watch(const std::shared_ptr<FiberWaiter> &waiter, int result) override
+        {
+            iom = IOManager::GetThis();
+            if (iom == nullptr)
+            {
+                errno = EINVAL;
+                return -1;
+            }
+            // 边沿触发的epoll在ADD/MOD时会检查一次当前状态，已经就绪的fd会马上触发回调
+            // 失败时保留addEvent设置的errno：EEXIST（已经有协程在等）、EPERM（普通文件）、EBADF等
+            if (iom->addEvent(fd, event, [waiter, result]()
+                              { waiter->wake(result); }) != 0)
+            {
+                return -1;
+            }
+            return 1;
+        }
+        void unwatch(const FiberWaiter *) override
+        {
+            // 事件已经触发过的话delEvent返回false，回调里的claim会失败，不影响结果
+            iom->delEvent(fd, event);
+        }
+
+        int fd;
+        IOManager::Event event;
+        IOManager *iom = nullptr;
+    };
+
+    int Select::readable(int fd)
+    {
+        _m_cases.emplace_back(new FdCase(fd, IOManager::READ));
+        return _m_cases.size() - 1;
+    }
+
+    int Select::writable(int fd)
+    {
+        _m_cases.emplace_back(new FdCase(fd, IOManager::WRITE));
+        return _m_cases.size() - 1;
+    }
+
+    int Select::tryAll(size_t start)
+    {
+        size_t n = _m_cases.size();
+        for (size_t i = 0; i < n; ++i)
+        {
+            size_t idx = (start + i) % n;
+            if (!_m_cases[idx]->disabled && _m_cases[idx]->tryComplete())
+            {
+                return idx;
+            }
+        }
+        return -1;
+    }
+
+    int Select::poll()
+    {
+        int r = tryAll(0);
+        if (r < 0)
+        {
+            errno = EAGAIN;
+        }
+        return r;
+    }
+
+    bool Select::watchAll(const std::shared_ptr<FiberWaiter> &waiter, int &error, size_t &start)
+    {
+        error = 0;
+        for (size_t i = 0; i < _m_cases.size(); ++i)
+        {
+            if (_m_cases[i]->disabled)
+            {
+                continue;
+            }
+            int rt = _m_cases[i]->watch(waiter, CASE_BASE + i);
+            if (rt == 1)
+            {
+                continue;
+            }
+            if (rt < 0)
+            {
+                error = errno;
+            }
+            unwatchAll(waiter.get(), i);
+            start = i;
+            // 已登记的分支可能已经claim了等待者并且会resume它，必须把这次resume消化掉，
+            // 并且下一轮先试这个分支，否则发给它的通知就被浪费了
+            if (!waiter->claim(ABORTED))
+            {
+                waiter->wait();
+                start = waiter->result() - CASE_BASE;
+            }
+            return false;
+        }
+        return true;
+    }
+
+    void Select::unwatchAll(const FiberWaiter *waiter, size_t count)
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            if (!_m_cases[i]->disabled)
+            {
+                _m_cases[i]->unwatch(waiter);
+            }
+        }
+    }
+
+    int Select::wait()
+    {
+        bool any = false;
+        for (auto &c : _m_cases)
+        {
+            any = any || !c->disabled;
+        }
+        if (!any)
+        {
+            errno = EINVAL;
+            return -1;
+        }
+        // 每次从随机位置开始尝试，避免排在前面的分支一直优先
+        static thread_local uint32_t t_seed = 2463534242u;
+        t_seed ^= t_seed << 13;
+        t_seed ^= t_seed >> 17;
+        t_seed ^= t_seed << 5;
+        size_t start = t_seed % _m_cases.size();
+
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(_m_timeoutMs);
+        while (true)
+        {
+            int r = tryAll(start);
+            if (r >= 0)
+            {
+                return r;
+            }
+
+            std::shared_ptr<FiberWaiter> waiter = std::make_shared<FiberWaiter>(_m_timed);
+            int error = 0;
+            if (!watchAll(waiter, error, start))
+            {
+                if (error)
+                {
+                    errno = error;
+                    return -1;
+                }
+                continue;
+            }
+
+            bool woken = true;
+            if (_m_timed)
+            {
+                auto now = std::chrono::steady_clock::now();
+                uint64_t left = now < deadline ? std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now).count() : 0;
+                woken = waiter->waitFor(left);
+            }
+            else
+            {
+                waiter->wait();
+            }
+            unwatchAll(waiter.get(), _m_cases.size());
+            if (waiter->result() == FiberWaiter::CANCELED)
+            {
+                errno = ECANCELED;
+                return -1;
+            }
+            if (!woken)
+            {
+                errno = ETIMEDOUT;
+                return -1;
+            }
+
+            size_t idx = waiter->result() - CASE_BASE;
+            if (dynamic_cast<FdCase *>(_m_cases[idx].get()))
+            {
+                return idx;
+            }
+            // 通道分支被唤醒只表示可能可以完成，先试被唤醒的分支，不行（被别的协程抢先）就重新来一轮
+            start = idx;
+        }
+    }
+}
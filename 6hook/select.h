@@ -0,0 +1,166 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include "channel.h"
+#include "ioManager.h"
+
+// 多路等待：同时等待多个通道操作、fd可读/可写以及一个超时，哪个先完成就返回哪个
+// 所有分支共用一个FiberWaiter，claim()保证只有一个分支能唤醒协程；
+// 返回前撤销其余分支的登记：通道从等待队列里删除节点，fd调用delEvent，超时取消定时器，
+// 撤销不掉的（已经在触发途中的）claim会失败，不会重复唤醒
+//
+// 用法：
+//     Select sel;
+//     int a = sel.recv(ch1, v1);
+//     int b = sel.readable(fd);
+//     sel.timeout(100);
+//     int r = sel.wait();    // r == a / r == b，超时返回-1且errno = ETIMEDOUT
+
+namespace nsCoroutine
+{
+    class Select
+    {
+    public:
+        Select() = default;
+        Select(const Select &) = delete;
+        Select &operator=(const Select &) = delete;
+
+        // 接收分支：收到消息写入out。通道已关闭且取空时分支也算完成，*ok被置为false
+        template <typename T>
+        int recv(Channel<T> &ch, T &out, bool *ok = nullptr)
+        {
+            _m_cases.emplace_back(new RecvCase<T>(ch, out, ok));
+            return _m_cases.size() - 1;
+        }
+
+        // 发送分支：v在分支完成时被移入通道。通道已关闭时分支也算完成，*ok被置为false
+        template <typename T>
+        int send(Channel<T> &ch, T v, bool *ok = nullptr)
+        {
+            _m_cases.emplace_back(new SendCase<T>(ch, std::move(v), ok));
+            return _m_cases.size() - 1;
+        }
+
+        // fd可读/可写分支，需要在IOManager的协程里使用；同一个fd的同一种事件不能同时被别的协程等待
+        int readable(int fd);
+        int writable(int fd);
+
+        // 停用一个分支（例如通道已经关闭），之后的wait()不再等待它
+        // 同一个Select可以反复wait()，循环里复用它可以省掉每轮重新构造分支的开销
+        void disable(int index) { _m_cases[index]->disabled = true; }
+
+        // 最多等待ms毫秒
+        void timeout(uint64_t ms)
+        {
+            _m_timed = true;
+            _m_timeoutMs = ms;
+        }
+
+        // 等待任一分支完成，返回分支编号
+        // 失败返回-1：超时errno = ETIMEDOUT；没有可用的分支errno = EINVAL；
+        // fd分支注册失败时errno是addEvent的原因：EEXIST（同一事件已经有协程在等）、EBADF、EPERM（epoll不支持的fd，如普通文件）等
+        int wait();
+        // 只检查一遍所有分支（fd分支不阻塞地poll一次），不挂起，没有分支能完成返回-1且errno = EAGAIN
+        int poll();
+
+    private:
+        struct Case
+        {
+            virtual ~Case() = default;
+            // 不挂起地尝试完成
+            virtual bool tryComplete() = 0;
+            // 登记唤醒：1已登记，0已经可以完成无需登记，-1出错
+            virtual int watch(const std::shared_ptr<FiberWaiter> &waiter, int result) = 0;
+            virtual void unwatch(const FiberWaiter *waiter) = 0;
+
+            bool disabled = false;
+        };
+
+        template <typename T>
+        struct RecvCase : public Case
+        {
+            RecvCase(Channel<T> &ch, T &out, bool *ok) : ch(ch), out(out), ok(ok) {}
+            bool tryComplete() override
+            {
+                if (ch.tryRecvImpl(out))
+                {
+                    setOk(true);
+                    return true;
+                }
+                if (ch.isDrained())
+                {
+                    setOk(false);
+                    return true;
+                }
+                return false;
+            }
+            int watch(const std::shared_ptr<FiberWaiter> &waiter, int result) override
+            {
+                return ch.watchRecv(waiter, result) ? 1 : 0;
+            }
+            void unwatch(const FiberWaiter *waiter) override { ch.unwatchRecv(waiter); }
+            void setOk(bool v)
+            {
+                if (ok)
+                {
+                    *ok = v;
+                }
+            }
+
+            Channel<T> &ch;
+            T &out;
+            bool *ok;
+        };
+
+        template <typename T>
+        struct SendCase : public Case
+        {
+            SendCase(Channel<T> &ch, T v, bool *ok) : ch(ch), value(std::move(v)), ok(ok) {}
+            bool tryComplete() override
+            {
+                if (ch.trySendImpl(value))
+                {
+                    setOk(true);
+                    return true;
+                }
+                if (ch.isClosed())
+                {
+                    setOk(false);
+                    return true;
+                }
+                return false;
+            }
+            int watch(const std::shared_ptr<FiberWaiter> &waiter, int result) override
+            {
+                return ch.watchSend(waiter, result) ? 1 : 0;
+            }
+            void unwatch(const FiberWaiter *waiter) override { ch.unwatchSend(waiter); }
+            void setOk(bool v)
+            {
+                if (ok)
+                {
+                    *ok = v;
+                }
+            }
+
+            Channel<T> &ch;
+            T value;
+            bool *ok;
+        };
+
+        struct FdCase;
+
+        // 登记所有未停用的分支；有分支已经可以完成时撤销已登记的部分并返回false，start设为下一轮应该先尝试的分支
+        bool watchAll(const std::shared_ptr<FiberWaiter> &waiter, int &error, size_t &start);
+        // 撤销前count个分支中已登记的部分
+        void unwatchAll(const FiberWaiter *waiter, size_t count);
+        // 从start开始轮流尝试一遍
+        int tryAll(size_t start);
+
+    private:
+        std::vector<std::unique_ptr<Case>> _m_cases;
+        bool _m_timed = false;
+        uint64_t _m_timeoutMs = 0;
+    };
+}
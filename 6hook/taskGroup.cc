@@ -0,0 +1,192 @@
+#include "taskGroup.h"
+
+#include <cassert>
+
+namespace nsCoroutine
+{
+    bool CancelState::arm(std::function<void()> canceler)
+    {
+        std::lock_guard<std::mutex> lock(_m_mutex);
+        if (cancelled())
+        {
+            return false;
+        }
+        _m_canceler = std::move(canceler);
+        return true;
+    }
+
+    void CancelState::disarm()
+    {
+        std::lock_guard<std::mutex> lock(_m_mutex);
+        _m_canceler = nullptr;
+    }
+
+    void CancelState::cancel()
+    {
+        std::vector<std::weak_ptr<TaskGroupState>> children;
+        {
+            // 回调在锁内调用，disarm()返回之后回调就不会再执行
+            std::lock_guard<std::mutex> lock(_m_mutex);
+            if (_m_cancelled.exchange(true, std::memory_order_acq_rel))
+            {
+                return;
+            }
+            if (_m_canceler)
+            {
+                _m_canceler();
+                _m_canceler = nullptr;
+            }
+            children.swap(_m_children);
+        }
+        for (auto &weak : children)
+        {
+            if (std::shared_ptr<TaskGroupState> group = weak.lock())
+            {
+                group->cancel();
+            }
+        }
+    }
+
+    void CancelState::addChild(const std::shared_ptr<TaskGroupState> &group)
+    {
+        {
+            std::lock_guard<std::mutex> lock(_m_mutex);
+            if (!cancelled())
+            {
+                // 顺便清理已经销毁的子组，循环里反复创建TaskGroup时不会无限增长
+                for (auto it = _m_children.begin(); it != _m_children.end();)
+                {
+                    it = it->expired() ? _m_children.erase(it) : it + 1;
+                }
+                _m_children.push_back(group);
+                return;
+            }
+        }
+        group->cancel();
+    }
+
+    CancelState *CancelState::GetThis()
+    {
+        Fiber *fiber = Fiber::GetThisRaw();
+        return fiber ? fiber->cancelState() : nullptr;
+    }
+
+    std::shared_ptr<CancelState> TaskGroupState::join()
+    {
+        std::shared_ptr<CancelState> member = std::make_shared<CancelState>();
+        bool cancelled;
+        {
+            std::lock_guard<std::mutex> lock(_m_mutex);
+            _m_members.push_back(member);
+            cancelled = _m_cancelled;
+        }
+        if (cancelled)
+        {
+            member->cancel();
+        }
+        return member;
+    }
+
+    void TaskGroupState::leave(const std::shared_ptr<CancelState> &member, std::exception_ptr error)
+    {
+        bool cancel_others = false;
+        std::vector<std::shared_ptr<FiberWaiter>> waiters;
+        {
+            std::lock_guard<std::mutex> lock(_m_mutex);
+            for (auto it = _m_members.begin(); it != _m_members.end(); ++it)
+            {
+                if (*it == member)
+                {
+                    _m_members.erase(it);
+                    break;
+                }
+            }
+            if (error && !_m_error)
+            {
+                _m_error = error;
+                cancel_others = true;
+            }
+            if (_m_members.empty())
+            {
+                waiters.swap(_m_waiters);
+            }
+        }
+        if (cancel_others)
+        {
+            cancel();
+        }
+        for (auto &w : waiters)
+        {
+            w->wake();
+        }
+    }
+
+    void TaskGroupState::cancel()
+    {
+        std::list<std::shared_ptr<CancelState>> members;
+        {
+            std::lock_guard<std::mutex> lock(_m_mutex);
+            _m_cancelled = true;
+            members = _m_members;
+        }
+        for (auto &m : members)
+        {
+            m->cancel();
+        }
+    }
+
+    bool TaskGroupState::cancelled()
+    {
+        std::lock_guard<std::mutex> lock(_m_mutex);
+        return _m_cancelled;
+    }
+
+    std::exception_ptr TaskGroupState::wait()
+    {
+        while (true)
+        {
+            std::shared_ptr<FiberWaiter> waiter;
+            {
+                std::lock_guard<std::mutex> lock(_m_mutex);
+                if (_m_members.empty())
+                {
+                    return _m_error;
+                }
+                // 等待子任务结束不可取消：取消只会让子任务更快结束
+                waiter = std::make_shared<FiberWaiter>(false, false);
+                _m_waiters.push_back(waiter);
+            }
+            waiter->wait();
+        }
+    }
+
+    TaskGroup::TaskGroup(Scheduler *scheduler)
+        : _m_scheduler(scheduler ? scheduler : Scheduler::GetThis()), _m_state(std::make_shared<TaskGroupState>())
+    {
+        assert(_m_scheduler != nullptr);
+        // 在别的任务组的子任务里创建的组，随外层一起取消
+        if (CancelState *parent = CancelState::GetThis())
+        {
+            parent->addChild(_m_state);
+        }
+    }
+
+    TaskGroup::~TaskGroup()
+    {
+        _m_state->wait();
+    }
+
+    void TaskGroup::wait()
+    {
+        if (std::exception_ptr error = _m_state->wait())
+        {
+            std::rethrow_exception(error);
+        }
+    }
+
+    bool TaskGroup::IsCancelled()
+    {
+        CancelState *state = CancelState::GetThis();
+        return state && state->cancelled();
+    }
+}
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "fiber.h"
+#include "future.h"
+#include "scheduler.h"
+
+// 结构化并发：任务组和取消
+// TaskGroup::spawn启动的子任务都属于这个组，wait()（以及析构）等待全部子任务结束；
+// cancel()取消整个组：子任务阻塞在hook的I/O、sleep、FiberSemaphore/FiberCondVar/Channel/Select/Future上时立即被唤醒，
+// 这些调用返回失败且errno = ECANCELED（Future::get抛出std::system_error）。FiberMutex::lock不可取消
+// 子任务里再创建的TaskGroup是它的子组，外层取消会传递下去
+
+namespace nsCoroutine
+{
+    class TaskGroupState;
+
+    // 协程的取消状态，只有TaskGroup的子任务才有（Fiber里为空指针时没有任何开销）
+    // 阻塞点在挂起前用arm()登记"怎么把我叫醒"，恢复后disarm()；取消时调用登记的回调
+    class CancelState
+    {
+    public:
+        bool cancelled() const { return _m_cancelled.load(std::memory_order_acquire); }
+
+        // 登记唤醒回调，已经被取消时不登记并返回false
+        bool arm(std::function<void()> canceler);
+        // 撤销登记，返回后回调不会再被调用
+        void disarm();
+        // 取消：置位标志，唤醒正在阻塞的协程，并取消它创建的子组
+        void cancel();
+        // 登记这个协程里创建的子组
+        void addChild(const std::shared_ptr<TaskGroupState> &group);
+
+        // 当前协程的取消状态，没有返回nullptr
+        static CancelState *GetThis();
+
+    private:
+        std::atomic<bool> _m_cancelled{false};
+        std::mutex _m_mutex;
+        std::function<void()> _m_canceler;
+        std::vector<std::weak_ptr<TaskGroupState>> _m_children;
+    };
+
+    // 任务组的共享状态，子任务持有它的shared_ptr，TaskGroup对象析构后子任务仍然可以安全访问
+    class TaskGroupState
+    {
+    public:
+        // 登记一个子任务，返回它的取消状态
+        std::shared_ptr<CancelState> join();
+        // 子任务结束，error非空表示以异常结束：记录第一个异常并取消其余子任务
+        void leave(const std::shared_ptr<CancelState> &member, std::exception_ptr error);
+        void cancel();
+        bool cancelled();
+        // 挂起直到所有子任务结束，返回第一个异常
+        std::exception_ptr wait();
+
+    private:
+        std::mutex _m_mutex;
+        bool _m_cancelled = false;
+        std::list<std::shared_ptr<CancelState>> _m_members; // 正在运行的子任务
+        std::exception_ptr _m_error;
+        std::vector<std::shared_ptr<FiberWaiter>> _m_waiters;
+    };
+
+    class TaskGroup
+    {
+    public:
+        // 子任务在scheduler上执行，默认为当前线程的调度器
+        explicit TaskGroup(Scheduler *scheduler = nullptr);
+        // 等待所有子任务结束，不抛出异常
+        ~TaskGroup();
+        TaskGroup(const TaskGroup &) = delete;
+        TaskGroup &operator=(const TaskGroup &) = delete;
+
+        // 在组里启动子任务，返回它结果的Future；子任务抛出异常时整个组被取消
+        // 子任务继承当前协程的截止时间和优先级
+        template <typename F>
+        auto spawn(F &&f) -> Future<std::invoke_result_t<std::decay_t<F>>>
+        {
+            using R = std::invoke_result_t<std::decay_t<F>>;
+            std::shared_ptr<FutureState<R>> result = std::make_shared<FutureState<R>>();
+            std::shared_ptr<CancelState> member = _m_state->join();
+            Fiber *parent = Fiber::GetThisRaw();
+            uint64_t deadline = parent->getDeadline();
+            _m_scheduler->scheduleLock(std::function<void()>(
+                [group = _m_state, member, result, fn = std::forward<F>(f)]() mutable
+                {
+                    Fiber *self = Fiber::GetThisRaw();
+                    self->setCancelState(member);
+                    std::exception_ptr error;
+                    try
+                    {
+                        if constexpr (std::is_void_v<R>)
+                        {
+                            fn();
+                            result->setValue();
+                        }
+                        else
+                        {
+                            result->setValue(fn());
+                        }
+                    }
+                    catch (...)
+                    {
+                        error = std::current_exception();
+                        result->setException(error);
+                    }
+                    self->setCancelState(nullptr);
+                    group->leave(member, error);
+                }), -1, parent->getPriority(), deadline);
+            return Future<R>(std::move(result));
+        }
+
+        // 挂起直到所有子任务结束（不可取消），有子任务以异常结束时重新抛出第一个异常
+        void wait();
+        // 取消组内所有子任务
+        void cancel() { _m_state->cancel(); }
+        bool cancelled() { return _m_state->cancelled(); }
+
+        // 当前协程是否已经被取消，供计算密集的子任务主动检查
+        static bool IsCancelled();
+
+    private:
+        Scheduler *_m_scheduler;
+        std::shared_ptr<TaskGroupState> _m_state;
+    };
+}
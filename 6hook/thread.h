@@ -5,6 +5,7 @@
 #include <functional>
 #include <string>
 #include <condition_variable>
+#include <chrono>
 
 namespace nsCoroutine
 {
@@ -34,6 +35,18 @@ namespace nsCoroutine
             --_count;
         }
 
+        // 带超时的P操作，超时返回false
+        bool waitFor(uint64_t ms)
+        {
+            std::unique_lock<std::mutex> lock(_mtx);
+            if (!_cv.wait_for(lock, std::chrono::milliseconds(ms), [this]() { return _count > 0; }))
+            {
+                return false;
+            }
+            --_count;
+            return true;
+        }
+
         // V操作，+1
         void signal()
         {
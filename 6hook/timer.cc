@@ -87,7 +87,7 @@ namespace nsCoroutine
 
     //构造函数
     Timer::Timer(uint64_t ms, std::function<void()> cb, bool recurring, TimerManager* manager)
-        :_m_recurring(recurring), _m_ms(ms), _m_cb(cb), _m_manager(manager)
+        :_m_recurring(recurring), _m_ms(ms), _m_cb(std::move(cb)), _m_manager(manager)
     {
         auto now = std::chrono::system_clock::now();    //当前时间
         _m_next = now + std::chrono::milliseconds(ms);  //计算绝对时间 = 当前时间now + _m_ms
@@ -113,7 +113,7 @@ namespace nsCoroutine
     //添加新的定时器到定时器管理器中，并在必要时唤醒管理中的线程，准确的来说是在ioscheduler类的阻塞中的epoll，以确保定时器能够及时触发后回调函数
     std::shared_ptr<Timer> TimerManager::addTimer(uint64_t ms, std::function<void()> cb, bool recurring)
     {
-        std::shared_ptr<Timer> timer(new Timer(ms, cb, recurring, this));
+        std::shared_ptr<Timer> timer(new Timer(ms, std::move(cb), recurring, this));
         addTimer(timer);
         return timer;
     }
@@ -147,7 +147,8 @@ namespace nsCoroutine
         }
     }
 
-    static void OnTimer(std::weak_ptr<void> weak_cond, std::function<void()> cb)
+    //参数使用const引用，std::bind保存的weak_ptr和cb在每次触发时不再被复制
+    static void OnTimer(const std::weak_ptr<void>& weak_cond, const std::function<void()>& cb)
     {
         //确保当前条件的对象仍然存在
         std::shared_ptr<void> tmp = weak_cond.lock();
@@ -160,7 +161,7 @@ namespace nsCoroutine
     std::shared_ptr<Timer> TimerManager::addConditionTimer(uint64_t ms, std::function<void()> cb, std::weak_ptr<void> weak_cond, bool recurring)
     {
         //将OnTimer的真正指向交给了第一个addtimer，然后创建timer对象
-        return addTimer(ms, std::bind(&OnTimer, weak_cond, cb), recurring);
+        return addTimer(ms, std::bind(&OnTimer, std::move(weak_cond), std::move(cb)), recurring);
     }
 
     //获取下一次超时时间
@@ -211,17 +212,18 @@ namespace nsCoroutine
             std::shared_ptr<Timer> temp = *_m_timers.begin();
             _m_timers.erase(_m_timers.begin());
 
-            cbs.push_back(temp->_m_cb);
             //如果定时器是循环的，_m_next属性设置为当前时间加上定时器的间隔(_m_ms)，然后重新插入到定时器集合中
             if(temp->_m_recurring)
             {
+                cbs.push_back(temp->_m_cb);
                 //重新加入时间堆
                 temp->_m_next = now + std::chrono::milliseconds(temp->_m_ms);
-                _m_timers.insert(temp);
+                _m_timers.insert(std::move(temp));
             }
             else
             {
-                //清理cb
+                //一次性定时器直接把cb移动出去，移动后置空，cancel()仍能据此判断定时器已失效
+                cbs.push_back(std::move(temp->_m_cb));
                 temp->_m_cb = nullptr;
             }
         }
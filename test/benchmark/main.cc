@@ -0,0 +1,1025 @@
+// 协程库的性能测试
+// 编译：g++ -std=c++17 -O2 -I../../6hook main.cc $(ls ../../6hook/*.cc | grep -v -i test.cc) -o main -ldl -pthread
+// 运行：./main [用例名]，不带参数时运行全部用例，结果校验失败时返回1
+#include "ioManager.h"
+#include "hook.h"
+#include "fiberSync.h"
+#include "channel.h"
+#include "select.h"
+#include "fdManager.h"
+#include "deadline.h"
+#include "resolver.h"
+#include "pthreadHook.h"
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <chrono>
+#include <mutex>
+#include <shared_mutex>
+#include <algorithm>
+#include <string>
+#include <functional>
+#include <thread>
+#include <vector>
+#include <sys/socket.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+static const int WORKER_THREADS = 4;
+
+static double now_ms()
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// 记录一批协程全部完成的时间点
+// IOManager析构时空闲线程可能要等epoll_wait超时才退出，计时不能包含析构
+struct Finish
+{
+    explicit Finish(int n) : left(n) {}
+    void done()
+    {
+        if (--left == 0)
+        {
+            end = now_ms();
+        }
+    }
+    std::atomic<int> left;
+    double end = 0;
+};
+
+// 校验用例的结果：不对时打印出来并计数，main最后返回非0
+static int s_failed = 0;
+
+static void expect(bool ok, const char *what)
+{
+    if (!ok)
+    {
+        printf("  FAILED: %s\n", what);
+        ++s_failed;
+    }
+}
+
+// 在临界区里模拟一点计算量
+static void busy_work(int n)
+{
+    volatile int x = 0;
+    for (int i = 0; i < n; ++i)
+    {
+        x = x + i;
+    }
+}
+
+// 10k个协程争抢同一把锁，比较std::mutex和FiberMutex
+template <typename Mutex>
+static void mutex_case(const char *name, int fibers, int iters, int work)
+{
+    Mutex mtx;
+    long counter = 0;
+    Finish finish(fibers);
+    double start = now_ms();
+    {
+        nsCoroutine::IOManager iom(WORKER_THREADS, false, "bench");
+        for (int i = 0; i < fibers; ++i)
+        {
+            iom.scheduleLock([&]()
+            {
+                for (int j = 0; j < iters; ++j)
+                {
+                    std::lock_guard<Mutex> lock(mtx);
+                    ++counter;
+                    busy_work(work);
+                }
+                finish.done();
+            });
+        }
+    }
+    double cost = finish.end - start;
+    printf("%-12s fibers=%d iters=%d work=%d: %8.1f ms, %10.0f lock/s, counter=%ld\n",
+           name, fibers, iters, work, cost, counter / cost * 1000, counter);
+    expect(counter == (long)fibers * iters, "counter == fibers * iters");
+}
+
+static void bench_mutex()
+{
+    const int fibers = 10000;
+    for (int work : {0, 200})
+    {
+        mutex_case<std::mutex>("std::mutex", fibers, 100, work);
+        mutex_case<nsCoroutine::FiberMutex>("FiberMutex", fibers, 100, work);
+    }
+
+    // 持锁期间让出协程（例如在锁内做hook的I/O），std::mutex会把其他工作线程也卡住，只测FiberMutex
+    nsCoroutine::FiberMutex mtx;
+    long counter = 0;
+    Finish finish(1000);
+    double start = now_ms();
+    {
+        nsCoroutine::IOManager iom(WORKER_THREADS, false, "bench");
+        for (int i = 0; i < 1000; ++i)
+        {
+            iom.scheduleLock([&]()
+            {
+                {
+                    std::lock_guard<nsCoroutine::FiberMutex> lock(mtx);
+                    ++counter;
+                    usleep(1000);
+                }
+                finish.done();
+            });
+        }
+    }
+    printf("FiberMutex holding across usleep(1000): 1000 fibers, %.1f ms, counter=%ld\n", finish.end - start, counter);
+    expect(counter == 1000, "counter == 1000");
+}
+
+// 一个生产者协程向一个消费者协程发送消息
+// 同线程：两个协程在同一个单线程IOManager里；跨线程：生产者和消费者各在一个单线程IOManager里
+// 每个线程只能创建一个调度器，跨线程时消费者的IOManager在另一个线程里创建
+static void channel_case(const char *name, size_t capacity, bool cross_thread, long messages)
+{
+    nsCoroutine::Channel<long> ch(capacity);
+    long sum = 0;
+    Finish finish(1);
+    auto consume = [&]()
+    {
+        long v;
+        for (long i = 0; i < messages; ++i)
+        {
+            ch.recv(v);
+            sum += v;
+        }
+        finish.done();
+    };
+    double start = now_ms();
+    {
+        std::thread consumer_thread;
+        nsCoroutine::IOManager producer(1, false, "producer");
+        if (cross_thread)
+        {
+            consumer_thread = std::thread([&]()
+            {
+                nsCoroutine::IOManager consumer(1, false, "consumer");
+                consumer.scheduleLock(consume);
+            });
+        }
+        else
+        {
+            producer.scheduleLock(consume);
+        }
+        producer.scheduleLock([&]()
+        {
+            for (long i = 0; i < messages; ++i)
+            {
+                ch.send(i);
+            }
+        });
+        if (consumer_thread.joinable())
+        {
+            consumer_thread.join();
+        }
+    }
+    double cost = finish.end - start;
+    printf("%-14s capacity=%-10s: %8.1f ms, %10.0f msg/s, sum_ok=%d\n", name,
+           capacity == nsCoroutine::Channel<long>::UNBOUNDED ? "unbounded" : std::to_string(capacity).c_str(),
+           cost, messages / cost * 1000, sum == messages * (messages - 1) / 2);
+    expect(sum == messages * (messages - 1) / 2, "channel received every message once");
+}
+
+static void bench_channel()
+{
+    const long messages = 2000000;
+    for (size_t capacity : {(size_t)2, (size_t)128, nsCoroutine::Channel<long>::UNBOUNDED})
+    {
+        channel_case("same-thread", capacity, false, messages);
+        channel_case("cross-thread", capacity, true, messages);
+    }
+}
+
+// 汇聚sources个通道的消息：用一个Select协程直接等待所有通道，对比每个通道配一个转发协程写进同一个通道
+static void fanin_case(bool use_select, int sources, long per_source)
+{
+    std::vector<std::unique_ptr<nsCoroutine::Channel<long>>> inputs;
+    for (int i = 0; i < sources; ++i)
+    {
+        inputs.emplace_back(new nsCoroutine::Channel<long>(64));
+    }
+    nsCoroutine::Channel<long> merged(64);
+    long sum = 0;
+    int helper_fibers = 0;
+    Finish finish(1);
+    double start = now_ms();
+    {
+        nsCoroutine::IOManager iom(WORKER_THREADS, false, "bench");
+        for (int i = 0; i < sources; ++i)
+        {
+            iom.scheduleLock([&, i]()
+            {
+                for (long k = 0; k < per_source; ++k)
+                {
+                    inputs[i]->send(k);
+                }
+                inputs[i]->close();
+            });
+        }
+        if (use_select)
+        {
+            iom.scheduleLock([&]()
+            {
+                // Select在循环外构造一次，通道关闭后停用对应分支
+                nsCoroutine::Select sel;
+                long v;
+                bool ok;
+                for (int i = 0; i < sources; ++i)
+                {
+                    sel.recv(*inputs[i], v, &ok);
+                }
+                for (int left = sources; left > 0;)
+                {
+                    int r = sel.wait();
+                    if (ok)
+                    {
+                        sum += v;
+                    }
+                    else
+                    {
+                        sel.disable(r);
+                        --left;
+                    }
+                }
+                finish.done();
+            });
+        }
+        else
+        {
+            helper_fibers = sources;
+            std::atomic<int> forwarding(sources);
+            for (int i = 0; i < sources; ++i)
+            {
+                iom.scheduleLock([&, i]()
+                {
+                    long v;
+                    while (inputs[i]->recv(v))
+                    {
+                        merged.send(v);
+                    }
+                    if (--forwarding == 0)
+                    {
+                        merged.close();
+                    }
+                });
+            }
+            iom.scheduleLock([&]()
+            {
+                long v;
+                while (merged.recv(v))
+                {
+                    sum += v;
+                }
+                finish.done();
+            });
+        }
+    }
+    double cost = finish.end - start;
+    long total = sources * per_source;
+    printf("%-18s sources=%d helper_fibers=%-3d (stacks %4d KB): %8.1f ms, %10.0f msg/s, sum_ok=%d\n",
+           use_select ? "select" : "forwarder fibers", sources, helper_fibers, helper_fibers * 128,
+           cost, total / cost * 1000, sum == sources * (per_source * (per_source - 1) / 2));
+    expect(sum == sources * (per_source * (per_source - 1) / 2), "merged every message once");
+}
+
+static void bench_select()
+{
+    for (int sources : {8, 64})
+    {
+        fanin_case(true, sources, 100000);
+        fanin_case(false, sources, 100000);
+    }
+}
+
+// fibers个协程各做rounds轮屏障同步，比较FiberBarrier和原子计数+sleep轮询
+static void barrier_case(bool use_barrier, int fibers, int rounds)
+{
+    nsCoroutine::FiberBarrier barrier(fibers);
+    std::atomic<int> arrived{0};
+    std::atomic<int> generation{0};
+    std::atomic<long> polls{0};
+    Finish finish(fibers);
+    double start = now_ms();
+    {
+        nsCoroutine::IOManager iom(WORKER_THREADS, false, "bench");
+        for (int i = 0; i < fibers; ++i)
+        {
+            iom.scheduleLock([&]()
+            {
+                for (int r = 0; r < rounds; ++r)
+                {
+                    if (use_barrier)
+                    {
+                        barrier.wait();
+                        continue;
+                    }
+                    int gen = generation.load();
+                    if (arrived.fetch_add(1) + 1 == fibers)
+                    {
+                        arrived.store(0);
+                        generation.fetch_add(1);
+                        continue;
+                    }
+                    while (generation.load() == gen)
+                    {
+                        ++polls;
+                        usleep(1000);
+                    }
+                }
+                finish.done();
+            });
+        }
+    }
+    double cost = finish.end - start;
+    printf("%-18s fibers=%d rounds=%d: %8.1f ms, %8.1f us/round, polls=%ld\n",
+           use_barrier ? "FiberBarrier" : "atomic+usleep", fibers, rounds, cost, cost * 1000 / rounds, polls.load());
+}
+
+static void bench_barrier()
+{
+    for (int fibers : {16, 1000})
+    {
+        barrier_case(true, fibers, 200);
+        barrier_case(false, fibers, 200);
+    }
+}
+
+// 读多写少：每个协程反复加读锁查一张小表，每write_every次操作做一次写
+template <typename RWMutex>
+static void rwlock_case(const char *name, int fibers, int iters, int write_every)
+{
+    RWMutex mtx;
+    std::vector<long> table(16, 1);
+    std::atomic<long> sum{0};
+    Finish finish(fibers);
+    double start = now_ms();
+    {
+        nsCoroutine::IOManager iom(WORKER_THREADS, false, "bench");
+        for (int i = 0; i < fibers; ++i)
+        {
+            iom.scheduleLock([&, i]()
+            {
+                long local = 0;
+                for (int j = 0; j < iters; ++j)
+                {
+                    if ((i * iters + j) % write_every == 0)
+                    {
+                        std::unique_lock<RWMutex> lock(mtx);
+                        ++table[j % table.size()];
+                    }
+                    else
+                    {
+                        std::shared_lock<RWMutex> lock(mtx);
+                        local += table[j % table.size()];
+                    }
+                }
+                sum += local;
+                finish.done();
+            });
+        }
+    }
+    double cost = finish.end - start;
+    long ops = (long)fibers * iters;
+    printf("%-18s fibers=%d iters=%d write_every=%-6d: %8.1f ms, %10.0f op/s\n",
+           name, fibers, iters, write_every, cost, ops / cost * 1000);
+}
+
+static void bench_rwlock()
+{
+    for (int write_every : {100000, 1000})
+    {
+        rwlock_case<std::shared_mutex>("std::shared_mutex", 64, 200000, write_every);
+        rwlock_case<nsCoroutine::FiberRWMutex>("FiberRWMutex", 64, 200000, write_every);
+    }
+}
+
+// 读/proc/self/status里的一项（KB）
+static long proc_status_kb(const char *key)
+{
+    FILE *f = fopen("/proc/self/status", "r");
+    char line[256];
+    long value = 0;
+    size_t len = strlen(key);
+    while (f && fgets(line, sizeof(line), f))
+    {
+        if (strncmp(line, key, len) == 0)
+        {
+            value = atol(line + len + 1);
+            break;
+        }
+    }
+    if (f)
+    {
+        fclose(f);
+    }
+    return value;
+}
+
+// 模拟处理一个请求：用掉几KB栈，返回后这部分栈就不再需要了
+__attribute__((noinline)) static void handle_request(int fd)
+{
+    char request[8192];
+    memset(request, fd, sizeof(request));
+    // 阻止编译器把没有读到的写入优化掉
+    asm volatile("" : : "r"(request) : "memory");
+    busy_work(request[100]);
+}
+
+// conns个连接协程先处理一个请求，然后阻塞在read上等待下一个请求，
+// 所有协程都挂起后统计每个连接的内存开销，比较独立栈和共享栈
+static void conn_memory_case(bool shared_stack, int conns)
+{
+    std::vector<int> fds(conns * 2);
+    for (int i = 0; i < conns; ++i)
+    {
+        socketpair(AF_UNIX, SOCK_STREAM, 0, &fds[i * 2]);
+        nsCoroutine::FdMgr::GetInstance()->get(fds[i * 2], true);
+    }
+    std::atomic<int> parked{0};
+    Finish finish(conns);
+    long rss0 = proc_status_kb("VmRSS:"), vm0 = proc_status_kb("VmSize:");
+    long rss = 0, vm = 0;
+    double start = now_ms(), woke = 0;
+    {
+        nsCoroutine::IOManager iom(WORKER_THREADS, false, "bench");
+        iom.setSharedStack(shared_stack);
+        for (int i = 0; i < conns; ++i)
+        {
+            int fd = fds[i * 2];
+            iom.scheduleLock([&, fd]()
+            {
+                handle_request(fd);
+                ++parked;
+                char c;
+                read(fd, &c, 1);
+                finish.done();
+            });
+        }
+        while (parked.load() < conns)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        rss = proc_status_kb("VmRSS:") - rss0;
+        vm = proc_status_kb("VmSize:") - vm0;
+        woke = now_ms();
+        for (int i = 0; i < conns; ++i)
+        {
+            write(fds[i * 2 + 1], "x", 1);
+        }
+    }
+    // 主线程没有启用hook，close不会清理FdManager，手动删除，否则复用的fd号会拿到旧的FdCtx
+    for (int fd : fds)
+    {
+        nsCoroutine::FdMgr::GetInstance()->del(fd);
+        close(fd);
+    }
+    printf("%-13s conns=%d: RSS %6.1f KB/conn, virtual %6.1f KB/conn, park %7.1f ms, wake all %7.1f ms\n",
+           shared_stack ? "shared stack" : "private stack", conns, (double)rss / conns, (double)vm / conns,
+           woke - start, finish.end - woke);
+}
+
+static void bench_stack()
+{
+    conn_memory_case(false, 5000);
+    conn_memory_case(true, 5000);
+
+    // 栈高水位统计：用来按实际用量调整默认栈大小
+    nsCoroutine::Fiber::SetStackProfiling(true);
+    conn_memory_case(false, 5000);
+    nsCoroutine::Fiber::SetStackProfiling(false);
+    nsCoroutine::Fiber::StackStats stats = nsCoroutine::Fiber::GetStackStats();
+    printf("stack high-water: fibers=%lu avg=%.1f KB max=%.1f KB histogram:",
+           (unsigned long)stats.fibers, stats.fibers ? stats.totalBytes / 1024.0 / stats.fibers : 0.0, stats.maxBytes / 1024.0);
+    for (size_t i = 0; i < nsCoroutine::Fiber::STACK_HISTOGRAM_BUCKETS; ++i)
+    {
+        printf(" <=%dK:%lu", 4 << i, (unsigned long)stats.histogram[i]);
+    }
+    printf("\n");
+}
+
+// 调度延迟：工作线程一直忙于批量任务（任务结束前再提交一个，队列深度保持不变），
+// 另一个线程每2ms提交一个探测任务，统计从提交到开始执行的时间
+static void priority_case(int probe_priority, int backlog, int probes)
+{
+    static const char *names[] = {"high", "normal", "low"};
+    std::atomic<bool> running{true};
+    std::atomic<long> bulk_done{0};
+    std::vector<double> latency(probes);
+    Finish finish(probes);
+    {
+        nsCoroutine::IOManager iom(WORKER_THREADS, false, "bench");
+        std::function<void()> bulk = [&]()
+        {
+            busy_work(20000);
+            ++bulk_done;
+            if (running)
+            {
+                iom.scheduleLock(bulk);
+            }
+        };
+        for (int i = 0; i < backlog; ++i)
+        {
+            iom.scheduleLock(bulk);
+        }
+        for (int i = 0; i < probes; ++i)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+            double submit = now_ms();
+            iom.scheduleLock(std::function<void()>([&, i, submit]()
+            {
+                latency[i] = now_ms() - submit;
+                finish.done();
+            }), -1, probe_priority);
+        }
+        while (finish.left > 0)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        running = false;
+    }
+    std::sort(latency.begin(), latency.end());
+    printf("probe=%-6s backlog=%d: p50 %8.3f ms, p99 %8.3f ms, max %8.3f ms, bulk tasks %ld\n",
+           names[probe_priority], backlog, latency[probes / 2], latency[probes * 99 / 100], latency.back(), bulk_done.load());
+}
+
+static void bench_priority()
+{
+    for (int backlog : {100, 1000})
+    {
+        priority_case(nsCoroutine::Fiber::PRIORITY_NORMAL, backlog, 500);
+        priority_case(nsCoroutine::Fiber::PRIORITY_HIGH, backlog, 500);
+        // 低优先级不会饿死：每轮至少有一次机会
+        priority_case(nsCoroutine::Fiber::PRIORITY_LOW, backlog, 500);
+    }
+}
+
+// 协作式抢占：一个工作线程上有一个连续计算300ms的任务（循环里调用yield_point()作为安全点），
+// 另一个线程每2ms提交一个探测任务，统计从提交到开始执行的时间
+static void preempt_case(uint64_t slice_ms, int probes)
+{
+    std::vector<double> latency(probes);
+    Finish finish(probes);
+    uint64_t overruns;
+    {
+        nsCoroutine::IOManager iom(1, false, "bench");
+        iom.setTimeSlice(slice_ms);
+        iom.scheduleLock([&]()
+        {
+            double end = now_ms() + 300;
+            while (now_ms() < end)
+            {
+                busy_work(10000);
+                nsCoroutine::yield_point();
+            }
+        });
+        for (int i = 0; i < probes; ++i)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+            double submit = now_ms();
+            iom.scheduleLock([&, i, submit]()
+            {
+                latency[i] = now_ms() - submit;
+                finish.done();
+            });
+        }
+        while (finish.left > 0)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        overruns = iom.getSliceOverruns();
+    }
+    std::sort(latency.begin(), latency.end());
+    printf("time slice %3lu ms: probe p50 %8.3f ms, p99 %8.3f ms, max %8.3f ms, overruns %lu\n",
+           (unsigned long)slice_ms, latency[probes / 2], latency[probes * 99 / 100], latency.back(), (unsigned long)overruns);
+}
+
+static void bench_preempt()
+{
+    for (uint64_t slice : {0, 10, 2})
+    {
+        preempt_case(slice, 100);
+    }
+}
+
+// 截止时间模拟：用真实的调度策略对象排队，但在虚拟时间里执行（每个任务固定耗时100us），结果不受机器抖动影响
+// 任务按泊松过程到达，截止时间为到达后0.5~5ms；load是到达速率和处理能力之比，
+// burst为true时每10ms里前2ms的到达速率是load的3倍、其余时间降低，平均负载不变（短时过载）
+// 统计完成时已经超过截止时间的任务数，比较默认策略（同一优先级就是FIFO）和EDF
+static void edf_case(bool edf, double load, bool burst, int tasks)
+{
+    const uint64_t cost = 100; // us
+    std::unique_ptr<nsCoroutine::SchedulePolicy> policy;
+    if (edf)
+    {
+        policy.reset(new nsCoroutine::EdfPolicy());
+    }
+    else
+    {
+        policy.reset(new nsCoroutine::PriorityPolicy());
+    }
+    unsigned seed = 12345;
+    auto random01 = [&seed]()
+    {
+        seed = seed * 1103515245 + 12345;
+        return ((seed >> 8) & 0xffff) / 65536.0;
+    };
+    std::vector<uint64_t> arrival(tasks), deadline(tasks);
+    double t = 0;
+    for (int i = 0; i < tasks; ++i)
+    {
+        double rate = load;
+        if (burst)
+        {
+            rate = (uint64_t)t % 10000 < 2000 ? load * 3 : load * 0.5;
+        }
+        t += -std::log(1 - random01()) * cost / rate;
+        arrival[i] = (uint64_t)t;
+        deadline[i] = arrival[i] + 500 + (uint64_t)(random01() * 4500);
+    }
+
+    uint64_t now = 0;
+    int next = 0, done = 0, missed = 0;
+    uint64_t late_total = 0;
+    while (done < tasks)
+    {
+        // 到达的任务入队，空闲时直接跳到下一个任务到达
+        if (policy->empty() && now < arrival[next])
+        {
+            now = arrival[next];
+        }
+        while (next < tasks && arrival[next] <= now)
+        {
+            nsCoroutine::ScheduleTask task(std::function<void()>([] {}), -1);
+            task.prepare(-1, deadline[next]);
+            policy->push(std::move(task));
+            ++next;
+        }
+        nsCoroutine::ScheduleTask task;
+        bool tickle = false;
+        policy->take(task, 0, tickle);
+        now += cost;
+        ++done;
+        if (now > task._deadline)
+        {
+            ++missed;
+            late_total += now - task._deadline;
+        }
+    }
+    printf("%-4s load=%.2f%s tasks=%d: missed %6d (%5.1f%%), avg lateness of missed %8.2f ms\n",
+           edf ? "EDF" : "FIFO", load, burst ? " burst" : "", tasks, missed, 100.0 * missed / tasks,
+           missed ? late_total / 1000.0 / missed : 0.0);
+}
+
+static void bench_edf()
+{
+    for (double load : {0.8, 0.95})
+    {
+        for (bool burst : {false, true})
+        {
+            edf_case(false, load, burst, 100000);
+            edf_case(true, load, burst, 100000);
+        }
+    }
+    // 持续过载：队列无限增长，两种策略几乎全部超时，这时需要的是限流而不是调度顺序
+    edf_case(false, 1.2, false, 100000);
+    edf_case(true, 1.2, false, 100000);
+}
+
+// 本机的DNS桩服务器：每个查询延迟delay_ms后应答一条A记录（TTL 300s），模拟到递归服务器的往返
+// 运行在普通线程里，用的是原始的阻塞调用
+static void dns_stub(int fd, int delay_ms, std::atomic<bool> &stop)
+{
+    struct Pending
+    {
+        double due;
+        std::string reply;
+        struct sockaddr_in from;
+    };
+    std::vector<Pending> pending;
+    struct timeval tv = {0, 1000};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    unsigned char buf[512];
+    while (!stop)
+    {
+        struct sockaddr_in from;
+        socklen_t len = sizeof(from);
+        ssize_t n = recvfrom(fd, buf, sizeof(buf), 0, (struct sockaddr *)&from, &len);
+        if (n > 12)
+        {
+            // 原样带回头部和问题，加一条指向问题名字的A记录
+            std::string reply((char *)buf, n);
+            reply[2] = (char)0x81;
+            reply[3] = (char)0x80;
+            reply[7] = 1;
+            const unsigned char answer[] = {0xc0, 0x0c, 0, 1, 0, 1, 0, 0, 0x01, 0x2c, 0, 4, 10, 0, 0, 1};
+            reply.append((const char *)answer, sizeof(answer));
+            pending.push_back({now_ms() + delay_ms, reply, from});
+        }
+        double now = now_ms();
+        for (auto it = pending.begin(); it != pending.end();)
+        {
+            if (it->due <= now)
+            {
+                sendto(fd, it->reply.data(), it->reply.size(), 0, (struct sockaddr *)&it->from, sizeof(it->from));
+                it = pending.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+    }
+}
+
+static int resolve_one(const std::string &name)
+{
+    struct addrinfo hints = {};
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    struct addrinfo *res = nullptr;
+    int rt = getaddrinfo(name.c_str(), "80", &hints, &res);
+    if (rt == 0)
+    {
+        freeaddrinfo(res);
+    }
+    return rt;
+}
+
+// 一个工作线程上用hook的getaddrinfo解析names个不同的域名，桩服务器每个应答延迟5ms
+// concurrent为false时在一个协程里依次解析，相当于阻塞的getaddrinfo在这个线程上的耗时
+static void resolve_case(const char *name, bool concurrent, int names, const std::string &prefix)
+{
+    nsCoroutine::Resolver *resolver = nsCoroutine::Resolver::GetInstance();
+    uint64_t queries = resolver->getQueries();
+    std::atomic<int> failed{0};
+    double start, end;
+    {
+        nsCoroutine::IOManager iom(1, false, "bench");
+        Finish finish(concurrent ? names : 1);
+        start = now_ms();
+        if (concurrent)
+        {
+            for (int i = 0; i < names; ++i)
+            {
+                iom.scheduleLock([&, i]()
+                {
+                    failed += resolve_one(prefix + std::to_string(i) + ".bench") != 0;
+                    finish.done();
+                });
+            }
+        }
+        else
+        {
+            iom.scheduleLock([&]()
+            {
+                for (int i = 0; i < names; ++i)
+                {
+                    failed += resolve_one(prefix + std::to_string(i) + ".bench") != 0;
+                }
+                finish.done();
+            });
+        }
+        while (finish.left > 0)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        end = finish.end;
+    }
+    printf("%-34s %4d names: %8.2f ms, dns queries %4lu, failed %d\n",
+           name, names, end - start, (unsigned long)(resolver->getQueries() - queries), failed.load());
+}
+
+// hosts文件里的名字：libc每次调用都重新读文件，hook之后解析一次常驻内存
+static void hosts_case(bool hooked, int calls)
+{
+    double start = 0, end = 0;
+    int failed = 0;
+    auto run = [&]()
+    {
+        start = now_ms();
+        for (int i = 0; i < calls; ++i)
+        {
+            failed += resolve_one("localhost") != 0;
+        }
+        end = now_ms();
+    };
+    if (hooked)
+    {
+        nsCoroutine::IOManager iom(1, false, "bench");
+        Finish finish(1);
+        iom.scheduleLock([&]()
+        {
+            run();
+            finish.done();
+        });
+        while (finish.left > 0)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+    else
+    {
+        run();
+    }
+    printf("hosts lookup, %-20s %6d calls: %8.2f us/call, failed %d\n", hooked ? "hooked getaddrinfo" : "libc getaddrinfo", calls, (end - start) * 1000 / calls, failed);
+}
+
+static void bench_resolve()
+{
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(addr);
+    bind(fd, (struct sockaddr *)&addr, len);
+    getsockname(fd, (struct sockaddr *)&addr, &len);
+    std::atomic<bool> stop{false};
+    std::thread stub(dns_stub, fd, 5, std::ref(stop));
+    nsCoroutine::Resolver::GetInstance()->setNameservers({"127.0.0.1:" + std::to_string(ntohs(addr.sin_port))});
+
+    resolve_case("sequential (= blocking resolver)", false, 200, "seq");
+    resolve_case("concurrent fibers", true, 200, "con");
+    resolve_case("concurrent fibers, cached", true, 200, "con");
+    hosts_case(false, 2000);
+    hosts_case(true, 2000);
+
+    stop = true;
+    stub.join();
+    close(fd);
+}
+
+// 旧代码的pthread互斥锁：协程在4个工作线程上争抢同一把锁，临界区里计算约50us，
+// 同时每2ms提交一个探测任务，统计从提交到开始执行的时间。不开pthread hook时等锁的协程把工作线程卡住
+// yield为true时持锁期间改做hook的usleep(1000)：不开pthread hook会死锁（工作线程全部阻塞，持锁协程的定时器无人处理），只测hook版本
+static void pthread_mutex_case(bool hooked, bool yield, int fibers, int iters, int probes)
+{
+    nsCoroutine::set_pthread_hook_enable(hooked);
+    pthread_mutex_t mtx = PTHREAD_MUTEX_INITIALIZER;
+    long counter = 0;
+    std::vector<double> latency(probes);
+    Finish locked(fibers);
+    Finish finish(probes);
+    double start = now_ms();
+    {
+        nsCoroutine::IOManager iom(WORKER_THREADS, false, "bench");
+        for (int i = 0; i < fibers; ++i)
+        {
+            iom.scheduleLock([&]()
+            {
+                for (int j = 0; j < iters; ++j)
+                {
+                    pthread_mutex_lock(&mtx);
+                    ++counter;
+                    if (yield)
+                    {
+                        usleep(1000);
+                    }
+                    else
+                    {
+                        busy_work(20000);
+                    }
+                    pthread_mutex_unlock(&mtx);
+                }
+                locked.done();
+            });
+        }
+        for (int i = 0; i < probes; ++i)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+            double submit = now_ms();
+            iom.scheduleLock([&, i, submit]()
+            {
+                latency[i] = now_ms() - submit;
+                finish.done();
+            });
+        }
+        while (finish.left > 0 || locked.left > 0)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+    nsCoroutine::set_pthread_hook_enable(false);
+    std::sort(latency.begin(), latency.end());
+    printf("pthread_mutex %-8s %-14s %d fibers x %d: %7.1f ms, probe p50 %7.3f ms, max %7.3f ms, counter=%ld\n",
+           hooked ? "hooked" : "original", yield ? "usleep(1000)" : "busy ~50us", fibers, iters,
+           locked.end - start, latency[probes / 2], latency.back(), counter);
+    expect(counter == (long)fibers * iters, "counter == fibers * iters");
+}
+
+// 单工作线程上的生产者/消费者，用pthread_cond_wait等待；不开pthread hook时消费者阻塞线程，生产者永远得不到运行，只测hook版本
+static void pthread_cond_case(long items)
+{
+    nsCoroutine::set_pthread_hook_enable(true);
+    pthread_mutex_t mtx = PTHREAD_MUTEX_INITIALIZER;
+    pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
+    long produced = 0, consumed = 0;
+    Finish finish(2);
+    double start = now_ms();
+    {
+        nsCoroutine::IOManager iom(1, false, "bench");
+        iom.scheduleLock([&]()
+        {
+            pthread_mutex_lock(&mtx);
+            while (consumed < items)
+            {
+                while (consumed == produced)
+                {
+                    pthread_cond_wait(&cond, &mtx);
+                }
+                ++consumed;
+                pthread_cond_signal(&cond);
+            }
+            pthread_mutex_unlock(&mtx);
+            finish.done();
+        });
+        iom.scheduleLock([&]()
+        {
+            pthread_mutex_lock(&mtx);
+            while (produced < items)
+            {
+                while (produced > consumed)
+                {
+                    pthread_cond_wait(&cond, &mtx);
+                }
+                ++produced;
+                pthread_cond_signal(&cond);
+            }
+            pthread_mutex_unlock(&mtx);
+            finish.done();
+        });
+        while (finish.left > 0)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+    nsCoroutine::set_pthread_hook_enable(false);
+    double cost = finish.end - start;
+    printf("pthread_cond ping-pong on one worker, %ld items: %8.1f ms, %10.0f handoff/s\n", items, cost, items / cost * 1000);
+}
+
+// 协程外的无竞争加解锁：hook只多一次开关检查
+static void pthread_passthrough_case(bool enable, long iters)
+{
+    nsCoroutine::set_pthread_hook_enable(enable);
+    pthread_mutex_t mtx = PTHREAD_MUTEX_INITIALIZER;
+    double start = now_ms();
+    for (long i = 0; i < iters; ++i)
+    {
+        pthread_mutex_lock(&mtx);
+        pthread_mutex_unlock(&mtx);
+    }
+    double cost = now_ms() - start;
+    nsCoroutine::set_pthread_hook_enable(false);
+    printf("uncontended lock/unlock outside fibers, pthread hook %-3s: %6.2f ns/op\n", enable ? "on" : "off", cost * 1e6 / iters);
+}
+
+static void bench_pthread()
+{
+    pthread_passthrough_case(false, 10000000);
+    pthread_passthrough_case(true, 10000000);
+    pthread_mutex_case(false, false, 100, 20, 50);
+    pthread_mutex_case(true, false, 100, 20, 50);
+    pthread_mutex_case(true, true, 100, 1, 20);
+    pthread_cond_case(100000);
+}
+
+int main(int argc, char *argv[])
+{
+    std::vector<std::pair<std::string, std::function<void()>>> cases = {
+        {"mutex", bench_mutex},
+        {"channel", bench_channel},
+        {"select", bench_select},
+        {"barrier", bench_barrier},
+        {"rwlock", bench_rwlock},
+        {"stack", bench_stack},
+        {"priority", bench_priority},
+        {"edf", bench_edf},
+        {"preempt", bench_preempt},
+        {"resolve", bench_resolve},
+        {"pthread", bench_pthread},
+    };
+    for (auto &c : cases)
+    {
+        if (argc < 2 || c.first == argv[1])
+        {
+            printf("==== %s ====\n", c.first.c_str());
+            c.second();
+        }
+    }
+    if (s_failed)
+    {
+        printf("%d check(s) failed\n", s_failed);
+        return 1;
+    }
+    return 0;
+}